@@ -1,8 +1,23 @@
 #!/bin/bash
 
-# SLURM job script for testing MPI + OpenMP scaling performance
-# This script runs multiple configurations to analyze parallel efficiency
-# Submit with: sbatch performance_test.sh
+# MPI + OpenMP scaling harness (strong and weak scaling)
+# Sweeps ranks x threads, repeats every point, and builds a consolidated report with
+# speedup, parallel efficiency and the Karp-Flatt serial fraction from training_results.csv.
+#
+# Runs on a plain Linux box:  ./performance_test.sh
+# or under SLURM:             sbatch performance_test.sh
+#
+# Settings (environment variables):
+#   RANKS="1 2 4"            MPI process counts to sweep
+#   THREADS="1 2 4"          OpenMP threads per process to sweep
+#   MODES="strong weak"      Strong scaling (fixed total samples) and/or weak scaling (fixed per-rank shard)
+#   REPEATS=3                Runs per point (the report uses the mean and the minimum)
+#   STRONG_SAMPLES=2880      Total training samples for strong scaling
+#   WEAK_SAMPLES=1440        Training samples per rank for weak scaling
+#   ITERATIONS=1             Training iterations per run
+#   BATCH_SIZE=64            Global mini-batch size (weak scaling multiplies it by the rank count)
+#   SYNTHETIC=auto           1 = --synthetic data, 0 = CIFAR-10, auto = synthetic if CIFAR-10 is missing
+#   OUT_DIR=scaling_<date>   Output directory (per-run logs, training_results.csv, reports)
 
 #SBATCH --nodes=1                    # Number of nodes to use
 #SBATCH --cpus-per-task=32           # Number of processor cores per node
@@ -11,30 +26,151 @@
 #SBATCH --output=scaling_results_%j.out   # Output file with job ID
 #SBATCH --constraint="nova18"
 
-# Load necessary modules
-module load openmpi
+set -euo pipefail
 
-# Fixed parameters for all runs
-TRAIN_SAMPLES=2880
-ITERATIONS=1
-PRINT_EVERY=1
+REPO_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+if [ -n "${SLURM_SUBMIT_DIR:-}" ]; then
+    REPO_DIR=$SLURM_SUBMIT_DIR
+fi
+
+RANKS=${RANKS:-"1 2 4"}
+THREADS=${THREADS:-"1 2 4"}
+MODES=${MODES:-"strong weak"}
+REPEATS=${REPEATS:-3}
+STRONG_SAMPLES=${STRONG_SAMPLES:-2880}
+WEAK_SAMPLES=${WEAK_SAMPLES:-1440}
+ITERATIONS=${ITERATIONS:-1}
+BATCH_SIZE=${BATCH_SIZE:-64}
+SYNTHETIC=${SYNTHETIC:-auto}
+OUT_DIR=${OUT_DIR:-"$REPO_DIR/scaling_$(date +%Y%m%d_%H%M%S)"}
+
+# Load MPI where environment modules exist (clusters); plain boxes use the mpirun on PATH
+if command -v module > /dev/null 2>&1; then
+    module load openmpi
+fi
+
+if [ ! -x "$REPO_DIR/main.exe" ]; then
+    make -C "$REPO_DIR" main.exe
+fi
+
+if [ "$SYNTHETIC" = "auto" ]; then
+    if [ -f "$REPO_DIR/cifar-10-batches-bin/data_batch_1.bin" ]; then
+        SYNTHETIC=0
+    else
+        SYNTHETIC=1
+    fi
+fi
+
+DATA_ARGS=""
+if [ "$SYNTHETIC" = "1" ]; then
+    DATA_ARGS="--synthetic"
+fi
+
+# Oversubscription lets a laptop or CI box run more ranks x threads than it has cores
+MPIRUN_ARGS="--oversubscribe"
+if [ "$(id -u)" = "0" ]; then
+    MPIRUN_ARGS="$MPIRUN_ARGS --allow-run-as-root"
+fi
+
+mkdir -p "$OUT_DIR"
+if [ "$SYNTHETIC" = "0" ]; then
+    ln -sfn "$REPO_DIR/cifar-10-batches-bin" "$OUT_DIR/cifar-10-batches-bin"
+fi
+
+# One line per run: mode,ranks,threads,repeat followed by the training_results.csv row
+RUNS_CSV="$OUT_DIR/runs.csv"
+rm -f "$RUNS_CSV" "$OUT_DIR/training_results.csv"
 
 run_test() {
-    local np=$1  # Number of MPI Processes
-    local nt=$2  # Number of OpenMP Threads per Process
-    
+    local mode=$1 # strong or weak
+    local np=$2   # Number of MPI Processes
+    local nt=$3   # Number of OpenMP Threads per Process
+    local rep=$4
+
+    local samples=$STRONG_SAMPLES
+    local batch=$BATCH_SIZE
+    if [ "$mode" = "weak" ]; then
+        samples=$((WEAK_SAMPLES * np))
+        batch=$((BATCH_SIZE * np))
+    fi
+
     export OMP_NUM_THREADS=$nt
-    export OMP_PROC_BIND=close
-    export OMP_PLACES=cores
 
-    mpirun -np $np \
-           --map-by node:PE=$nt \
-           --bind-to core \
-           ./main.exe -n $TRAIN_SAMPLES -i $ITERATIONS -p $PRINT_EVERY -t $nt
+    # Under SLURM mpirun binds each rank to its own cores and the OpenMP runtime places the team
+    # within them; locally the ranks share the machine, so the OpenMP binding stays unset and --pin
+    # gives every rank's threads a disjoint block of the allowed CPUs
+    local map_args=""
+    local pin_args=""
+    if [ -n "${SLURM_JOB_ID:-}" ]; then
+        export OMP_PROC_BIND=close
+        export OMP_PLACES=cores
+        map_args="--map-by node:PE=$nt --bind-to core"
+    else
+        unset OMP_PROC_BIND OMP_PLACES
+        pin_args="--pin"
+    fi
+
+    local log="$OUT_DIR/${mode}_np${np}_nt${nt}_rep${rep}.log"
+    echo "[$mode] ranks=$np threads=$nt samples=$samples batch=$batch repeat=$rep"
+
+    (cd "$OUT_DIR" && mpirun $MPIRUN_ARGS -np "$np" $map_args \
+        "$REPO_DIR/main.exe" $DATA_ARGS -n "$samples" -b "$batch" -i "$ITERATIONS" -p 0 -t "$nt" -e 0 $pin_args) > "$log" 2>&1 || {
+        echo "  run failed, see $log"
+        return 0
+    }
+
+    echo "$mode,$np,$nt,$rep,$(tail -n 1 "$OUT_DIR/training_results.csv")" >> "$RUNS_CSV"
+}
+
+for mode in $MODES; do
+    for np in $RANKS; do
+        for nt in $THREADS; do
+            for rep in $(seq 1 "$REPEATS"); do
+                run_test "$mode" "$np" "$nt" "$rep"
+            done
+        done
+    done
+done
+
+if [ ! -s "$RUNS_CSV" ]; then
+    echo "No successful runs"
+    exit 1
+fi
+
+# Consolidated report: mean/min training time per point, relative to the 1 rank x 1 thread point
+# (or the smallest ranks*threads point measured) of the same mode.
+# Strong: S = T1/Tp, E = S/p.  Weak: scaled speedup S = p*T1/Tp, E = T1/Tp.
+# Karp-Flatt serial fraction: e = (1/S - 1/p) / (1 - 1/p), for p > 1.
+# Column 10 of runs.csv is training_time_sec (4 tag columns + column 6 of training_results.csv).
+sort -t, -k1,1 -k2,2n -k3,3n "$RUNS_CSV" | awk -F, -v report_csv="$OUT_DIR/scaling_report.csv" '
+{
+    key = $1 "," $2 "," $3
+    if (!(key in n)) { order[++num_keys] = key; mode[key] = $1; ranks[key] = $2; threads[key] = $3 }
+    n[key]++
+    sum[key] += $10
+    if (!(key in min) || $10 < min[key]) min[key] = $10
+    p = $2 * $3
+    if (!($1 in base_p) || p < base_p[$1]) { base_p[$1] = p; base_key[$1] = key }
 }
+END {
+    print "mode,ranks,threads,cores,runs,mean_time_sec,min_time_sec,speedup,efficiency,karp_flatt" > report_csv
+    printf "%-7s %6s %8s %6s %5s %14s %13s %8s %10s %11s\n", "Mode", "Ranks", "Threads", "Cores", "Runs", "Mean time (s)", "Min time (s)", "Speedup", "Efficiency", "Karp-Flatt"
+    for (i = 1; i <= num_keys; i++)
+    {
+        key = order[i]
+        m = mode[key]
+        p = ranks[key] * threads[key]
+        rel_p = p / base_p[m]
+        mean = sum[key] / n[key]
+        base = sum[base_key[m]] / n[base_key[m]]
+        speedup = (m == "weak") ? rel_p * base / mean : base / mean
+        efficiency = speedup / rel_p
+        kf = (rel_p > 1) ? (1 / speedup - 1 / rel_p) / (1 - 1 / rel_p) : 0
+        kf_text = (rel_p > 1) ? sprintf("%.4f", kf) : "-"
+        printf "%-7s %6d %8d %6d %5d %14.3f %13.3f %8.3f %10.3f %11s\n", m, ranks[key], threads[key], p, n[key], mean, min[key], speedup, efficiency, kf_text
+        printf "%s,%d,%d,%d,%d,%.4f,%.4f,%.4f,%.4f,%s\n", m, ranks[key], threads[key], p, n[key], mean, min[key], speedup, efficiency, (rel_p > 1) ? kf_text : "" >> report_csv
+    }
+}' | tee "$OUT_DIR/scaling_report.txt"
 
-run_test 1 1
-run_test 1 2
-run_test 1 4
-run_test 1 8
-run_test 1 16
+echo
+echo "Report: $OUT_DIR/scaling_report.txt (CSV: $OUT_DIR/scaling_report.csv)"
@@ -0,0 +1,311 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <mpi.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "affinity.h"
+
+#define MAX_CPUS 1024
+#define MAP_LINE_LENGTH 1024
+
+// One logical CPU of the node
+typedef struct
+{
+    int cpu;
+    int package;
+    int l3;   // Id of the L3 cache domain (package id if unknown)
+    int core;
+    int smt;  // Position among the core's hardware threads (0 = first)
+} cpu_info;
+
+#ifdef __linux__
+// CPUs reserved for helper threads (used by affinity_use_helper_cpus)
+static cpu_set_t helper_cpus;
+static int helper_cpus_valid = 0;
+#endif
+
+// Helper functions
+static int parse_cpu_list(const char *text, int *cpus, int max_cpus);
+static int read_int(const char *path, int fallback);
+static int read_cpu_list(const char *path, int *cpus, int max_cpus);
+static int compare_cpus(const void *a, const void *b);
+#ifdef __linux__
+static int discover_topology(cpu_info *cpus, const cpu_set_t *allowed);
+#endif
+
+int affinity_pin_threads(int num_threads, int reserved_threads, MPI_Comm comm)
+{
+    int rank, num_processes;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_processes);
+
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    int local_rank, local_size;
+    MPI_Comm_rank(node_comm, &local_rank);
+    MPI_Comm_size(node_comm, &local_size);
+
+    char line[MAP_LINE_LENGTH] = "";
+    int pinned = 0;
+    int num_cpus = 0, num_cores = 0, num_packages = 0, num_l3 = 0;
+
+#ifdef __linux__
+    // Only the CPUs this rank may run on (cpusets, cgroups, mpirun --bind-to); the ranks of the node
+    // with the same set split it, a rank bound to CPUs of its own keeps them all
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        CPU_ZERO(&allowed);
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            CPU_SET(c, &allowed);
+    }
+    cpu_set_t *node_sets = (cpu_set_t *)malloc(sizeof(cpu_set_t) * local_size);
+    MPI_Allgather(&allowed, sizeof(cpu_set_t), MPI_BYTE, node_sets, sizeof(cpu_set_t), MPI_BYTE, node_comm);
+    int share_rank = 0, share_size = 0;
+    for (int r = 0; r < local_size; r++)
+    {
+        if (CPU_EQUAL(&node_sets[r], &allowed))
+        {
+            share_rank += r < local_rank;
+            share_size++;
+        }
+    }
+    free(node_sets);
+
+    static cpu_info cpus[MAX_CPUS];
+    num_cpus = discover_topology(cpus, &allowed);
+
+    if (num_cpus > 0)
+    {
+        // Physical cores first (SMT position 0), then their siblings, each in socket -> L3 -> core order
+        qsort(cpus, num_cpus, sizeof(cpu_info), compare_cpus);
+        for (int i = 0; i < num_cpus; i++)
+        {
+            if (cpus[i].smt == 0)
+                num_cores++;
+            if (i == 0 || cpus[i].package != cpus[i - 1].package)
+                num_packages += cpus[i].smt == 0;
+            if (i == 0 || cpus[i].l3 != cpus[i - 1].l3 || cpus[i].package != cpus[i - 1].package)
+                num_l3 += cpus[i].smt == 0;
+        }
+
+        // This rank's contiguous block of cores (ranks share cores if there are more ranks than cores)
+        int first_core = share_rank * num_cores / share_size;
+        int last_core = (share_rank + 1) * num_cores / share_size;
+        if (last_core == first_core)
+            last_core = first_core + 1;
+        if (last_core > num_cores)
+        {
+            first_core = num_cores - 1;
+            last_core = num_cores;
+        }
+
+        // Block CPUs in pinning order: its cores, then their SMT siblings
+        int block[MAX_CPUS];
+        int block_size = 0;
+        for (int i = first_core; i < last_core; i++)
+            block[block_size++] = i;
+        for (int i = num_cores; i < num_cpus; i++)
+        {
+            for (int c = first_core; c < last_core; c++)
+            {
+                if (cpus[i].package == cpus[c].package && cpus[i].core == cpus[c].core)
+                {
+                    block[block_size++] = i;
+                    break;
+                }
+            }
+        }
+
+        // Helper threads get the block's CPUs after the team's (the whole block if none are reserved)
+        CPU_ZERO(&helper_cpus);
+        for (int r = 0; r < reserved_threads; r++)
+            CPU_SET(cpus[block[(num_threads + r) % block_size]].cpu, &helper_cpus);
+        if (reserved_threads == 0)
+            for (int i = 0; i < block_size; i++)
+                CPU_SET(cpus[block[i]].cpu, &helper_cpus);
+        helper_cpus_valid = 1;
+
+        // Each thread pins itself (the OpenMP runtime keeps the same threads for later regions)
+        int thread_cpu[MAX_CPUS];
+        int failed = 0;
+#pragma omp parallel num_threads(num_threads) reduction(+ : failed)
+        {
+            int t = omp_get_thread_num();
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[block[t % block_size]].cpu, &set);
+            if (sched_setaffinity(0, sizeof(set), &set) != 0)
+                failed++;
+            if (t < MAX_CPUS)
+                thread_cpu[t] = sched_getcpu();
+        }
+        pinned = failed == 0;
+
+        int length = snprintf(line, sizeof(line), "Rank %3d (local %d): cores %d-%d |", rank, local_rank, first_core, last_core - 1);
+        for (int t = 0; t < num_threads && t < MAX_CPUS && length < (int)sizeof(line) - 32; t++)
+        {
+            const cpu_info *info = &cpus[block[t % block_size]];
+            length += snprintf(line + length, sizeof(line) - length, " t%d->cpu%d(s%d,c%d)%s", t, thread_cpu[t],
+                               info->package, info->core, info->smt ? "ht" : "");
+        }
+        for (int r = 0; r < reserved_threads && length < (int)sizeof(line) - 32; r++)
+            length += snprintf(line + length, sizeof(line) - length, "%s%d", r == 0 ? " | helpers->cpu" : ",",
+                               cpus[block[(num_threads + r) % block_size]].cpu);
+        if (!pinned)
+            snprintf(line + length, sizeof(line) - length, " [sched_setaffinity failed]");
+    }
+    else
+    {
+        snprintf(line, sizeof(line), "Rank %3d (local %d): topology not available, threads not pinned", rank, local_rank);
+    }
+#else
+    snprintf(line, sizeof(line), "Rank %3d (local %d): thread pinning not supported on this platform", rank, local_rank);
+#endif
+    MPI_Comm_free(&node_comm);
+
+    // Print every rank's map from rank 0
+    char *lines = NULL;
+    if (rank == 0)
+        lines = (char *)malloc((size_t)num_processes * MAP_LINE_LENGTH);
+    MPI_Gather(line, MAP_LINE_LENGTH, MPI_CHAR, lines, MAP_LINE_LENGTH, MPI_CHAR, 0, comm);
+
+    if (rank == 0)
+    {
+        printf("\n========== THREAD PINNING ==========\n");
+        if (num_cpus > 0)
+            printf("Topology (rank 0's CPUs): %d sockets, %d L3 domains, %d cores, %d CPUs (%d ranks on node)\n",
+                   num_packages, num_l3, num_cores, num_cpus, local_size);
+        for (int r = 0; r < num_processes; r++)
+            printf("%s\n", lines + (size_t)r * MAP_LINE_LENGTH);
+        printf("====================================\n\n");
+        free(lines);
+    }
+
+    return pinned;
+}
+
+void affinity_use_helper_cpus(void)
+{
+#ifdef __linux__
+    if (helper_cpus_valid)
+        sched_setaffinity(0, sizeof(helper_cpus), &helper_cpus);
+#endif
+}
+
+#ifdef __linux__
+/**
+ * Read the socket, L3 domain, core and SMT position of every online CPU in allowed; returns the
+ * CPU count (0 on failure)
+ */
+static int discover_topology(cpu_info *cpus, const cpu_set_t *allowed)
+{
+    int online[MAX_CPUS];
+    int num_online = read_cpu_list("/sys/devices/system/cpu/online", online, MAX_CPUS);
+    char path[256];
+    int count = 0;
+
+    for (int o = 0; o < num_online; o++)
+    {
+        int cpu = online[o];
+        if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, allowed))
+            continue;
+        const int i = count++;
+        cpus[i].cpu = cpu;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        cpus[i].package = read_int(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        cpus[i].core = read_int(path, cpu);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index3/id", cpu);
+        cpus[i].l3 = read_int(path, cpus[i].package);
+
+        // SMT position: index of this CPU among its core's siblings
+        int siblings[MAX_CPUS];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+        int num_siblings = read_cpu_list(path, siblings, MAX_CPUS);
+        cpus[i].smt = 0;
+        for (int s = 0; s < num_siblings; s++)
+            if (siblings[s] < cpu && siblings[s] < CPU_SETSIZE && CPU_ISSET(siblings[s], allowed))
+                cpus[i].smt++;
+    }
+
+    return count;
+}
+#endif
+
+static int compare_cpus(const void *a, const void *b)
+{
+    const cpu_info *x = (const cpu_info *)a;
+    const cpu_info *y = (const cpu_info *)b;
+    if (x->smt != y->smt)
+        return x->smt - y->smt;
+    if (x->package != y->package)
+        return x->package - y->package;
+    if (x->l3 != y->l3)
+        return x->l3 - y->l3;
+    if (x->core != y->core)
+        return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+static int read_int(const char *path, int fallback)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return fallback;
+    int value;
+    if (fscanf(file, "%d", &value) != 1)
+        value = fallback;
+    fclose(file);
+    return value;
+}
+
+static int read_cpu_list(const char *path, int *cpus, int max_cpus)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return 0;
+    char text[4096] = "";
+    if (!fgets(text, sizeof(text), file))
+        text[0] = '\0';
+    fclose(file);
+    return parse_cpu_list(text, cpus, max_cpus);
+}
+
+/**
+ * Parse a kernel CPU list such as "0-3,8-11"
+ */
+static int parse_cpu_list(const char *text, int *cpus, int max_cpus)
+{
+    int count = 0;
+    const char *p = text;
+    while (*p && count < max_cpus)
+    {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long c = first; c <= last && count < max_cpus; c++)
+            cpus[count++] = (int)c;
+        if (*p == ',')
+            p++;
+        else
+            break;
+    }
+    return count;
+}
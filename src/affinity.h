@@ -0,0 +1,25 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <mpi.h>
+
+// Topology-aware thread pinning for hybrid MPI + OpenMP runs
+// The topology (sockets, L3 domains, cores, SMT siblings) of the CPUs the rank may run on (its
+// inherited affinity mask: cpusets, cgroups, mpirun --bind-to) is read from /sys. Physical cores
+// are ordered socket -> L3 -> core and split into contiguous blocks, one per rank of the node with
+// the same mask (ranks are numbered by the shared-memory communicator). Each OpenMP thread of a
+// rank is pinned to one core of its block, then to the cores' SMT siblings if there are more
+// threads than cores. Cores for helper threads (background evaluation) are reserved after the
+// team's.
+
+// Pin the calling rank's OpenMP team of num_threads threads, reserve the next reserved_threads CPUs
+// of its block for helper threads and print the map of all ranks on rank 0 (collective). Returns 1
+// if the threads were pinned.
+int affinity_pin_threads(int num_threads, int reserved_threads, MPI_Comm comm);
+
+// Move the calling thread to the CPUs reserved for helper threads (all of its rank's block if none
+// were reserved), for threads created after pinning, which would otherwise inherit the single CPU
+// of the thread that created them; the OpenMP team it starts inherits them
+void affinity_use_helper_cpus(void);
+
+#endif // AFFINITY_H
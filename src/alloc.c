@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <omp.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "alloc.h"
+
+#define MAX_NUMA_NODES 64
+#define MAX_SAMPLED_PAGES 4096
+
+// Global variables
+static int use_huge_pages = 0;
+
+// Helper functions
+static size_t huge_page_bytes(const void *ptr, size_t bytes);
+
+void alloc_set_huge_pages(int enabled)
+{
+    use_huge_pages = enabled;
+}
+
+void *alloc_first_touch(size_t bytes)
+{
+    if (bytes == 0)
+        bytes = ALLOC_ALIGNMENT;
+
+    void *ptr = NULL;
+    size_t alignment = ALLOC_ALIGNMENT;
+    size_t size = bytes;
+
+    // Whole huge pages, so the block's pages can all be promoted
+    if (use_huge_pages && bytes >= ALLOC_HUGE_PAGE_SIZE)
+    {
+        alignment = ALLOC_HUGE_PAGE_SIZE;
+        size = (bytes + ALLOC_HUGE_PAGE_SIZE - 1) / ALLOC_HUGE_PAGE_SIZE * ALLOC_HUGE_PAGE_SIZE;
+    }
+
+    if (posix_memalign(&ptr, alignment, size) != 0)
+        return NULL;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (alignment == ALLOC_HUGE_PAGE_SIZE)
+        madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+
+    // First touch: same contiguous static split as the kernels' collapse(2) loops over the elements
+    if (bytes >= ALLOC_PARALLEL_TOUCH_BYTES && !omp_in_parallel())
+    {
+        const long count = (long)(bytes / sizeof(double));
+        double *values = (double *)ptr;
+
+#pragma omp parallel for schedule(static)
+        for (long i = 0; i < count; i++)
+            values[i] = 0.0;
+
+        memset((char *)ptr + count * sizeof(double), 0, bytes - count * sizeof(double));
+    }
+    else
+    {
+        memset(ptr, 0, bytes);
+    }
+
+    return ptr;
+}
+
+void alloc_free(void *ptr)
+{
+    free(ptr);
+}
+
+void alloc_print_placement(const char *name, const void *ptr, size_t bytes)
+{
+    int node_pages[MAX_NUMA_NODES] = {0};
+    int sampled = 0;
+    int unknown = 0;
+
+#if defined(__linux__) && defined(SYS_move_pages)
+    long page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)ptr / page_size * page_size;
+    size_t num_pages = ((uintptr_t)ptr + bytes - first + page_size - 1) / page_size;
+    size_t stride = num_pages > MAX_SAMPLED_PAGES ? (num_pages + MAX_SAMPLED_PAGES - 1) / MAX_SAMPLED_PAGES : 1;
+
+    void *pages[MAX_SAMPLED_PAGES];
+    int status[MAX_SAMPLED_PAGES];
+    for (size_t p = 0; p < num_pages && sampled < MAX_SAMPLED_PAGES; p += stride)
+        pages[sampled++] = (void *)(first + p * page_size);
+
+    // With no target nodes, move_pages only reports the node of every page
+    if (syscall(SYS_move_pages, 0, (unsigned long)sampled, pages, NULL, status, 0) != 0)
+    {
+        unknown = sampled;
+    }
+    else
+    {
+        for (int i = 0; i < sampled; i++)
+        {
+            if (status[i] >= 0 && status[i] < MAX_NUMA_NODES)
+                node_pages[status[i]]++;
+            else
+                unknown++;
+        }
+    }
+#endif
+
+    printf("  %-10s %9.2f MB  huge pages: %8.2f MB  nodes:", name, bytes / (1024.0 * 1024.0),
+           huge_page_bytes(ptr, bytes) / (1024.0 * 1024.0));
+    for (int n = 0; n < MAX_NUMA_NODES; n++)
+        if (node_pages[n] > 0)
+            printf(" %d=%.0f%%", n, 100.0 * node_pages[n] / sampled);
+    if (unknown > 0)
+        printf(" unknown=%.0f%%", 100.0 * unknown / (sampled > 0 ? sampled : 1));
+    printf("\n");
+}
+
+/**
+ * Transparent huge-page bytes of the mappings overlapping a block (from /proc/self/smaps)
+ */
+static size_t huge_page_bytes(const void *ptr, size_t bytes)
+{
+    size_t total_kb = 0;
+#ifdef __linux__
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps)
+        return 0;
+
+    uintptr_t begin = (uintptr_t)ptr;
+    uintptr_t end = begin + bytes;
+    int overlaps = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), smaps))
+    {
+        unsigned long vma_start, vma_end, kb;
+        if (sscanf(line, "%lx-%lx ", &vma_start, &vma_end) == 2)
+            overlaps = vma_start < end && vma_end > begin;
+        else if (overlaps && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1)
+            total_kb += kb;
+    }
+    fclose(smaps);
+#endif
+    return total_kb * 1024 < bytes ? total_kb * 1024 : bytes;
+}
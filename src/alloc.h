@@ -0,0 +1,31 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+// NUMA-aware allocation for long-lived storage (parameters, gradient accumulators, datasets, plan
+// slabs): blocks are 64-byte aligned (2 MB aligned and MADV_HUGEPAGE-advised for large blocks when
+// huge pages are enabled) and zeroed by a parallel first touch whose static schedule matches the
+// element split of the collapse(2) kernel loops, so each page lands on the node of the thread
+// that later processes it (with threads pinned, e.g. OMP_PROC_BIND=close). Called inside a
+// parallel region, the calling thread touches the whole block (per-thread buffers).
+// Temporaries stay on calloc (new_matrix): its large blocks are fresh zero pages that the first
+// kernel writing them places, and nothing is written twice.
+
+#define ALLOC_ALIGNMENT 64
+#define ALLOC_HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+// Blocks smaller than this are zeroed by the calling thread
+#define ALLOC_PARALLEL_TOUCH_BYTES (256UL * 1024)
+
+// Back blocks of at least one huge page with transparent huge pages (off by default)
+void alloc_set_huge_pages(int enabled);
+
+// Zeroed, aligned, first-touched block (NULL on failure); release with alloc_free
+void *alloc_first_touch(size_t bytes);
+void alloc_free(void *ptr);
+
+// Print the NUMA node distribution and huge-page coverage of a block (sampled via move_pages)
+void alloc_print_placement(const char *name, const void *ptr, size_t bytes);
+
+#endif // ALLOC_H
@@ -0,0 +1,712 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <omp.h>
+#include <mpi.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "autotune.h"
+#include "matrix.h"
+#include "nn.h"
+#include "config.h"
+
+#define TUNE_MAX_ENTRIES 256
+#define TUNE_MAX_BATCHES 8
+
+// Per-message latency assumed for an on-node allreduce step (the bandwidth term is measured)
+#define ALLREDUCE_LATENCY_US 2.0
+
+// Candidate tile sizes and schedules
+static const int candidate_tiles[] = {1, 8, 16, 32, 64};
+#define NUM_CANDIDATE_TILES (int)(sizeof(candidate_tiles) / sizeof(candidate_tiles[0]))
+
+static const omp_sched_t candidate_schedules[] = {omp_sched_static, omp_sched_dynamic, omp_sched_guided};
+#define NUM_CANDIDATE_SCHEDULES (int)(sizeof(candidate_schedules) / sizeof(candidate_schedules[0]))
+
+// Candidate rows per task of the backward kernels
+static const int candidate_grains[] = {1, 2, 4, 8, 16, 32, 64};
+#define NUM_CANDIDATE_GRAINS (int)(sizeof(candidate_grains) / sizeof(candidate_grains[0]))
+
+static const char *kernel_names[TUNE_KERNEL_COUNT] = {
+    "matrix_mult_add_col", "backward_weight_grad", "backward_input_grad"};
+
+// Global variables
+int g_tune_count = 0;
+static tune_entry entries[TUNE_MAX_ENTRIES];
+static _Thread_local const tune_entry *forced_entry = NULL; // Candidate under measurement
+static int log_misses = 0;                                  // Set once a run's tuning is loaded
+static int miss_logged = 0;
+
+// Helper functions
+static const tune_entry *find_entry(tune_kernel kernel, int m, int k, int n, int threads);
+static void log_miss(tune_kernel kernel, int m, int k, int n, int threads);
+static void store_entry(const tune_entry *entry);
+static double time_kernel(tune_kernel kernel, int m, int k, int n, int reps);
+static double time_step(const int *layer_dims, int L, int batch, int reps);
+static double measure_copy_bandwidth(size_t bytes, int reps);
+static double elapsed_ms(const struct timespec *start, const struct timespec *end);
+static int compare_doubles(const void *a, const void *b);
+static const char *schedule_name(omp_sched_t schedule);
+static int parse_schedule(const char *name, omp_sched_t *schedule);
+
+int tune_gemm(tune_kernel kernel, int m, int k, int n)
+{
+    const tune_entry *entry = NULL;
+    if (forced_entry && forced_entry->kernel == kernel)
+        entry = forced_entry;
+    else if (g_tune_count > 0)
+        entry = find_entry(kernel, m, k, n, omp_get_max_threads());
+
+    if (!entry)
+    {
+        omp_set_schedule(omp_sched_static, 0);
+        return 1;
+    }
+
+    omp_set_schedule(entry->schedule, entry->chunk);
+    return entry->tile;
+}
+
+int tune_variant(tune_kernel kernel, int m, int k, int n)
+{
+    const tune_entry *entry = NULL;
+    if (forced_entry && forced_entry->kernel == kernel)
+        entry = forced_entry;
+    else if (g_tune_count > 0)
+        entry = find_entry(kernel, m, k, n, omp_get_max_threads());
+    return entry ? entry->variant : -1;
+}
+
+int tune_grainsize(tune_kernel kernel, int m, int k, int n)
+{
+    const tune_entry *entry = NULL;
+    if (forced_entry && forced_entry->kernel == kernel)
+        entry = forced_entry;
+    else if (g_tune_count > 0)
+        entry = find_entry(kernel, m, k, n, omp_get_max_threads());
+    return entry ? entry->tile : 0;
+}
+
+void autotune_kernels(const int *layer_dims, int L, int first_rows, const int *batches, int num_batches, int reps, int verbose)
+{
+    int threads = omp_get_max_threads();
+
+    if (verbose)
+    {
+        printf("\n========== KERNEL AUTOTUNING (%d threads) ==========\n", threads);
+        printf("%-26s %-16s %-8s %5s %-8s %12s %12s %8s\n",
+               "Kernel", "Shape (MxKxN)", "Variant", "Tile", "Schedule", "Default(ms)", "Tuned(ms)", "Speedup");
+    }
+
+    for (int bi = 0; bi < num_batches; bi++)
+    {
+        for (int l = 1; l <= L; l++)
+        {
+            for (int kernel = 0; kernel < TUNE_KERNEL_COUNT; kernel++)
+            {
+                // The input layer's gradient is never computed
+                if (kernel == TUNE_BACKWARD_INPUT && l == 1)
+                    continue;
+
+                // GEMM shapes of layer l in the forward and backward pass (this rank's rows of a split
+                // first layer, which also bound the input gradient of the second)
+                const int out = l == 1 ? first_rows : layer_dims[l];
+                int m, k, n;
+                if (kernel == TUNE_MULT_ADD_COL)
+                {
+                    m = out;
+                    k = layer_dims[l - 1];
+                    n = batches[bi];
+                }
+                else if (kernel == TUNE_BACKWARD_WEIGHT)
+                {
+                    m = out;
+                    k = batches[bi];
+                    n = layer_dims[l - 1];
+                }
+                else
+                {
+                    m = l == 2 ? first_rows : layer_dims[l - 1];
+                    k = layer_dims[l];
+                    n = batches[bi];
+                }
+
+                tune_entry candidate = {(tune_kernel)kernel, m, k, n, threads, 1, omp_sched_static, 0, 0.0, GEMM_GENERIC};
+
+                // The untuned kernel: untiled static schedule, forward variant chosen by the shape rules,
+                // backward tasks sized by the work per row
+                if (kernel == TUNE_MULT_ADD_COL)
+                    candidate.variant = gemm_shape_variant(m, k);
+                else
+                    candidate.tile = backward_grainsize((long)k * n);
+                forced_entry = &candidate;
+                candidate.time_ms = time_kernel(candidate.kernel, m, k, n, reps);
+                forced_entry = NULL;
+                double default_ms = candidate.time_ms;
+                tune_entry best = candidate;
+
+                // Backward kernel over every task grainsize
+                for (int gi = 0; kernel != TUNE_MULT_ADD_COL && gi < NUM_CANDIDATE_GRAINS; gi++)
+                {
+                    candidate.tile = candidate_grains[gi];
+                    forced_entry = &candidate;
+                    candidate.time_ms = time_kernel(candidate.kernel, m, k, n, reps);
+                    forced_entry = NULL;
+
+                    if (candidate.time_ms < best.time_ms)
+                        best = candidate;
+                }
+
+                // Generic forward kernel over every tile and schedule
+                candidate.variant = GEMM_GENERIC;
+                for (int si = 0; kernel == TUNE_MULT_ADD_COL && si < NUM_CANDIDATE_SCHEDULES; si++)
+                {
+                    for (int ti = 0; ti < NUM_CANDIDATE_TILES; ti++)
+                    {
+                        candidate.schedule = candidate_schedules[si];
+                        candidate.chunk = candidate.schedule == omp_sched_static ? 0 : 1;
+                        candidate.tile = candidate_tiles[ti];
+
+                        forced_entry = &candidate;
+                        candidate.time_ms = time_kernel(candidate.kernel, m, k, n, reps);
+                        forced_entry = NULL;
+
+                        if (candidate.time_ms < best.time_ms)
+                            best = candidate;
+                    }
+                }
+
+                // Every specialized forward variant that applies to the shape (own fixed schedule)
+                for (int v = GEMM_GENERIC + 1; kernel == TUNE_MULT_ADD_COL && v < GEMM_VARIANT_COUNT; v++)
+                {
+                    if (!gemm_variant_supports((gemm_variant)v, m, k))
+                        continue;
+                    candidate.variant = v;
+                    candidate.tile = 1;
+                    candidate.schedule = omp_sched_static;
+                    candidate.chunk = 0;
+
+                    forced_entry = &candidate;
+                    candidate.time_ms = time_kernel(candidate.kernel, m, k, n, reps);
+                    forced_entry = NULL;
+
+                    if (candidate.time_ms < best.time_ms)
+                        best = candidate;
+                }
+
+                store_entry(&best);
+
+                if (verbose)
+                {
+                    char shape[32];
+                    snprintf(shape, sizeof(shape), "%dx%dx%d", m, k, n);
+                    printf("%-26s %-16s %-8s %5d %-8s %12.3f %12.3f %7.2fx\n",
+                           kernel_names[kernel], shape, gemm_variant_name((gemm_variant)best.variant),
+                           best.tile, kernel == TUNE_MULT_ADD_COL ? schedule_name(best.schedule) : "tasks",
+                           default_ms, best.time_ms, best.time_ms > 0 ? default_ms / best.time_ms : 1.0);
+                }
+            }
+        }
+    }
+
+    if (verbose)
+        printf("=====================================================\n\n");
+}
+
+int autotune_node_cores(MPI_Comm comm)
+{
+    // Online CPUs of the node (omp_get_num_procs() only sees the CPUs this rank is bound to)
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+#ifdef __linux__
+    // Union of the CPUs the node's ranks may run on (a cpuset or cgroup leaves the job fewer cores)
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return cores > 0 ? cores : omp_get_num_procs();
+    int node_size = 1;
+    if (comm != MPI_COMM_NULL)
+    {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm node_comm;
+        MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+        MPI_Comm_size(node_comm, &node_size);
+        MPI_Allreduce(MPI_IN_PLACE, &allowed, sizeof(cpu_set_t), MPI_BYTE, MPI_BOR, node_comm);
+        MPI_Comm_free(&node_comm);
+    }
+
+    // Ranks bound to a core each (mpirun --bind-to core) say nothing about the node: keep the online count
+    int allowed_cores = CPU_COUNT(&allowed);
+    if (allowed_cores > node_size && (cores <= 0 || allowed_cores < cores))
+        cores = allowed_cores;
+#else
+    (void)comm;
+#endif
+    return cores > 0 ? cores : omp_get_num_procs();
+}
+
+tune_layout autotune_layout(const int *layer_dims, int L, int batch_size, int cores, int reps, int verbose)
+{
+    int saved_threads = omp_get_max_threads();
+
+    // Gradients exchanged per step
+    size_t param_bytes = 0;
+    for (int l = 1; l <= L; l++)
+        param_bytes += (size_t)(layer_dims[l] * layer_dims[l - 1] + layer_dims[l]) * sizeof(double);
+    double bytes_per_ms = measure_copy_bandwidth(param_bytes, reps);
+
+    if (verbose)
+    {
+        printf("\n========== RANKS x THREADS (%d cores) ==========\n", cores);
+        printf("%6s %8s %12s %12s %12s %12s\n", "Ranks", "Threads", "Local batch", "Compute(ms)", "Comm(ms)", "Step(ms)");
+    }
+
+    tune_layout best = {cores, cores, 1, 0.0};
+
+    // Every split of the cores into equal ranks
+    for (int threads = 1; threads <= cores; threads++)
+    {
+        if (cores % threads != 0)
+            continue;
+
+        int ranks = cores / threads;
+        int local_batch = (batch_size + ranks - 1) / ranks;
+
+        // Compute: the step's GEMMs on one rank's share of the batch
+        omp_set_num_threads(threads);
+        double compute_ms = time_step(layer_dims, L, local_batch, reps);
+
+        // Communication: ring allreduce of the gradients (2(p-1)/p of the data, 2(p-1) messages)
+        double comm_ms = 0.0;
+        if (ranks > 1)
+            comm_ms = 2.0 * (ranks - 1) / ranks * param_bytes / bytes_per_ms + 2.0 * (ranks - 1) * ALLREDUCE_LATENCY_US / 1000.0;
+
+        double step_ms = compute_ms + comm_ms;
+        if (verbose)
+            printf("%6d %8d %12d %12.3f %12.3f %12.3f\n", ranks, threads, local_batch, compute_ms, comm_ms, step_ms);
+
+        if (best.step_ms == 0.0 || step_ms < best.step_ms)
+        {
+            best.ranks = ranks;
+            best.threads = threads;
+            best.step_ms = step_ms;
+        }
+    }
+    omp_set_num_threads(saved_threads);
+
+    if (verbose)
+    {
+        printf("Recommended: %d ranks x %d threads per node\n", best.ranks, best.threads);
+        printf("=================================================\n\n");
+    }
+    return best;
+}
+
+void autotune_default_path(char *path, int size)
+{
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+    snprintf(path, size, "tuning_%s.txt", host);
+}
+
+int autotune_save(const char *path, const tune_layout *layout)
+{
+    FILE *file = fopen(path, "w");
+    if (!file)
+        return -1;
+
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+
+    fprintf(file, "# Kernel tuning for host %s\n", host);
+    fprintf(file, "# kernel m k n threads tile schedule chunk time_ms variant\n");
+    for (int i = 0; i < g_tune_count; i++)
+    {
+        const tune_entry *e = &entries[i];
+        fprintf(file, "%s %d %d %d %d %d %s %d %.4f %s\n", kernel_names[e->kernel], e->m, e->k, e->n,
+                e->threads, e->tile, schedule_name(e->schedule), e->chunk, e->time_ms,
+                gemm_variant_name((gemm_variant)e->variant));
+    }
+    if (layout)
+    {
+        fprintf(file, "# layout cores ranks threads step_ms\n");
+        fprintf(file, "layout %d %d %d %.4f\n", layout->cores, layout->ranks, layout->threads, layout->step_ms);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int autotune_load(const char *path, tune_layout *layout)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    g_tune_count = 0;
+    if (layout)
+        memset(layout, 0, sizeof(*layout));
+
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#')
+            continue;
+
+        char name[64], schedule[16], variant[16] = "generic";
+        tune_entry e;
+        if (layout && sscanf(line, "layout %d %d %d %lf", &layout->cores, &layout->ranks, &layout->threads, &layout->step_ms) == 4)
+            continue;
+        // Files written before kernel variants existed have no variant column (generic)
+        if (sscanf(line, "%63s %d %d %d %d %d %15s %d %lf %15s", name, &e.m, &e.k, &e.n, &e.threads,
+                   &e.tile, schedule, &e.chunk, &e.time_ms, variant) < 9)
+            continue;
+        if (!parse_schedule(schedule, &e.schedule) || e.tile <= 0)
+            continue;
+
+        for (e.variant = 0; e.variant < GEMM_VARIANT_COUNT; e.variant++)
+            if (strcmp(variant, gemm_variant_name((gemm_variant)e.variant)) == 0)
+                break;
+        if (e.variant == GEMM_VARIANT_COUNT)
+            continue;
+
+        int kernel;
+        for (kernel = 0; kernel < TUNE_KERNEL_COUNT; kernel++)
+            if (strcmp(name, kernel_names[kernel]) == 0)
+                break;
+        if (kernel == TUNE_KERNEL_COUNT)
+            continue;
+        e.kernel = (tune_kernel)kernel;
+
+        store_entry(&e);
+    }
+
+    fclose(file);
+    return g_tune_count;
+}
+
+int autotune_init(const char *path, int tune, const int *layer_dims, int L, int first_rows,
+                  const int *widths, int num_widths, int batch_size, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Ranks sharing a node share its tuning file
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    int node_rank, node_size;
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    int node_cores = tune ? autotune_node_cores(comm) : 0;
+
+    char default_path[300];
+    if (!path)
+    {
+        autotune_default_path(default_path, sizeof(default_path));
+        path = default_path;
+    }
+
+    if (tune)
+    {
+        // Every rank's shapes: rows of its first layer, then the micro-batch widths it trains with
+        const int stride = 2 + TUNE_MAX_BATCHES;
+        int local[2 + TUNE_MAX_BATCHES] = {first_rows, num_widths < TUNE_MAX_BATCHES ? num_widths : TUNE_MAX_BATCHES};
+        for (int i = 0; i < local[1]; i++)
+            local[2 + i] = widths[i];
+        int *shapes = node_rank == 0 ? (int *)malloc(sizeof(int) * stride * node_size) : NULL;
+        MPI_Gather(local, stride, MPI_INT, shapes, stride, MPI_INT, 0, node_comm);
+
+        if (node_rank == 0)
+        {
+            // One pass per distinct first-layer split, over the widths of the ranks that have it
+            for (int r = 0; r < node_size; r++)
+            {
+                const int rows = shapes[stride * r];
+                int seen = 0;
+                for (int q = 0; q < r && !seen; q++)
+                    seen = shapes[stride * q] == rows;
+                if (seen)
+                    continue;
+
+                int batches[TUNE_MAX_BATCHES];
+                int num_batches = 0;
+                for (int q = r; q < node_size; q++)
+                {
+                    const int *shape = &shapes[stride * q];
+                    for (int i = 0; shape[0] == rows && i < shape[1]; i++)
+                    {
+                        int known = 0;
+                        for (int j = 0; j < num_batches && !known; j++)
+                            known = batches[j] == shape[2 + i];
+                        if (!known && num_batches < TUNE_MAX_BATCHES)
+                            batches[num_batches++] = shape[2 + i];
+                    }
+                }
+                autotune_kernels(layer_dims, L, rows, batches, num_batches, AUTOTUNE_REPS, rank == 0);
+            }
+            free(shapes);
+
+            tune_layout layout = autotune_layout(layer_dims, L, batch_size, node_cores, AUTOTUNE_REPS, rank == 0);
+            if (autotune_save(path, &layout) != 0)
+                fprintf(stderr, "Warning: Cannot write tuning file %s\n", path);
+        }
+
+        // Wait for the node's tuning without spinning on the cores being measured
+        MPI_Request request;
+        int done = 0;
+        MPI_Ibarrier(node_comm, &request);
+        while (!done)
+        {
+            MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+            if (!done)
+                usleep(1000);
+        }
+    }
+
+    tune_layout layout;
+    int count = autotune_load(path, &layout);
+    log_misses = count > 0;
+
+    if (rank == 0 && count >= 0)
+    {
+        printf("Kernel tuning: %d shapes from %s\n", count, path);
+        if (layout.ranks > 0)
+            printf("Recommended layout for this node: %d ranks x %d threads (running %d ranks x %d threads)\n",
+                   layout.ranks, layout.threads, node_size, omp_get_max_threads());
+    }
+
+    MPI_Comm_free(&node_comm);
+    return count > 0 ? count : 0;
+}
+
+/**
+ * Entry for the shape, or else the one of the same layer and thread count tuned at the nearest batch
+ * width (steps of a shard differ by a sample; the dW kernel has the batch as k, the others as n)
+ */
+static const tune_entry *find_entry(tune_kernel kernel, int m, int k, int n, int threads)
+{
+    const tune_entry *nearest = NULL;
+    int nearest_gap = 0;
+    for (int i = 0; i < g_tune_count; i++)
+    {
+        const tune_entry *e = &entries[i];
+        if (e->kernel != kernel || e->m != m || e->threads != threads)
+            continue;
+
+        int gap;
+        if (kernel == TUNE_BACKWARD_WEIGHT)
+            gap = e->n == n ? abs(e->k - k) : -1;
+        else
+            gap = e->k == k ? abs(e->n - n) : -1;
+        if (gap == 0)
+            return e;
+        if (gap > 0 && (!nearest || gap < nearest_gap))
+        {
+            nearest = e;
+            nearest_gap = gap;
+        }
+    }
+
+    if (!nearest)
+        log_miss(kernel, m, k, n, threads);
+    return nearest;
+}
+
+/**
+ * Report the first shape of a run with no tuned entry (it keeps the default schedule and variant)
+ */
+static void log_miss(tune_kernel kernel, int m, int k, int n, int threads)
+{
+    if (!log_misses)
+        return;
+
+    int first;
+#pragma omp atomic capture
+    first = miss_logged++;
+    if (first == 0)
+        fprintf(stderr, "Warning: No tuned entry for %s %dx%dx%d at %d threads, using the defaults "
+                        "(rerun --autotune for this layout)\n",
+                kernel_names[kernel], m, k, n, threads);
+}
+
+static void store_entry(const tune_entry *entry)
+{
+    // Replace an existing entry for the same shape and thread count
+    for (int i = 0; i < g_tune_count; i++)
+    {
+        tune_entry *e = &entries[i];
+        if (e->kernel == entry->kernel && e->m == entry->m && e->k == entry->k && e->n == entry->n && e->threads == entry->threads)
+        {
+            *e = *entry;
+            return;
+        }
+    }
+
+    if (g_tune_count < TUNE_MAX_ENTRIES)
+        entries[g_tune_count++] = *entry;
+}
+
+/**
+ * Median wall time of one kernel over random inputs (result allocation included for the forward
+ * kernel, as in training; the backward kernels write into preallocated plan buffers)
+ */
+static double time_kernel(tune_kernel kernel, int m, int k, int n, int reps)
+{
+    matrix A, B, b = {0, 0, NULL}, C = {0, 0, NULL}, mask = {0, 0, NULL};
+    if (kernel == TUNE_MULT_ADD_COL)
+    {
+        A = new_matrix(m, k); // W
+        B = new_matrix(k, n); // A
+        b = new_matrix(m, 1);
+    }
+    else if (kernel == TUNE_BACKWARD_WEIGHT)
+    {
+        A = new_matrix(m, k); // dZ
+        B = new_matrix(n, k); // A_prev
+        C = new_matrix(m, n); // dW
+    }
+    else
+    {
+        A = new_matrix(k, m);    // W
+        B = new_matrix(k, n);    // dZ
+        C = new_matrix(m, n);    // dZ_prev
+        mask = new_matrix(m, n); // ReLU output of the layer below (about half active)
+    }
+
+    unsigned int seed = RANDOM_SEED;
+    for (size_t i = 0; i < (size_t)A.rows * A.cols; i++)
+        A.val[i] = (double)rand_r(&seed) / RAND_MAX - 0.5;
+    for (size_t i = 0; i < (size_t)B.rows * B.cols; i++)
+        B.val[i] = (double)rand_r(&seed) / RAND_MAX - 0.5;
+    for (size_t i = 0; i < (size_t)mask.rows * mask.cols; i++)
+        mask.val[i] = (double)rand_r(&seed) / RAND_MAX - 0.5;
+    const int grainsize = kernel == TUNE_MULT_ADD_COL ? 0 : tune_grainsize(kernel, m, k, n);
+
+    double *times = (double *)malloc(sizeof(double) * reps);
+    for (int r = -1; r < reps; r++) // One untimed warmup run
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (kernel == TUNE_MULT_ADD_COL)
+        {
+            matrix Z = matrix_mult_add_col(&A, &B, &b);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            delete_matrix(&Z);
+        }
+        else
+        {
+#pragma omp parallel
+#pragma omp master
+            {
+                if (kernel == TUNE_BACKWARD_WEIGHT)
+                    backward_weight_grad(&A, &B, 1.0 / k, 1.0, 0, grainsize, &C);
+                else
+                    backward_input_grad(&A, &B, &mask, 0, grainsize, &C);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &end);
+        }
+
+        if (r >= 0)
+            times[r] = elapsed_ms(&start, &end);
+    }
+
+    qsort(times, reps, sizeof(double), compare_doubles);
+    double median = times[reps / 2];
+
+    free(times);
+    delete_matrix(&A);
+    delete_matrix(&B);
+    delete_matrix(&b);
+    delete_matrix(&C);
+    delete_matrix(&mask);
+    return median;
+}
+
+/**
+ * Kernel time of one forward + backward step at the given batch width (current thread count)
+ */
+static double time_step(const int *layer_dims, int L, int batch, int reps)
+{
+    double total = 0.0;
+    for (int l = 1; l <= L; l++)
+    {
+        total += time_kernel(TUNE_MULT_ADD_COL, layer_dims[l], layer_dims[l - 1], batch, reps);
+        total += time_kernel(TUNE_BACKWARD_WEIGHT, layer_dims[l], batch, layer_dims[l - 1], reps);
+        if (l > 1)
+            total += time_kernel(TUNE_BACKWARD_INPUT, layer_dims[l - 1], layer_dims[l], batch, reps);
+    }
+    return total;
+}
+
+/**
+ * Shared-memory copy bandwidth in bytes per ms (proxy for on-node message transfer)
+ */
+static double measure_copy_bandwidth(size_t bytes, int reps)
+{
+    char *src = (char *)malloc(bytes);
+    char *dst = (char *)malloc(bytes);
+    memset(src, 1, bytes);
+    memset(dst, 0, bytes);
+
+    double best_ms = 0.0;
+    for (int r = 0; r < reps; r++)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        memcpy(dst, src, bytes);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double ms = elapsed_ms(&start, &end);
+        if (r == 0 || ms < best_ms)
+            best_ms = ms;
+    }
+
+    free(src);
+    free(dst);
+    return best_ms > 0.0 ? bytes / best_ms : 1e9;
+}
+
+static double elapsed_ms(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static const char *schedule_name(omp_sched_t schedule)
+{
+    switch (schedule)
+    {
+    case omp_sched_dynamic:
+        return "dynamic";
+    case omp_sched_guided:
+        return "guided";
+    default:
+        return "static";
+    }
+}
+
+static int parse_schedule(const char *name, omp_sched_t *schedule)
+{
+    if (strcmp(name, "static") == 0)
+        *schedule = omp_sched_static;
+    else if (strcmp(name, "dynamic") == 0)
+        *schedule = omp_sched_dynamic;
+    else if (strcmp(name, "guided") == 0)
+        *schedule = omp_sched_guided;
+    else
+        return 0;
+    return 1;
+}
@@ -0,0 +1,77 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <omp.h>
+#include <mpi.h>
+
+// Kernel autotuning: benchmarks tile sizes and OpenMP schedules for the forward GEMM of every
+// layer (and its shape-specialized variants), and the task grainsize of the backward kernels, and
+// persists the winners in a per-host tuning file that later runs load.
+// The forward kernel looks its shape up on every call and falls back to the untiled static schedule;
+// execution plans bind the backward grainsizes once (default: sized by the work per row).
+
+// Tunable GEMM kernels (C is m x n with inner dimension k)
+typedef enum
+{
+    TUNE_MULT_ADD_COL,     // Z = W * A + b (forward)
+    TUNE_BACKWARD_WEIGHT,  // dW += dZ * A_prev^T / m (backward_weight_grad)
+    TUNE_BACKWARD_INPUT,   // dZ_prev = W^T * dZ, masked (backward_input_grad)
+    TUNE_KERNEL_COUNT
+} tune_kernel;
+
+typedef struct
+{
+    tune_kernel kernel;
+    int m, k, n;
+    int threads;          // OpenMP threads the entry was tuned for
+    int tile;             // Square block of C per loop iteration (1 = untiled), or rows per task
+                          // of a backward kernel
+    omp_sched_t schedule; // Schedule of the (collapsed) block loop
+    int chunk;            // Schedule chunk size (0 = implementation default)
+    double time_ms;       // Median time of the winning candidate
+    int variant;          // gemm_variant of TUNE_MULT_ADD_COL (GEMM_GENERIC for the others)
+} tune_entry;
+
+// Recommended ranks x threads layout for the node
+typedef struct
+{
+    int cores;
+    int ranks;
+    int threads;
+    double step_ms; // Estimated time of one training step (compute + gradient allreduce)
+} tune_layout;
+
+// Number of loaded or tuned entries (checked before every lookup)
+extern int g_tune_count;
+
+// Select the schedule for one kernel call: sets the OpenMP runtime schedule and returns the tile size
+int tune_gemm(tune_kernel kernel, int m, int k, int n);
+
+// Tuned kernel variant for a shape (-1 if the shape has no entry)
+int tune_variant(tune_kernel kernel, int m, int k, int n);
+
+// Tuned task grainsize of a backward kernel for a shape (0 if the shape has no entry)
+int tune_grainsize(tune_kernel kernel, int m, int k, int n);
+
+// Benchmark all candidates for the network's GEMM shapes at the given batch sizes and current thread
+// count, with first_rows rows of the first layer (a tensor-parallel rank's share, or layer_dims[1])
+void autotune_kernels(const int *layer_dims, int L, int first_rows, const int *batches, int num_batches, int reps, int verbose);
+
+// Cores of the node shared by the ranks of comm (collective over comm; MPI_COMM_NULL for one process)
+int autotune_node_cores(MPI_Comm comm);
+
+// Estimate the best ranks x threads split of the node's cores for one training step of batch_size samples
+tune_layout autotune_layout(const int *layer_dims, int L, int batch_size, int cores, int reps, int verbose);
+
+// Per-host tuning file (tuning_<hostname>.txt)
+void autotune_default_path(char *path, int size);
+int autotune_save(const char *path, const tune_layout *layout);
+int autotune_load(const char *path, tune_layout *layout);
+
+// Per-node setup (collective): with tune set, the first rank of every node benchmarks the shapes all
+// of the node's ranks train with (each passes its first-layer rows and micro-batch widths) and writes
+// the file while the others wait; all ranks then load the node's file. Returns the number of entries.
+int autotune_init(const char *path, int tune, const int *layer_dims, int L, int first_rows,
+                  const int *widths, int num_widths, int batch_size, MPI_Comm comm);
+
+#endif // AUTOTUNE_H
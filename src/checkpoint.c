@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <mpi.h>
+
+#include "checkpoint.h"
+#include "trace.h"
+
+// Helper functions
+static void *write_thread(void *arg);
+static uint64_t fnv1a(const void *data, size_t bytes);
+static void wait_for_write(checkpoint_writer *w);
+static int map_checkpoint(const char *path, void **map, size_t *map_bytes, checkpoint_header *header);
+static void replica_layout(const tp_group *tp, const pipe_group *pp, int *dp_size, int *dp_rank, int *position,
+                           MPI_Comm *dp_comm, MPI_Comm *group_comm);
+
+void checkpoint_writer_init(checkpoint_writer *w, const char *path, const int *layer_dims, int L, int seed,
+                            const tp_group *tp, const pipe_group *pp, int rank)
+{
+    memset(w, 0, sizeof(*w));
+    w->path = path;
+    w->writer = rank == 0;
+
+    int dp_size, dp_rank, position;
+    MPI_Comm group_comm;
+    replica_layout(tp, pp, &dp_size, &dp_rank, &position, &w->dp_comm, &group_comm);
+    w->leader = position == 0;
+
+    memcpy(w->header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    w->header.version = CHECKPOINT_VERSION;
+    w->header.num_layers = L;
+    w->header.replicas = dp_size;
+    for (int l = 0; l <= L; l++)
+        w->header.layer_dims[l] = layer_dims[l];
+    w->header.seed = seed;
+    for (int l = 0; l < L; l++)
+        w->model_doubles += (size_t)layer_dims[l + 1] * layer_dims[l] + layer_dims[l + 1];
+    w->header.payload_doubles = (uint64_t)dp_size * w->model_doubles;
+
+    if (w->writer)
+        w->staging = (double *)malloc(sizeof(double) * w->header.payload_doubles);
+    else if (w->leader)
+        w->staging = (double *)malloc(sizeof(double) * w->model_doubles);
+    if (tp && tp->size > 1)
+    {
+        w->W0_full = new_matrix(layer_dims[1], layer_dims[0]);
+        w->b0_full = new_matrix(layer_dims[1], 1);
+    }
+}
+
+void checkpoint_save(checkpoint_writer *w, nn_params *params, const tp_group *tp, const pipe_group *pp,
+                     int epoch, long step, double learning_rate)
+{
+    TRACE_BEGIN(trace_begin_us);
+
+    // Full parameters on every rank of the replica
+    if (pp)
+        pipe_share_params(pp, params);
+    const int split = tp && tp->size > 1;
+    if (split)
+    {
+        tp_allgather_rows(tp, &params->W[0], &w->W0_full);
+        tp_allgather_rows(tp, &params->b[0], &w->b0_full);
+    }
+
+    if (w->leader)
+    {
+        // The staging buffer is free once the previous write is done
+        double begin = MPI_Wtime();
+        wait_for_write(w);
+        w->stall_ms += (MPI_Wtime() - begin) * 1000.0;
+
+        // The replica's copy, then every other replica's after the writer's own
+        begin = MPI_Wtime();
+        size_t k = 0;
+        for (int l = 0; l < params->L; l++)
+        {
+            const matrix *W = split && l == 0 ? &w->W0_full : &params->W[l];
+            const matrix *b = split && l == 0 ? &w->b0_full : &params->b[l];
+            memcpy(w->staging + k, W->val, sizeof(double) * W->rows * W->cols);
+            k += (size_t)W->rows * W->cols;
+            memcpy(w->staging + k, b->val, sizeof(double) * b->rows);
+            k += b->rows;
+        }
+        MPI_Gather(w->writer ? MPI_IN_PLACE : w->staging, (int)w->model_doubles, MPI_DOUBLE, w->staging,
+                   (int)w->model_doubles, MPI_DOUBLE, 0, w->dp_comm);
+
+        if (w->writer)
+        {
+            w->header.epoch = epoch;
+            w->header.step = step;
+            w->header.learning_rate = learning_rate;
+            w->copy_ms += (MPI_Wtime() - begin) * 1000.0;
+
+            w->running = pthread_create(&w->thread, NULL, write_thread, w) == 0;
+            if (!w->running)
+                w->failed++;
+        }
+    }
+    TRACE_END(trace_begin_us, "checkpoint_save", "io");
+}
+
+void checkpoint_writer_destroy(checkpoint_writer *w)
+{
+    if (w->writer)
+    {
+        double begin = MPI_Wtime();
+        wait_for_write(w);
+        w->stall_ms += (MPI_Wtime() - begin) * 1000.0;
+
+        printf("Checkpoints: %d written to %s (epoch %d)%s\n", w->written, w->path, w->header.epoch,
+               w->failed ? ", some writes FAILED" : "");
+        printf("  Snapshot copies: %.2f ms, waiting for writes: %.2f ms, background writes: %.2f ms\n",
+               w->copy_ms, w->stall_ms, w->write_ms);
+    }
+    free(w->staging);
+    if (w->W0_full.val)
+    {
+        delete_matrix(&w->W0_full);
+        delete_matrix(&w->b0_full);
+    }
+}
+
+int checkpoint_load(const char *path, const int *layer_dims, int L, const tp_group *tp, const pipe_group *pp,
+                    MPI_Comm comm, nn_params *params, checkpoint_header *header)
+{
+    TRACE_BEGIN(trace_begin_us);
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Map and check the file on rank 0
+    int status = 0;
+    void *map = MAP_FAILED;
+    size_t map_bytes = 0;
+    if (rank == 0)
+    {
+        status = map_checkpoint(path, &map, &map_bytes, header);
+
+        int same_shape = header->num_layers == (uint32_t)L;
+        for (int l = 0; same_shape && l <= L; l++)
+            same_shape = header->layer_dims[l] == layer_dims[l];
+        if (status == 0 && !same_shape)
+        {
+            fprintf(stderr, "Error: Checkpoint %s doesn't match the architecture\n", path);
+            status = 1;
+        }
+    }
+    MPI_Bcast(&status, 1, MPI_INT, 0, comm);
+    if (status != 0)
+    {
+        if (map != MAP_FAILED)
+            munmap(map, map_bytes);
+        return 1;
+    }
+    MPI_Bcast(header, sizeof(checkpoint_header), MPI_BYTE, 0, comm);
+
+    int dp_size, dp_rank, position;
+    MPI_Comm dp_comm, group_comm;
+    replica_layout(tp, pp, &dp_size, &dp_rank, &position, &dp_comm, &group_comm);
+    const int own_copies = header->replicas == (uint32_t)dp_size;
+    if (rank == 0 && !own_copies)
+        printf("Checkpoint %s holds %u replica(s), this run has %d: all of them start from the first\n", path,
+               header->replicas, dp_size);
+
+    // Rank 0 sends every replica leader its copy straight from the mapping, the leaders broadcast
+    // it to the rest of their replica
+    size_t model_doubles = 0;
+    for (int l = 0; l < L; l++)
+        model_doubles += (size_t)layer_dims[l + 1] * layer_dims[l] + layer_dims[l + 1];
+    double *model = (double *)malloc(sizeof(double) * model_doubles);
+    if (rank == 0)
+    {
+        const double *payload = (const double *)((const char *)map + sizeof(checkpoint_header));
+        memcpy(model, payload, sizeof(double) * model_doubles);
+        for (int r = 1; r < dp_size; r++)
+            MPI_Send(payload + (own_copies ? (size_t)r * model_doubles : 0), (int)model_doubles, MPI_DOUBLE, r, 0,
+                     dp_comm);
+    }
+    else if (position == 0)
+    {
+        MPI_Recv(model, (int)model_doubles, MPI_DOUBLE, 0, 0, dp_comm, MPI_STATUS_IGNORE);
+    }
+    MPI_Bcast(model, (int)model_doubles, MPI_DOUBLE, 0, group_comm);
+
+    // Keep this rank's rows of layer 0
+    const int split = tp && tp->size > 1;
+    params->L = L;
+    params->W = (matrix *)malloc(sizeof(matrix) * L);
+    params->b = (matrix *)malloc(sizeof(matrix) * L);
+    size_t k = 0;
+    for (int l = 0; l < L; l++)
+    {
+        const int rows = layer_dims[l + 1], cols = layer_dims[l];
+        const int first = split && l == 0 ? tp->row_offset : 0;
+        const int count = split && l == 0 ? tp->row_count : rows;
+        params->W[l] = new_matrix_first_touch(count, cols);
+        params->b[l] = new_matrix_first_touch(count, 1);
+        memcpy(params->W[l].val, model + k + (size_t)first * cols, sizeof(double) * count * cols);
+        k += (size_t)rows * cols;
+        memcpy(params->b[l].val, model + k + first, sizeof(double) * count);
+        k += rows;
+    }
+
+    free(model);
+    if (map != MAP_FAILED)
+        munmap(map, map_bytes);
+    TRACE_END(trace_begin_us, "checkpoint_load", "io");
+    return 0;
+}
+
+int checkpoint_read(const char *path, nn_params *params, checkpoint_header *header)
+{
+    TRACE_BEGIN(trace_begin_us);
+    void *map = MAP_FAILED;
+    size_t map_bytes = 0;
+    if (map_checkpoint(path, &map, &map_bytes, header) != 0)
+    {
+        if (map != MAP_FAILED)
+            munmap(map, map_bytes);
+        return 1;
+    }
+
+    const double *payload = (const double *)((const char *)map + sizeof(checkpoint_header));
+    const int L = header->num_layers;
+    params->L = L;
+    params->W = (matrix *)malloc(sizeof(matrix) * L);
+    params->b = (matrix *)malloc(sizeof(matrix) * L);
+    size_t k = 0;
+    for (int l = 0; l < L; l++)
+    {
+        params->W[l] = new_matrix_first_touch(header->layer_dims[l + 1], header->layer_dims[l]);
+        params->b[l] = new_matrix_first_touch(header->layer_dims[l + 1], 1);
+        const size_t size_W = (size_t)params->W[l].rows * params->W[l].cols;
+        memcpy(params->W[l].val, payload + k, sizeof(double) * size_W);
+        memcpy(params->b[l].val, payload + k + size_W, sizeof(double) * params->b[l].rows);
+        k += size_W + params->b[l].rows;
+    }
+
+    munmap(map, map_bytes);
+    TRACE_END(trace_begin_us, "checkpoint_read", "io");
+    return 0;
+}
+
+/**
+ * Map a checkpoint read-only and check it against its own header (magic, version, size, checksum)
+ * Returns 0 on success, 1 on error (the mapping, if any, is left to the caller)
+ */
+static int map_checkpoint(const char *path, void **map, size_t *map_bytes, checkpoint_header *header)
+{
+    memset(header, 0, sizeof(checkpoint_header));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(checkpoint_header))
+    {
+        fprintf(stderr, "Error: Cannot read checkpoint %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    *map_bytes = st.st_size;
+    *map = mmap(NULL, *map_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*map == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Cannot map checkpoint %s\n", path);
+        return 1;
+    }
+
+    memcpy(header, *map, sizeof(checkpoint_header));
+    const double *payload = (const double *)((const char *)*map + sizeof(checkpoint_header));
+
+    int valid_shape = header->num_layers >= 1 && header->num_layers <= MAX_HIDDEN_LAYERS + 1 && header->replicas >= 1;
+    uint64_t expected = 0;
+    for (uint32_t l = 0; valid_shape && l < header->num_layers; l++)
+    {
+        valid_shape = header->layer_dims[l] > 0 && header->layer_dims[l + 1] > 0;
+        expected += (uint64_t)header->layer_dims[l + 1] * header->layer_dims[l] + header->layer_dims[l + 1];
+    }
+    expected *= header->replicas;
+
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0)
+    {
+        fprintf(stderr, "Error: %s is not a checkpoint\n", path);
+        return 1;
+    }
+    if (header->version != CHECKPOINT_VERSION)
+    {
+        fprintf(stderr, "Error: Checkpoint %s has version %u (expected %d)\n", path, header->version,
+                CHECKPOINT_VERSION);
+        return 1;
+    }
+    if (!valid_shape || header->payload_doubles != expected ||
+        *map_bytes != sizeof(checkpoint_header) + expected * sizeof(double))
+    {
+        fprintf(stderr, "Error: Checkpoint %s is truncated or has an invalid shape\n", path);
+        return 1;
+    }
+    if (fnv1a(payload, expected * sizeof(double)) != header->checksum)
+    {
+        fprintf(stderr, "Error: Checkpoint %s is corrupt (checksum mismatch)\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * The data-parallel replicas this rank belongs to: the pipelines, or the tensor-parallel groups
+ * (position is the rank within its replica, dp_comm joins the ranks at the same position)
+ */
+static void replica_layout(const tp_group *tp, const pipe_group *pp, int *dp_size, int *dp_rank, int *position,
+                           MPI_Comm *dp_comm, MPI_Comm *group_comm)
+{
+    *dp_size = pp ? pp->dp_size : tp->dp_size;
+    *dp_rank = pp ? pp->dp_rank : tp->dp_rank;
+    *position = pp ? pp->stage : tp->rank;
+    *dp_comm = pp ? pp->dp_comm : tp->dp_comm;
+    *group_comm = pp ? pp->comm : tp->comm;
+}
+
+static void wait_for_write(checkpoint_writer *w)
+{
+    if (!w->running)
+        return;
+    pthread_join(w->thread, NULL);
+    w->running = 0;
+}
+
+/**
+ * Write the staged snapshot to a temporary file and rename it over the checkpoint
+ */
+static void *write_thread(void *arg)
+{
+    checkpoint_writer *w = (checkpoint_writer *)arg;
+    TRACE_BEGIN(trace_begin_us);
+    double begin = MPI_Wtime();
+    const size_t payload_bytes = sizeof(double) * w->header.payload_doubles;
+    w->header.checksum = fnv1a(w->staging, payload_bytes);
+
+    char tmp_path[1024];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", w->path);
+    FILE *file = fopen(tmp_path, "wb");
+    int ok = file != NULL;
+    if (ok)
+    {
+        ok = fwrite(&w->header, sizeof(checkpoint_header), 1, file) == 1 &&
+             fwrite(w->staging, 1, payload_bytes, file) == payload_bytes;
+        ok = fflush(file) == 0 && ok;
+        ok = fsync(fileno(file)) == 0 && ok;
+        ok = fclose(file) == 0 && ok;
+    }
+    ok = ok && rename(tmp_path, w->path) == 0;
+
+    if (ok)
+    {
+        w->written++;
+    }
+    else
+    {
+        fprintf(stderr, "Warning: Could not write checkpoint %s\n", w->path);
+        w->failed++;
+    }
+    w->write_ms += (MPI_Wtime() - begin) * 1000.0;
+    TRACE_END(trace_begin_us, "checkpoint_write", "io");
+    return NULL;
+}
+
+static uint64_t fnv1a(const void *data, size_t bytes)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < bytes; i++)
+    {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,85 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <mpi.h>
+#include "config.h"
+#include "matrix.h"
+#include "nn.h"
+#include "tensor_parallel.h"
+#include "pipeline.h"
+
+// Binary checkpoints: a fixed header followed by the full parameters of every data-parallel
+// replica (W1, b1, W2, b2, ... as row-major doubles, replica after replica; replicas start from
+// different initializations and stay distinct). The first rank of every replica sends its copy to
+// rank 0, which stages the snapshot and a background thread writes it to <path>.tmp, syncs it and
+// renames it over <path>, so a crash mid-write leaves the previous checkpoint intact. Training uses
+// plain SGD, whose only state is the learning rate and step count, and draws random numbers only
+// for the He initialization, so the seed is its RNG state.
+
+#define CHECKPOINT_MAGIC "NNCKPT"
+#define CHECKPOINT_VERSION 2
+
+typedef struct
+{
+    char magic[8];                             // CHECKPOINT_MAGIC, zero-padded
+    uint32_t version;                          // CHECKPOINT_VERSION
+    uint32_t num_layers;                       // L
+    uint32_t replicas;                         // Models in the payload (data-parallel replicas)
+    int32_t layer_dims[MAX_HIDDEN_LAYERS + 2]; // Layer widths (num_layers + 1 used)
+    int32_t epoch;                             // Iterations completed
+    int32_t seed;                              // Seed offset of the He initialization
+    uint64_t step;                             // Parameter updates applied
+    double learning_rate;                      // Optimizer state
+    uint64_t payload_doubles;                  // replicas x the size of one model
+    uint64_t checksum;                         // FNV-1a of the payload bytes
+} checkpoint_header;
+
+typedef struct
+{
+    const char *path;
+    int writer;               // This rank writes the files
+    int leader;               // First rank of its replica (sends the replica's copy to the writer)
+    MPI_Comm dp_comm;         // Replica leaders (the writer is rank 0)
+    size_t model_doubles;     // One replica's parameters
+    checkpoint_header header; // Of the snapshot in staging
+    double *staging;          // Snapshot being written (writer), or the replica's copy (other leaders)
+    matrix W0_full;           // Layer 0 gathered from a tensor-parallel group
+    matrix b0_full;
+    pthread_t thread;
+    int running;
+
+    // Totals over all checkpoints
+    int written;
+    int failed;
+    double copy_ms;  // Snapshot copies on the training thread
+    double stall_ms; // Training thread waiting for the previous write
+    double write_ms; // Background writes
+} checkpoint_writer;
+
+// rank is the rank in the training communicator (rank 0 writes); the replicas are the
+// tensor-parallel groups, or the pipelines if pp is not NULL
+void checkpoint_writer_init(checkpoint_writer *w, const char *path, const int *layer_dims, int L, int seed,
+                            const tp_group *tp, const pipe_group *pp, int rank);
+
+// Snapshot params after epoch iterations and step updates and start writing it in the background.
+// Collective over the training communicator
+void checkpoint_save(checkpoint_writer *w, nn_params *params, const tp_group *tp, const pipe_group *pp,
+                     int epoch, long step, double learning_rate);
+
+// Wait for the last write and print the totals (writer only)
+void checkpoint_writer_destroy(checkpoint_writer *w);
+
+// Map the checkpoint on rank 0 of comm, check it against layer_dims and send every replica its own
+// copy (all of them the first one if the number of replicas differs); every rank gets its part of
+// the parameters (its rows of layer 0 under tensor parallelism). Returns 0 on success, 1 on error
+// (on every rank; collective)
+int checkpoint_load(const char *path, const int *layer_dims, int L, const tp_group *tp, const pipe_group *pp,
+                    MPI_Comm comm, nn_params *params, checkpoint_header *header);
+
+// Read the first replica's model from a checkpoint, taking the architecture from its header (no
+// MPI; for inference). Returns 0 on success, 1 on error
+int checkpoint_read(const char *path, nn_params *params, checkpoint_header *header);
+
+#endif // CHECKPOINT_H
@@ -2,14 +2,52 @@
 #define CONFIG_H
 
 // Maximum and default training dataset size
-#define MAX_TRAINING_SAMPLES 43200 // 64 * 675 (divisible by 64 and 90, less than 90% of 50000)
+#define MAX_TRAINING_SAMPLES 43200 // Leaves room for the 1/9 test split within 5000 images per class
 #define DEFAULT_TRAINING_SAMPLES MAX_TRAINING_SAMPLES
 
 // Default hyperparameters
 #define DEFAULT_LEARNING_RATE 0.001
 #define DEFAULT_NUM_ITERATIONS 1000
 #define DEFAULT_PRINT_EVERY 100
-#define BATCH_SIZE 64
+#define DEFAULT_BATCH_SIZE 64 // Global mini-batch size (summed over all processes)
+#define DEFAULT_MICRO_BATCH_SIZE 0 // Local micro-batch size for gradient accumulation (0 = whole local batch)
+
+// Network architecture: hidden layer widths (input and output widths come from the data)
+#define MAX_HIDDEN_LAYERS 16
+#define DEFAULT_HIDDEN_LAYERS "128,64"
+
+// Samples per chunk for inference-only forward passes (keeps activations cache-resident)
+#define INFERENCE_CHUNK_SIZE 64
+
+// Inference server defaults: largest dynamic batch, longest time the oldest queued request waits
+// for a batch to fill, and worker threads (each with its own engine)
+#define SERVE_MAX_BATCH 32
+#define SERVE_MAX_WAIT_US 1000
+#define SERVE_WORKERS 2
+#define SERVE_MAX_CONNECTIONS 1024
+
+// Training samples per rank whose activation ranges calibrate the int8 model (--int8)
+#define QUANT_CALIBRATION_SAMPLES 1024
+
+// Samples per allgather when evaluating with layer 0 split across a tensor-parallel group
+#define TP_EVAL_CHUNK_SIZE 1024
+
+// Default micro-batches per pipeline stage in every local mini-batch (when -u is not given)
+#define PIPELINE_MICRO_BATCHES_PER_STAGE 4
+
+// Asynchronous SGD: default number of ranks hosting parameter shards, and how long a rank sleeps
+// between reads of the step clocks while held back by the staleness bound
+#define DEFAULT_ASYNC_SERVERS 1
+#define ASYNC_POLL_US 100
+
+// Default iterations between checkpoints (with --checkpoint; the final model is always saved)
+#define DEFAULT_CHECKPOINT_EVERY 10
+
+// Most values per hyperparameter in a sweep
+#define MAX_SWEEP_VALUES 64
+
+// Timed repetitions per candidate when autotuning kernels (the median is kept)
+#define AUTOTUNE_REPS 5
 
 // Random seed for reproducibility
 #define RANDOM_SEED 42
@@ -17,4 +55,8 @@
 // Default number of OpenMP threads
 #define DEFAULT_NUM_THREADS 1
 
+// Default number of OpenMP threads for background evaluation, taken out of the process's threads
+// (0 = evaluate inline)
+#define DEFAULT_EVAL_THREADS 0
+
 #endif // CONFIG_H
\ No newline at end of file
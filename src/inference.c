@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+
+#include "inference.h"
+#include "checkpoint.h"
+#include "nn_params.h"
+#include "alloc.h"
+#include "trace.h"
+
+// Pixel value / 255.0 for every byte value (the exact scaling of the training transform)
+static double pixel_scale[256];
+
+// Helper functions
+static void write_outputs(const inference_engine *engine, const double *logits, int n, int *classes, double *probs);
+
+int inference_init(inference_engine *engine, const char *checkpoint_path, inference_mode mode, int chunk_size,
+                   int num_threads)
+{
+    memset(engine, 0, sizeof(*engine));
+    checkpoint_header header;
+    if (checkpoint_read(checkpoint_path, &engine->params, &header) != 0)
+        return 1;
+
+    engine->L = header.num_layers;
+    for (int l = 0; l <= engine->L; l++)
+        engine->layer_dims[l] = header.layer_dims[l];
+    engine->num_inputs = engine->layer_dims[0];
+    engine->num_classes = engine->layer_dims[engine->L];
+
+    engine->mode = mode;
+    if (mode == INFERENCE_LATENCY)
+    {
+        chunk_size = 1;
+        num_threads = 1;
+    }
+    engine->chunk_size = chunk_size > 0 ? chunk_size : INFERENCE_CHUNK_SIZE;
+    engine->num_threads = num_threads > 0 ? num_threads : omp_get_max_threads();
+
+    engine->plan = plan_build(PLAN_INFERENCE, engine->layer_dims, engine->L, engine->chunk_size, NULL);
+    engine->slabs = (double **)malloc(sizeof(double *) * engine->num_threads);
+
+    // Every thread allocates (and so first-touches) the slab it runs its chunks in
+#pragma omp parallel num_threads(engine->num_threads)
+    engine->slabs[omp_get_thread_num()] = plan_alloc_slab(&engine->plan);
+
+    for (int v = 0; v < 256; v++)
+        pixel_scale[v] = v / 255.0;
+    return 0;
+}
+
+void inference_free(inference_engine *engine)
+{
+    for (int t = 0; t < engine->num_threads; t++)
+        alloc_free(engine->slabs[t]);
+    free(engine->slabs);
+    plan_destroy(&engine->plan);
+    delete_nn_params(&engine->params);
+    if (engine->quant)
+    {
+        for (int t = 0; t < engine->num_threads; t++)
+            quant_workspace_free(&engine->quant_ws[t]);
+        free(engine->quant_ws);
+        delete_quant_model(engine->quant);
+        free(engine->quant);
+    }
+}
+
+void inference_quantize(inference_engine *engine, const uint8_t *images, size_t stride, int n)
+{
+    // Calibration sample as the training transform sees it (features x n)
+    matrix X_calib = new_matrix(engine->num_inputs, n);
+    for (int j = 0; j < n; j++)
+        for (int k = 0; k < engine->num_inputs; k++)
+            X_calib.val[(size_t)k * n + j] = pixel_scale[images[(size_t)j * stride + k]];
+
+    engine->quant = (quant_model *)malloc(sizeof(quant_model));
+    quantize_model(engine->quant, &engine->params, &X_calib, MPI_COMM_NULL);
+    delete_matrix(&X_calib);
+
+    engine->quant_ws = (quant_workspace *)malloc(sizeof(quant_workspace) * engine->num_threads);
+    for (int t = 0; t < engine->num_threads; t++)
+        engine->quant_ws[t] = quant_workspace_create(engine->quant, engine->chunk_size);
+}
+
+void inference_run(inference_engine *engine, const uint8_t *images, size_t stride, int n, int *classes,
+                   double *probs)
+{
+    TRACE_BEGIN(trace_begin_us);
+    const exec_plan *plan = &engine->plan;
+    const nn_params *params = &engine->params;
+    const int L = engine->L;
+    const int num_inputs = engine->num_inputs;
+    const int num_classes = engine->num_classes;
+
+    if (engine->quant)
+    {
+        // Int8 model: same chunking (one sample per chunk in latency mode), logits in the plan's output buffer
+        const int chunk_size = engine->chunk_size;
+        const int num_chunks = (n + chunk_size - 1) / chunk_size;
+#pragma omp parallel for schedule(dynamic) num_threads(engine->num_threads) if (engine->num_threads > 1 && num_chunks > 1)
+        for (int chunk = 0; chunk < num_chunks; chunk++)
+        {
+            const int t = omp_get_thread_num();
+            const int start = chunk * chunk_size;
+            const int cn = (start + chunk_size <= n) ? chunk_size : n - start;
+            double *logits = plan_view(plan, engine->slabs[t], plan->act[L - 1], cn).val;
+
+            quant_load_images(engine->quant, &engine->quant_ws[t], images + (size_t)start * stride, stride, cn);
+            quant_forward(engine->quant, &engine->quant_ws[t], cn, logits, NULL);
+            write_outputs(engine, logits, cn, classes ? &classes[start] : NULL,
+                          probs ? &probs[(size_t)start * num_classes] : NULL);
+        }
+        TRACE_END(trace_begin_us, "inference_run", "inference");
+        return;
+    }
+
+    if (engine->mode == INFERENCE_LATENCY)
+    {
+        // One sample at a time on the calling thread: the input is already a column
+        double *slab = engine->slabs[0];
+        double *input = plan_view(plan, slab, plan->input, 1).val;
+        for (int j = 0; j < n; j++)
+        {
+            const uint8_t *image = images + (size_t)j * stride;
+            for (int k = 0; k < num_inputs; k++)
+                input[k] = pixel_scale[image[k]];
+
+            const double *in = input;
+            for (int l = 0; l < L; l++)
+            {
+                double *out = plan_view(plan, slab, plan->act[l], 1).val;
+                dense_forward_vector(&params->W[l], &params->b[l], in, out, l < L - 1);
+                in = out;
+            }
+            write_outputs(engine, in, 1, classes ? &classes[j] : NULL, probs ? &probs[(size_t)j * num_classes] : NULL);
+        }
+        TRACE_END(trace_begin_us, "inference_run", "inference");
+        return;
+    }
+
+    const int chunk_size = engine->chunk_size;
+    const int num_chunks = (n + chunk_size - 1) / chunk_size;
+
+#pragma omp parallel for schedule(dynamic) num_threads(engine->num_threads) if (engine->num_threads > 1 && num_chunks > 1)
+    for (int chunk = 0; chunk < num_chunks; chunk++)
+    {
+        double *slab = engine->slabs[omp_get_thread_num()];
+        const int start = chunk * chunk_size;
+        const int cn = (start + chunk_size <= n) ? chunk_size : n - start;
+
+        // Scale the chunk's images into a contiguous (features x cn) block, one image per column
+        double *input = plan_view(plan, slab, plan->input, cn).val;
+        for (int j = 0; j < cn; j++)
+        {
+            const uint8_t *image = images + (size_t)(start + j) * stride;
+            for (int k = 0; k < num_inputs; k++)
+                input[k * cn + j] = pixel_scale[image[k]];
+        }
+
+        const double *in = input;
+        for (int l = 0; l < L; l++)
+        {
+            double *out = plan_view(plan, slab, plan->act[l], cn).val;
+            if (cn == 1)
+                dense_forward_vector(&params->W[l], &params->b[l], in, out, l < L - 1);
+            else
+                dense_forward_chunk(&params->W[l], &params->b[l], in, cn, out, l < L - 1);
+            in = out;
+        }
+        write_outputs(engine, in, cn, classes ? &classes[start] : NULL,
+                      probs ? &probs[(size_t)start * num_classes] : NULL);
+    }
+    TRACE_END(trace_begin_us, "inference_run", "inference");
+}
+
+uint8_t *inference_read_records(const char *path, size_t record_bytes, int *count)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "Error: Cannot open file %s\n", path);
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    *count = size > 0 ? (int)(size / record_bytes) : 0;
+    const size_t bytes = (size_t)*count * record_bytes;
+    uint8_t *records = (uint8_t *)malloc(bytes > 0 ? bytes : 1);
+    if (*count == 0 || fread(records, 1, bytes, file) != bytes)
+    {
+        fprintf(stderr, "Error: %s holds no complete %zu-byte records\n", path, record_bytes);
+        free(records);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    return records;
+}
+
+/**
+ * Argmax class and softmax probabilities of n samples from their logits (num_classes x n)
+ */
+static void write_outputs(const inference_engine *engine, const double *logits, int n, int *classes, double *probs)
+{
+    const int num_classes = engine->num_classes;
+    for (int j = 0; j < n; j++)
+    {
+        int pred_class = 0;
+        double max_val = logits[j];
+        for (int i = 1; i < num_classes; i++)
+        {
+            if (logits[i * n + j] > max_val)
+            {
+                max_val = logits[i * n + j];
+                pred_class = i;
+            }
+        }
+        if (classes)
+            classes[j] = pred_class;
+
+        if (probs)
+        {
+            double *p = &probs[(size_t)j * num_classes];
+            double sum = 0.0;
+            for (int i = 0; i < num_classes; i++)
+            {
+                p[i] = exp(logits[i * n + j] - max_val);
+                sum += p[i];
+            }
+            for (int i = 0; i < num_classes; i++)
+                p[i] /= sum;
+        }
+    }
+}
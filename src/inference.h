@@ -0,0 +1,65 @@
+#ifndef INFERENCE_H
+#define INFERENCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "nn.h"
+#include "plan.h"
+#include "quantize.h"
+
+// Standalone inference on a trained model: loads a checkpoint (no MPI needed) and classifies
+// uint8 images (pixels scaled by 1/255, as in training) with forward-only kernels on an inference
+// plan. Two tunings:
+//   INFERENCE_THROUGHPUT - requests are cut into chunks of chunk_size samples that threads take
+//                          dynamically, one plan slab each (large batches, all cores)
+//   INFERENCE_LATENCY    - samples go one at a time through matrix-vector kernels on the calling
+//                          thread (batch 1, no fork/join or gather overhead)
+// After inference_quantize, both run the int8 model (see quantize.h) instead of the double one.
+
+typedef enum
+{
+    INFERENCE_THROUGHPUT,
+    INFERENCE_LATENCY
+} inference_mode;
+
+typedef struct
+{
+    nn_params params;
+    int layer_dims[MAX_HIDDEN_LAYERS + 2];
+    int L;
+    int num_inputs;  // layer_dims[0] (bytes per image)
+    int num_classes; // layer_dims[L]
+
+    inference_mode mode;
+    int chunk_size;  // Samples per forward pass (1 in latency mode)
+    int num_threads; // Threads per request (1 in latency mode)
+    exec_plan plan;  // PLAN_INFERENCE for chunk_size samples
+    double **slabs;  // One per thread
+
+    quant_model *quant;        // Int8 model (NULL = double)
+    quant_workspace *quant_ws; // One per thread
+} inference_engine;
+
+// Load the model at checkpoint_path and build the engine; chunk_size and num_threads <= 0 pick the
+// defaults (INFERENCE_CHUNK_SIZE, omp_get_max_threads()), latency mode always uses 1 and 1.
+// Returns 0 on success, 1 on error
+int inference_init(inference_engine *engine, const char *checkpoint_path, inference_mode mode, int chunk_size,
+                   int num_threads);
+void inference_free(inference_engine *engine);
+
+// Switch the engine to an int8 model calibrated on n images (same layout as inference_run)
+void inference_quantize(inference_engine *engine, const uint8_t *images, size_t stride, int n);
+
+// Classify n images, image j starting at images + j * stride (num_inputs bytes each; stride
+// RECORD_SIZE with images = records + 1 reads CIFAR-10 records in place). Writes the predicted
+// class of every sample into classes and, if probs is not NULL, its class probabilities into
+// probs[j * num_classes ...]. Either output may be NULL
+void inference_run(inference_engine *engine, const uint8_t *images, size_t stride, int n, int *classes,
+                   double *probs);
+
+// Read a whole file of fixed-size records (CIFAR-10 binary: RECORD_SIZE, raw images: num_inputs)
+// Returns the malloc'd contents and sets count, or NULL on error (trailing partial records are ignored)
+uint8_t *inference_read_records(const char *path, size_t record_bytes, int *count);
+
+#endif // INFERENCE_H
@@ -2,11 +2,14 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <mpi.h>
 
 #include "load.h"
+#include "trace.h"
 
 // Global variables
 CIFAR10Image *cifar10_images = NULL;
+static MPI_Win images_win = MPI_WIN_NULL; // Node-shared window holding cifar10_images
 const char *class_names[NUM_CLASSES] = {
     "airplane", "automobile", "bird", "cat", "deer",
     "dog", "frog", "horse", "ship", "truck"};
@@ -20,6 +23,7 @@ static int read_cifar10_file(const char *filename, CIFAR10Image *images);
  */
 static int read_cifar10_file(const char *filename, CIFAR10Image *images)
 {
+    TRACE_BEGIN(trace_begin_us);
     FILE *file = fopen(filename, "rb");
     if (!file)
     {
@@ -48,49 +52,78 @@ static int read_cifar10_file(const char *filename, CIFAR10Image *images)
     }
 
     fclose(file);
+    TRACE_END(trace_begin_us, "read_cifar10_file", "load");
     return 0;
 }
 
 /**
- * Initialize CIFAR-10 data by loading all batch files
- * Returns 0 on success, 1 on error
+ * Initialize CIFAR-10 data by loading all batch files, once per node: the first rank of every
+ * node reads them into a shared-memory window that the node's other ranks map
+ * Returns 0 on success, 1 on error (on every rank of the node)
  */
-int init_cifar10_data()
+int init_cifar10_data(MPI_Comm comm)
 {
-    // Allocate memory for all images
-    cifar10_images = (CIFAR10Image *)malloc(TOTAL_IMAGES * sizeof(CIFAR10Image));
-    if (!cifar10_images)
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+    int node_rank;
+    MPI_Comm_rank(node_comm, &node_rank);
+
+    // Allocate memory for all images on the node's first rank
+    MPI_Aint bytes = node_rank == 0 ? (MPI_Aint)TOTAL_IMAGES * sizeof(CIFAR10Image) : 0;
+    CIFAR10Image *base = NULL;
+    if (MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, node_comm, &base, &images_win) != MPI_SUCCESS)
     {
         fprintf(stderr, "Error: Memory allocation failed for images (%.2f MB needed)\n",
                 (TOTAL_IMAGES * sizeof(CIFAR10Image)) / (1024.0 * 1024.0));
+        MPI_Comm_free(&node_comm);
         return 1;
     }
 
+    // Passive-target epoch over the whole load: the leader's stores are published by MPI_Win_sync
+    // on both sides of a barrier (the memory model of a shared-memory window)
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, images_win);
+
     // Load all batch files
-    for (int batch = 1; batch <= NUM_BATCHES; batch++)
+    int status = 0;
+    if (node_rank == 0)
     {
-        char batch_path[512];
-        snprintf(batch_path, sizeof(batch_path), "%s/data_batch_%d.bin", "cifar-10-batches-bin", batch);
-
-        if (read_cifar10_file(batch_path, &cifar10_images[(batch - 1) * IMAGES_PER_BATCH]) != 0)
+        for (int batch = 1; batch <= NUM_BATCHES && status == 0; batch++)
         {
-            fprintf(stderr, "Error: Failed to read batch %d\n", batch);
-            cleanup_cifar10_data();
-            return 1;
+            char batch_path[512];
+            snprintf(batch_path, sizeof(batch_path), "%s/data_batch_%d.bin", "cifar-10-batches-bin", batch);
+
+            if (read_cifar10_file(batch_path, &base[(batch - 1) * IMAGES_PER_BATCH]) != 0)
+            {
+                fprintf(stderr, "Error: Failed to read batch %d\n", batch);
+                status = 1;
+            }
         }
     }
+    // The leader's stores become visible to the node's other ranks
+    MPI_Win_sync(images_win);
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(images_win);
+    MPI_Win_unlock_all(images_win);
+    MPI_Bcast(&status, 1, MPI_INT, 0, node_comm);
 
-    return 0;
+    MPI_Aint size;
+    int disp_unit;
+    MPI_Win_shared_query(images_win, 0, &size, &disp_unit, &cifar10_images);
+    MPI_Comm_free(&node_comm);
+
+    if (status != 0)
+        cleanup_cifar10_data();
+    return status;
 }
 
 /**
- * Clean up allocated memory
+ * Clean up allocated memory (collective over the node when the images were loaded)
  */
 void cleanup_cifar10_data(void)
 {
-    if (cifar10_images)
+    if (images_win != MPI_WIN_NULL)
     {
-        free(cifar10_images);
+        MPI_Win_free(&images_win);
         cifar10_images = NULL;
     }
 }
@@ -2,6 +2,7 @@
 #define LOAD_H
 
 #include <stdint.h>
+#include <mpi.h>
 
 #define IMAGE_SIZE 32
 #define CHANNELS 3
@@ -25,7 +26,7 @@ extern CIFAR10Image *cifar10_images;
 extern const char *class_names[NUM_CLASSES];
 
 // Functions
-int init_cifar10_data(void);
+int init_cifar10_data(MPI_Comm comm); // Collective: one copy per node, shared by its ranks
 void cleanup_cifar10_data(void);
 
 #endif // LOAD_H
\ No newline at end of file
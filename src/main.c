@@ -1,37 +1,212 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <omp.h>
 #include <mpi.h>
 
 #include "config.h"
 #include "load.h"
 #include "transform.h"
+#include "synthetic.h"
 #include "matrix.h"
 #include "nn.h"
 #include "nn_params.h"
 #include "nn_train.h"
 #include "timing.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "autotune.h"
+#include "alloc.h"
+#include "affinity.h"
+#include "tensor_parallel.h"
+#include "pipeline.h"
+#include "param_server.h"
+#include "checkpoint.h"
+#include "quantize.h"
+
+// Helper functions
+static int parse_layer_list(const char *text, int *hidden);
+static int load_arch_file(const char *path, int *hidden);
+static int parse_value_list(const char *text, double *values);
+static int redirect_stdout(const char *path);
+static void restore_stdout(int saved);
 
 static void print_usage(const char *prog_name)
 {
     printf("Usage: mpirun -np <num_processes> %s [OPTIONS]\n", prog_name);
     printf("Options:\n");
-    printf("  -n, --train-samples <num> Number of training samples (max %d, default %d)\n", MAX_TRAINING_SAMPLES, DEFAULT_TRAINING_SAMPLES);
-    printf("                            Must be divisible by BATCH_SIZE (%d) and 90 (for 10 classes, 9:1 split)\n", BATCH_SIZE);
-    printf("                            In other words, must be divisible by 2880\n");
+    printf("  -n, --train-samples <num> Number of training samples (max %d for CIFAR-10, default %d)\n", MAX_TRAINING_SAMPLES, DEFAULT_TRAINING_SAMPLES);
+    printf("                            A further 1/9 as many test samples is held out (9:1 split)\n");
     printf("  -i, --iterations <num>    Number of training iterations (default %d)\n", DEFAULT_NUM_ITERATIONS);
+    printf("  -b, --batch-size <num>    Global mini-batch size across all processes (default %d)\n", DEFAULT_BATCH_SIZE);
+    printf("  -u, --micro-batch <num>   Local micro-batch size for gradient accumulation\n");
+    printf("                            (default: whole local batch in one pass)\n");
     printf("  -p, --print <num>         Print progress every N iterations (default %d)\n", DEFAULT_PRINT_EVERY);
     printf("  -t, --threads <num>       Number of OpenMP threads per process (default %d)\n", DEFAULT_NUM_THREADS);
+    printf("  -e, --eval-threads <num>  Of those, threads that evaluate in the background while the rest train\n");
+    printf("                            (default %d, 0 evaluates inline and blocks training)\n", DEFAULT_EVAL_THREADS);
+    printf("  --layers <w1,w2,...>      Hidden layer widths (default %s; input and output come from the data)\n", DEFAULT_HIDDEN_LAYERS);
+    printf("  --arch-file <file>        Read the hidden layers from a spec file, one 'dense <width>' per line\n");
+    printf("  --tensor-parallel <num>   Split layer 1's rows across groups of <num> ranks that share their data\n");
+    printf("                            (the other layers stay data-parallel across the groups; default 1)\n");
+    printf("  --pipeline <stages>       Split the layers into <stages> pipeline stages of consecutive ranks,\n");
+    printf("                            streaming micro-batches with a 1F1B schedule (default 1; -u defaults\n");
+    printf("                            to %d micro-batches per stage)\n", PIPELINE_MICRO_BATCHES_PER_STAGE);
+    printf("  --async <staleness>       Asynchronous SGD: push updates to parameter-server ranks and pull fresh\n");
+    printf("                            weights via MPI RMA, running at most <staleness> steps ahead of the\n");
+    printf("                            slowest rank (0 = lockstep)\n");
+    printf("  --servers <num>           Ranks hosting parameter shards in --async mode (default %d)\n", DEFAULT_ASYNC_SERVERS);
+    printf("  --slowdown <rank>:<f>     Make <rank> a straggler: stretch its steps to <f> times their compute time\n");
+    printf("  --sweep-lr <a,b,...>      Hyperparameter sweep: train one model per learning rate x seed, several\n");
+    printf("  --sweep-seeds <a,b,...>   at once on groups of ranks (each leader logs to sweep_config<n>.log)\n");
+    printf("  --sweep-groups <num>      Concurrent groups in a sweep (default: as many as the configurations,\n");
+    printf("                            up to a divisor of num_processes)\n");
+    printf("  --checkpoint <file>       Save the model, written in the background by rank 0, every\n");
+    printf("                            --checkpoint-every iterations (default %d) and after training\n", DEFAULT_CHECKPOINT_EVERY);
+    printf("  --checkpoint-every <num>  Iterations between checkpoints (0 = only the final model)\n");
+    printf("  --resume <file>           Continue training from a checkpoint instead of initializing the weights\n");
+    printf("  --int8                    After training, quantize the model to int8 (per-row weight scales,\n");
+    printf("                            activation ranges calibrated on the training shard) and report its\n");
+    printf("                            accuracy and evaluation time against the double model\n");
+    printf("  --int8-eval               Report the progress accuracy of the int8-quantized model, requantized\n");
+    printf("                            at every evaluation (final accuracy stays double)\n");
+    printf("  --calib-samples <num>     Training samples per rank for the int8 calibration (default %d)\n", QUANT_CALIBRATION_SAMPLES);
+    printf("  --trace <file>            Record a Chrome/Perfetto trace of all ranks and threads to <file>\n");
+    printf("  --synthetic               Generate a deterministic class-structured dataset instead of CIFAR-10\n");
+    printf("  --features <num>          Input dimensionality of the synthetic dataset (default %d)\n", PIXELS_PER_IMAGE);
+    printf("  --perf-counters           Report hardware counters (IPC, GFLOP/s, bytes/FLOP) per kernel\n");
+    printf("  --pin                     Pin OpenMP threads to cores within each rank's CPU set (skipped when\n");
+    printf("                            OMP_PROC_BIND or OMP_PLACES is set)\n");
+    printf("  --huge-pages              Back large matrices with transparent huge pages (2 MB aligned)\n");
+    printf("  --autotune                Benchmark kernel tile sizes / schedules and ranks x threads layouts at\n");
+    printf("                            startup and save the winners to the tuning file\n");
+    printf("  --tuning-file <file>      Kernel tuning file to load or write (default tuning_<hostname>.txt)\n");
     printf("  -h, --help                Show this help message\n");
     printf("\nExample:\n");
     printf("  mpirun -np 4 %s -n 2880 -i 10 -p 1 -t 4\n", prog_name);
+    printf("  mpirun -np 4 %s -n 2880 -i 10 -b 512 -u 32 -t 2\n", prog_name);
+    printf("  mpirun -np 4 %s -n 2880 -i 10 --layers 256,128,64\n", prog_name);
+    printf("  mpirun -np 4 %s -n 2880 -i 10 --tensor-parallel 2\n", prog_name);
+    printf("  mpirun -np 4 %s -n 2880 -i 10 --layers 512,256,128 --pipeline 2\n", prog_name);
+    printf("  mpirun -np 4 %s -n 2880 -i 10 --async 4 --slowdown 3:2\n", prog_name);
+    printf("  mpirun -np 4 %s -n 2880 -i 100 --checkpoint model.ckpt && mpirun -np 4 %s -n 2880 -i 200 --resume model.ckpt\n",
+           prog_name, prog_name);
+    printf("  mpirun -np 8 %s -n 2880 -i 10 --sweep-lr 0.001,0.003,0.01,0.03 --sweep-seeds 0,1\n", prog_name);
+}
+
+/**
+ * Parse a comma-separated list of hidden layer widths; returns the count, or -1 if invalid
+ */
+static int parse_layer_list(const char *text, int *hidden)
+{
+    int count = 0;
+    const char *p = text;
+    while (*p)
+    {
+        char *end;
+        long width = strtol(p, &end, 10);
+        if (end == p || width <= 0 || count == MAX_HIDDEN_LAYERS)
+            return -1;
+        hidden[count++] = (int)width;
+        p = end;
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return -1;
+    }
+    return count;
+}
+
+/**
+ * Parse a comma-separated list of numbers (at most MAX_SWEEP_VALUES); returns the count, or -1 if invalid
+ */
+static int parse_value_list(const char *text, double *values)
+{
+    int count = 0;
+    const char *p = text;
+    while (*p)
+    {
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p || count == MAX_SWEEP_VALUES)
+            return -1;
+        values[count++] = value;
+        p = end;
+        if (*p == ',')
+            p++;
+        else if (*p != '\0')
+            return -1;
+    }
+    return count;
+}
+
+/**
+ * Send stdout to a file; returns the saved descriptor for restore_stdout (-1 if not redirected)
+ */
+static int redirect_stdout(const char *path)
+{
+    fflush(stdout);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return -1;
+    int saved = dup(STDOUT_FILENO);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+    return saved;
+}
+
+static void restore_stdout(int saved)
+{
+    if (saved < 0)
+        return;
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+}
+
+/**
+ * Read hidden layers from a spec file: one 'dense <width>' per line, '#' starts a comment.
+ * Returns the count, or -1 if the file can't be read or a line is invalid
+ */
+static int load_arch_file(const char *path, int *hidden)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        char kind[32], extra[2];
+        int width;
+        int fields = sscanf(line, "%31s %d %1s", kind, &width, extra);
+        if (fields <= 0)
+            continue;
+        if (fields != 2 || strcmp(kind, "dense") != 0 || width <= 0 || count == MAX_HIDDEN_LAYERS)
+        {
+            count = -1;
+            break;
+        }
+        hidden[count++] = width;
+    }
+
+    fclose(file);
+    return count;
 }
 
 int main(int argc, char *argv[])
 {
     // ========== INITIALIZE MPI ==========
-    MPI_Init(&argc, &argv);
+    // Background evaluation makes MPI calls from a second thread
+    int thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &thread_support);
 
     int rank, num_processes;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -45,6 +220,34 @@ int main(int argc, char *argv[])
     int num_iterations = DEFAULT_NUM_ITERATIONS;
     int print_every = DEFAULT_PRINT_EVERY;
     int num_threads = DEFAULT_NUM_THREADS;
+    int batch_size = DEFAULT_BATCH_SIZE;
+    int micro_batch_size = DEFAULT_MICRO_BATCH_SIZE;
+    int eval_threads = DEFAULT_EVAL_THREADS;
+    const char *trace_file = NULL;
+    int use_perf_counters = 0;
+    int synthetic = 0;
+    int num_features = PIXELS_PER_IMAGE;
+    int autotune = 0;
+    int pin_threads = 0;
+    const char *tuning_file = NULL;
+    int tensor_parallel = 1;
+    int pipeline_stages = 1;
+    int async_staleness = -1;
+    int async_servers = DEFAULT_ASYNC_SERVERS;
+    int slow_rank = -1;
+    double slowdown = 1.0;
+    double sweep_lr[MAX_SWEEP_VALUES] = {DEFAULT_LEARNING_RATE};
+    double sweep_seeds[MAX_SWEEP_VALUES] = {0};
+    int num_sweep_lr = 0, num_sweep_seeds = 0;
+    int sweep_groups = 0;
+    const char *checkpoint_path = NULL;
+    int checkpoint_every = DEFAULT_CHECKPOINT_EVERY;
+    const char *resume_path = NULL;
+    int int8 = 0;
+    int int8_eval = 0;
+    int calib_samples = QUANT_CALIBRATION_SAMPLES;
+    int hidden[MAX_HIDDEN_LAYERS];
+    int num_hidden = parse_layer_list(DEFAULT_HIDDEN_LAYERS, hidden);
 
     // Parse command-line arguments
     for (int i = 1; i < argc; i++)
@@ -59,10 +262,10 @@ int main(int argc, char *argv[])
         else if ((strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--train-samples") == 0) && i + 1 < argc)
         {
             num_training_samples = atoi(argv[++i]);
-            if (num_training_samples <= 0 || num_training_samples > MAX_TRAINING_SAMPLES)
+            if (num_training_samples <= 0)
             {
                 if (rank == 0)
-                    fprintf(stderr, "Error: Number of training samples must be between 1 and %d\n", MAX_TRAINING_SAMPLES);
+                    fprintf(stderr, "Error: Number of training samples must be positive\n");
                 MPI_Finalize();
                 return 1;
             }
@@ -78,6 +281,28 @@ int main(int argc, char *argv[])
                 return 1;
             }
         }
+        else if ((strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batch-size") == 0) && i + 1 < argc)
+        {
+            batch_size = atoi(argv[++i]);
+            if (batch_size <= 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Batch size must be positive\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "-u") == 0 || strcmp(argv[i], "--micro-batch") == 0) && i + 1 < argc)
+        {
+            micro_batch_size = atoi(argv[++i]);
+            if (micro_batch_size < 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Micro-batch size must be non-negative\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
         else if ((strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--print") == 0) && i + 1 < argc)
         {
             print_every = atoi(argv[++i]);
@@ -100,6 +325,204 @@ int main(int argc, char *argv[])
                 return 1;
             }
         }
+        else if ((strcmp(argv[i], "-e") == 0 || strcmp(argv[i], "--eval-threads") == 0) && i + 1 < argc)
+        {
+            eval_threads = atoi(argv[++i]);
+            if (eval_threads < 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Number of evaluation threads must be non-negative\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--synthetic") == 0)
+        {
+            synthetic = 1;
+        }
+        else if (strcmp(argv[i], "--features") == 0 && i + 1 < argc)
+        {
+            num_features = atoi(argv[++i]);
+            if (num_features <= 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Number of features must be positive\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--perf-counters") == 0)
+        {
+            use_perf_counters = 1;
+        }
+        else if (strcmp(argv[i], "--pin") == 0)
+        {
+            pin_threads = 1;
+        }
+        else if (strcmp(argv[i], "--huge-pages") == 0)
+        {
+            alloc_set_huge_pages(1);
+        }
+        else if (strcmp(argv[i], "--autotune") == 0)
+        {
+            autotune = 1;
+        }
+        else if (strcmp(argv[i], "--tuning-file") == 0 && i + 1 < argc)
+        {
+            tuning_file = argv[++i];
+        }
+        else if (strcmp(argv[i], "--layers") == 0 && i + 1 < argc)
+        {
+            num_hidden = parse_layer_list(argv[++i], hidden);
+            if (num_hidden < 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: --layers expects up to %d positive widths separated by commas\n", MAX_HIDDEN_LAYERS);
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--arch-file") == 0 && i + 1 < argc)
+        {
+            const char *arch_file = argv[++i];
+            num_hidden = load_arch_file(arch_file, hidden);
+            if (num_hidden < 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Cannot read architecture from %s (expected up to %d 'dense <width>' lines)\n",
+                            arch_file, MAX_HIDDEN_LAYERS);
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--tensor-parallel") == 0 && i + 1 < argc)
+        {
+            tensor_parallel = atoi(argv[++i]);
+            if (tensor_parallel <= 0 || num_processes % tensor_parallel != 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Tensor-parallel group size must divide num_processes (%d)\n", num_processes);
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+        {
+            pipeline_stages = atoi(argv[++i]);
+            if (pipeline_stages <= 0 || num_processes % pipeline_stages != 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Pipeline stages must divide num_processes (%d)\n", num_processes);
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--async") == 0 && i + 1 < argc)
+        {
+            async_staleness = atoi(argv[++i]);
+            if (async_staleness < 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Staleness bound must be non-negative\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--servers") == 0 && i + 1 < argc)
+        {
+            async_servers = atoi(argv[++i]);
+            if (async_servers <= 0 || async_servers > num_processes)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Number of servers must be between 1 and num_processes (%d)\n", num_processes);
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--slowdown") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%d:%lf", &slow_rank, &slowdown) != 2 || slow_rank < 0 ||
+                slow_rank >= num_processes || slowdown < 1.0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: --slowdown expects <rank>:<factor> with a valid rank and factor >= 1\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "--sweep-lr") == 0 || strcmp(argv[i], "--sweep-seeds") == 0) && i + 1 < argc)
+        {
+            int is_lr = strcmp(argv[i], "--sweep-lr") == 0;
+            int count = parse_value_list(argv[++i], is_lr ? sweep_lr : sweep_seeds);
+            int valid = count > 0;
+            for (int v = 0; valid && v < count; v++)
+                valid = is_lr ? sweep_lr[v] > 0.0 : sweep_seeds[v] == (int)sweep_seeds[v];
+            if (!valid)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: %s expects up to %d %s separated by commas\n", argv[i - 1], MAX_SWEEP_VALUES,
+                            is_lr ? "positive learning rates" : "integer seeds");
+                MPI_Finalize();
+                return 1;
+            }
+            if (is_lr)
+                num_sweep_lr = count;
+            else
+                num_sweep_seeds = count;
+        }
+        else if (strcmp(argv[i], "--sweep-groups") == 0 && i + 1 < argc)
+        {
+            sweep_groups = atoi(argv[++i]);
+            if (sweep_groups <= 0 || num_processes % sweep_groups != 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Sweep groups must divide num_processes (%d)\n", num_processes);
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+        {
+            checkpoint_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc)
+        {
+            checkpoint_every = atoi(argv[++i]);
+            if (checkpoint_every < 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Checkpoint interval must be non-negative\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--resume") == 0 && i + 1 < argc)
+        {
+            resume_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--int8") == 0)
+        {
+            int8 = 1;
+        }
+        else if (strcmp(argv[i], "--int8-eval") == 0)
+        {
+            int8_eval = 1;
+        }
+        else if (strcmp(argv[i], "--calib-samples") == 0 && i + 1 < argc)
+        {
+            calib_samples = atoi(argv[++i]);
+            if (calib_samples <= 0)
+            {
+                if (rank == 0)
+                    fprintf(stderr, "Error: Number of calibration samples must be positive\n");
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
         else
         {
             if (rank == 0)
@@ -112,47 +535,239 @@ int main(int argc, char *argv[])
         }
     }
 
-    // BATCH_SIZE must be divisible by num_processes
-    if (BATCH_SIZE % num_processes != 0)
+    // CIFAR-10 has a fixed number of images (synthetic data has no limit)
+    if (!synthetic && num_training_samples > MAX_TRAINING_SAMPLES)
     {
         if (rank == 0)
-            fprintf(stderr, "Error: BATCH_SIZE (%d) must be divisible by num_processes (%d)\n", BATCH_SIZE, num_processes);
+            fprintf(stderr, "Error: Number of training samples must be between 1 and %d\n", MAX_TRAINING_SAMPLES);
         MPI_Finalize();
         return 1;
     }
 
+    // CIFAR-10 images have a fixed size
+    if (!synthetic && num_features != PIXELS_PER_IMAGE)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: --features requires --synthetic\n");
+        MPI_Finalize();
+        return 1;
+    }
 
-    // Training samples must be divisible by BATCH_SIZE
-    if (num_training_samples % BATCH_SIZE != 0)
+    // Every pipeline stage needs at least one layer, and a stage holds whole layers
+    if (pipeline_stages > 1 && (pipeline_stages > num_hidden + 1 || tensor_parallel > 1))
     {
         if (rank == 0)
-            fprintf(stderr, "Error: Training samples (%d) must be divisible by BATCH_SIZE (%d)\n", num_training_samples, BATCH_SIZE);
+            fprintf(stderr, "Error: --pipeline needs at least %d layers and can't be combined with --tensor-parallel\n", pipeline_stages);
         MPI_Finalize();
         return 1;
     }
 
-    // Training samples must be divisible by 90 (9:1 ratio plus balanced 10 classes)
-    if (num_training_samples % 90 != 0)
+    // Asynchronous updates replace the gradient allreduce of plain data parallelism only
+    if (async_staleness >= 0 && (pipeline_stages > 1 || tensor_parallel > 1))
     {
         if (rank == 0)
-            fprintf(stderr, "Error: Training samples (%d) must be divisible by 90\n", num_training_samples);
+            fprintf(stderr, "Error: --async can't be combined with --pipeline or --tensor-parallel\n");
         MPI_Finalize();
         return 1;
     }
 
+    // A sweep trains every learning rate x seed pair, one model per group of ranks at a time
+    int sweep = num_sweep_lr > 0 || num_sweep_seeds > 0;
+    if (num_sweep_lr == 0)
+        num_sweep_lr = 1;
+    if (num_sweep_seeds == 0)
+        num_sweep_seeds = 1;
+    int num_configs = num_sweep_lr * num_sweep_seeds;
+    if (sweep_groups == 0)
+    {
+        // As many groups as configurations, rounded down to a divisor of the ranks
+        sweep_groups = num_configs < num_processes ? num_configs : num_processes;
+        while (num_processes % sweep_groups != 0)
+            sweep_groups--;
+    }
+    if (sweep_groups > num_configs)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: More sweep groups (%d) than configurations (%d)\n", sweep_groups, num_configs);
+        MPI_Finalize();
+        return 1;
+    }
+    if (sweep_groups > 1 && (tensor_parallel > 1 || pipeline_stages > 1 || async_staleness >= 0))
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: A sweep over several groups can't be combined with --tensor-parallel, --pipeline or --async\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Quantization needs the whole model on every rank
+    if ((int8 || int8_eval) && (tensor_parallel > 1 || pipeline_stages > 1))
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: --int8 and --int8-eval can't be combined with --tensor-parallel or --pipeline\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Every configuration of a sweep starts from its own initialization
+    if (resume_path && num_configs > 1)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: --resume can't be combined with a sweep\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Consecutive ranks form a group (its own job communicator)
+    int job_size = num_processes / sweep_groups;
+    int group = rank / job_size;
+    MPI_Comm job_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, group, rank, &job_comm);
+    int job_rank;
+    MPI_Comm_rank(job_comm, &job_rank);
+
+    // The layer split across a tensor-parallel group must be a hidden layer with a row for every rank
+    int num_replicas = job_size / (tensor_parallel * pipeline_stages);
+    if (tensor_parallel > 1 && (num_hidden == 0 || hidden[0] < tensor_parallel))
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: --tensor-parallel needs a hidden layer 1 with at least %d units\n", tensor_parallel);
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Every data-parallel replica needs at least one sample of each global mini-batch
+    if (batch_size < num_replicas)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: Batch size (%d) must be at least the number of replicas (%d)\n", batch_size, num_replicas);
+        MPI_Finalize();
+        return 1;
+    }
+
+    // The stages of a pipeline hold different layers, so they evaluate together after sharing them
+    if (eval_threads > 0 && pipeline_stages > 1)
+    {
+        if (rank == 0)
+            printf("Pipeline parallelism: evaluating inline\n");
+        eval_threads = 0;
+    }
+
+    // Fall back to inline evaluation if MPI can't be called from the evaluation thread
+    if (eval_threads > 0 && thread_support < MPI_THREAD_MULTIPLE)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Warning: MPI_THREAD_MULTIPLE not supported, evaluating inline\n");
+        eval_threads = 0;
+    }
+
+    // Evaluation threads come out of the process's threads, so the two teams don't oversubscribe
+    // its cores (with --pin they get cores of their own)
+    if (eval_threads > 0 && eval_threads >= num_threads)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Warning: %d evaluation threads leave none of the %d threads to train, evaluating inline\n",
+                    eval_threads, num_threads);
+        eval_threads = 0;
+    }
+    const int train_threads = num_threads - eval_threads;
+
     // Calculate test samples and total samples
     int num_test_samples = num_training_samples / 9; // 10% of total
     int num_samples = num_training_samples + num_test_samples;
 
-    // Set number of OpenMP threads
-    omp_set_num_threads(num_threads);
+    // Every replica needs at least one training and one test sample
+    if (num_test_samples < num_replicas)
+    {
+        if (rank == 0)
+            fprintf(stderr, "Error: Training samples (%d) must be at least 9 * replicas (%d)\n", num_training_samples, 9 * num_replicas);
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Set number of OpenMP threads (the training team)
+    omp_set_num_threads(train_threads);
+
+    // Define neural network architecture: input, hidden layers, output
+    int layer_dims[MAX_HIDDEN_LAYERS + 2];
+    int L = num_hidden + 1; // number of layers (excluding input)
+    layer_dims[0] = num_features;
+    for (int l = 0; l < num_hidden; l++)
+        layer_dims[l + 1] = hidden[l];
+    layer_dims[L] = NUM_CLASSES;
+
+    // Groups splitting layer 1 (each group is one data-parallel replica)
+    tp_group tp = tp_group_create(tensor_parallel, layer_dims[1], job_comm);
+
+    // Pipelines of consecutive ranks, each rank one stage (each pipeline is one data-parallel replica)
+    pipe_group pp;
+    if (pipeline_stages > 1)
+        pp = pipe_group_create(pipeline_stages, layer_dims, L, job_comm);
+    int replica = pipeline_stages > 1 ? pp.dp_rank : tp.dp_rank;
+
+    // Resume from a checkpoint of the same architecture (mapped on rank 0, every replica gets its copy)
+    nn_params resume_params;
+    int start_iteration = 0;
+    int resume_seed = 0;
+    if (resume_path)
+    {
+        checkpoint_header header;
+        if (checkpoint_load(resume_path, layer_dims, L, &tp, pipeline_stages > 1 ? &pp : NULL, job_comm,
+                            &resume_params, &header) != 0)
+        {
+            MPI_Finalize();
+            return 1;
+        }
+        if (num_iterations <= header.epoch)
+        {
+            if (rank == 0)
+                fprintf(stderr, "Error: %s is at iteration %d, -i must be larger to continue training\n", resume_path,
+                        header.epoch);
+            delete_nn_params(&resume_params);
+            MPI_Finalize();
+            return 1;
+        }
+        start_iteration = header.epoch;
+        resume_seed = header.seed;
+        if (rank == 0)
+            printf("Resumed from %s: iteration %d, %lu updates (saved learning rate %g, seed %d)\n", resume_path,
+                   header.epoch, (unsigned long)header.step, header.learning_rate, header.seed);
+    }
+
+    // Tune the kernels for this node (or load an earlier run's tuning file) before any instrumentation,
+    // at the shapes this rank trains: its replica's (micro-)batch widths and its rows of layer 0
+    const int local_batch = batch_size / num_replicas + (replica < batch_size % num_replicas ? 1 : 0);
+    const int micro_width = train_micro_batch_size(local_batch, micro_batch_size, pipeline_stages);
+    int tune_widths[2] = {micro_width, local_batch % micro_width};
+    autotune_init(tuning_file, autotune, layer_dims, L, tp.row_count, tune_widths, tune_widths[1] > 0 ? 2 : 1,
+                  batch_size, MPI_COMM_WORLD);
+
+    // Pin each rank's threads to its share of its CPUs if asked, unless the user controls binding
+    if (pin_threads && (getenv("OMP_PROC_BIND") || getenv("OMP_PLACES")))
+    {
+        if (rank == 0)
+            printf("Thread pinning: left to OMP_PROC_BIND / OMP_PLACES\n");
+        pin_threads = 0;
+    }
+    if (pin_threads)
+        affinity_pin_threads(train_threads, eval_threads, MPI_COMM_WORLD);
+
+    // Per-thread hardware counters for the kernels (falls back to analytic counts if not permitted)
+    if (use_perf_counters && !perf_counters_init(train_threads) && rank == 0)
+        fprintf(stderr, "Warning: Hardware performance counters not available, reporting analytic counts only\n");
+
+    // Start tracing before any data is loaded
+    if (trace_file)
+        trace_init(trace_file);
 
     timer_t_custom startup_timer;
     TIMER_START(startup_timer);
 
-    int samples_per_process = num_samples / num_processes;
-    int train_per_process = num_training_samples / num_processes;
-    int test_per_process = num_test_samples / num_processes;
+    // Approximate local shard sizes (remainders are spread so shards differ by at most one sample;
+    // the ranks of a tensor-parallel group or a pipeline share one shard)
+    int samples_per_process = num_samples / num_replicas;
+    int train_per_process = num_training_samples / num_replicas;
+    int test_per_process = num_test_samples / num_replicas;
 
     if (rank == 0)
     {
@@ -160,47 +775,79 @@ int main(int argc, char *argv[])
         printf("Training samples: %d (90%% of total)\n", num_training_samples);
         printf("Test samples: %d (10%% of total)\n", num_test_samples);
         printf("Total samples: %d\n", num_samples);
+        if (synthetic)
+            printf("Data: synthetic (%d features)\n", num_features);
         printf("MPI processes: %d\n", num_processes);
-        printf("Samples per process: %d (train: %d, test: %d)\n", samples_per_process, train_per_process, test_per_process);
+        if (sweep)
+            printf("Sweep: %d configurations (%d learning rates x %d seeds) on %d groups of %d ranks\n",
+                   num_configs, num_sweep_lr, num_sweep_seeds, sweep_groups, job_size);
+        if (tensor_parallel > 1)
+            printf("Tensor-parallel groups: %d of %d ranks (one data-parallel replica each)\n", num_replicas, tensor_parallel);
+        if (pipeline_stages > 1)
+            printf("Pipelines: %d of %d stages (one data-parallel replica each)\n", num_replicas, pipeline_stages);
+        if (async_staleness >= 0)
+            printf("Asynchronous SGD: staleness bound %d, %d parameter server(s)\n", async_staleness, async_servers);
+        if (slow_rank >= 0)
+            printf("Straggler: rank %d runs %.2fx slower\n", slow_rank, slowdown);
+        printf("Samples per process: ~%d (train: ~%d, test: ~%d)\n", samples_per_process, train_per_process, test_per_process);
         printf("Samples per class (global): train: %d, test: %d\n", num_training_samples / NUM_CLASSES, num_test_samples / NUM_CLASSES);
-        printf("Mini-batch size: %d (global), %d (per process)\n", BATCH_SIZE, BATCH_SIZE / num_processes);
+        printf("Mini-batch size: %d (global), ~%d (per process)\n", batch_size, batch_size / num_replicas);
+        if (micro_batch_size > 0)
+            printf("Micro-batch size: %d (gradient accumulation)\n", micro_batch_size);
         printf("Iterations: %d\n", num_iterations);
         printf("Print every: %d iterations\n", print_every);
         printf("OpenMP threads per process: %d\n", num_threads);
         printf("=============================================================\n\n");
     }
 
-    // Load data (all ranks load all data)
-    timer_t_custom load_timer;
-    TIMER_START(load_timer);
-
-    if (init_cifar10_data() != 0)
+    // Load data (once per node, shared by its ranks; synthetic data is generated during the transform step)
+    if (!synthetic)
     {
-        fprintf(stderr, "Rank %d: Failed to initialize CIFAR-10 data\n", rank);
-        MPI_Finalize();
-        return 1;
-    }
+        timer_t_custom load_timer;
+        TIMER_START(load_timer);
 
-    TIMER_STOP(load_timer);
+        TRACE_BEGIN(trace_load);
+        int load_status = init_cifar10_data(MPI_COMM_WORLD);
+        TRACE_END(trace_load, "init_cifar10_data", "load");
+        if (load_status != 0)
+        {
+            fprintf(stderr, "Rank %d: Failed to initialize CIFAR-10 data\n", rank);
+            MPI_Finalize();
+            return 1;
+        }
 
-    // Synchronize after loading
-    MPI_Barrier(MPI_COMM_WORLD);
+        TIMER_STOP(load_timer);
 
-    if (rank == 0)
-    {
-        printf("\n========= DATA LOADED ==========\n");
-        printf("[TIMER] Data loading: %.2f ms\n", load_timer.elapsed_ms);
-        printf("Successfully loaded %d total images (%.2f MB)\n", TOTAL_IMAGES, TOTAL_MEMORY_MB);
-        printf("================================\n\n");
+        // Synchronize after loading
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        if (rank == 0)
+        {
+            printf("\n========= DATA LOADED ==========\n");
+            printf("[TIMER] Data loading: %.2f ms\n", load_timer.elapsed_ms);
+            printf("Successfully loaded %d total images (%.2f MB)\n", TOTAL_IMAGES, TOTAL_MEMORY_MB);
+            printf("================================\n\n");
+        }
     }
 
-    // Transform data (each rank gets its subset)
+    // Transform data (each replica gets its subset)
     timer_t_custom transform_timer;
     TIMER_START(transform_timer);
 
-    if (prepare_cifar10_data(num_samples, rank, num_processes) != 0)
+    TRACE_BEGIN(trace_transform);
+    int transform_status;
+    if (synthetic)
+        transform_status = prepare_synthetic_data(num_training_samples, num_test_samples, num_features, replica, num_replicas);
+    else
+        transform_status = prepare_cifar10_data(num_training_samples, num_test_samples, replica, num_replicas);
+    TRACE_END(trace_transform, synthetic ? "prepare_synthetic_data" : "prepare_cifar10_data", "transform");
+    if (transform_status != 0)
+        fprintf(stderr, "Rank %d: Failed to prepare %s data\n", rank, synthetic ? "synthetic" : "CIFAR-10");
+
+    // Freeing the shared images is collective over the node, so every rank learns of a failure first
+    MPI_Allreduce(MPI_IN_PLACE, &transform_status, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    if (transform_status != 0)
     {
-        fprintf(stderr, "Rank %d: Failed to prepare CIFAR-10 data\n", rank);
         cleanup_cifar10_data();
         MPI_Finalize();
         return 1;
@@ -228,21 +875,95 @@ int main(int argc, char *argv[])
     if (rank == 0)
         printf("\n[TIMER] Total startup: %.2f ms\n\n", startup_timer.elapsed_ms);
 
-    // Define neural network architecture
-    int layer_dims[] = {PIXELS_PER_IMAGE, 128, 64, NUM_CLASSES};
-    int L = 3; // number of layers (excluding input)
+    // Train the models: each group takes every sweep_groups-th configuration on its shard of the data
+    double sweep_start = MPI_Wtime();
+    double *results = (double *)calloc(3 * num_configs, sizeof(double));
+    for (int c = group; c < num_configs; c += sweep_groups)
+    {
+        double learning_rate = sweep_lr[c / num_sweep_seeds];
+        int seed = resume_path ? resume_seed : (int)sweep_seeds[c % num_sweep_seeds];
+        char config[64];
+        snprintf(config, sizeof(config), "lr=%g seed=%d", learning_rate, seed);
+
+        // In a sweep, each configuration has a checkpoint of its own
+        char config_checkpoint[1024];
+        if (checkpoint_path && sweep)
+            snprintf(config_checkpoint, sizeof(config_checkpoint), "%s.config%d", checkpoint_path, c);
+
+        // In a sweep, each group leader writes its model's log to a file of its own
+        int saved_stdout = -1;
+        if (sweep && job_rank == 0)
+        {
+            char log_path[64];
+            snprintf(log_path, sizeof(log_path), "sweep_config%d.log", c);
+            saved_stdout = redirect_stdout(log_path);
+        }
 
-    // Train the model
-    nn_params params = train_model(&data->X_train, &data->Y_train, &data->X_test, &data->Y_test,
-                                   layer_dims, L, DEFAULT_LEARNING_RATE, num_iterations,
-                                   print_every, num_samples, num_threads, rank, num_processes);
+        train_summary summary;
+        nn_params params = train_model(&data->X_train, &data->Y_train, &data->X_test, &data->Y_test,
+                                       layer_dims, L, learning_rate, num_iterations,
+                                       batch_size, micro_batch_size,
+                                       print_every, eval_threads, int8_eval ? calib_samples : 0, num_samples, num_threads, &tp,
+                                       pipeline_stages > 1 ? &pp : NULL, async_staleness, async_servers,
+                                       rank == slow_rank ? slowdown : 1.0, seed,
+                                       resume_path ? &resume_params : NULL, start_iteration,
+                                       checkpoint_path && sweep ? config_checkpoint : checkpoint_path, checkpoint_every,
+                                       config, &summary, job_comm);
+        if (int8)
+            quant_report(&params, &data->X_train, &data->Y_train, &data->X_test, &data->Y_test, calib_samples,
+                         job_comm);
+        delete_nn_params(&params);
+        restore_stdout(saved_stdout);
+
+        if (job_rank == 0)
+        {
+            results[3 * c] = summary.train_accuracy;
+            results[3 * c + 1] = summary.test_accuracy;
+            results[3 * c + 2] = summary.training_time_sec;
+        }
+    }
+
+    if (sweep)
+    {
+        // Every configuration's results, from the group that trained it
+        if (rank == 0)
+            MPI_Reduce(MPI_IN_PLACE, results, 3 * num_configs, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        else
+            MPI_Reduce(results, NULL, 3 * num_configs, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+        double sweep_sec = MPI_Wtime() - sweep_start;
+
+        if (rank == 0)
+        {
+            double model_sec = 0.0;
+            printf("\n========== SWEEP RESULTS ==========\n");
+            printf("%-7s %-6s %-10s %-6s %10s %10s %10s\n", "Config", "Group", "LR", "Seed", "Train(%)", "Test(%)", "Time(s)");
+            for (int c = 0; c < num_configs; c++)
+            {
+                printf("%-7d %-6d %-10g %-6d %10.2f %10.2f %10.2f\n", c, c % sweep_groups, sweep_lr[c / num_sweep_seeds],
+                       (int)sweep_seeds[c % num_sweep_seeds], results[3 * c], results[3 * c + 1], results[3 * c + 2]);
+                model_sec += results[3 * c + 2];
+            }
+            printf("Sweep time: %.2f s for %d models (%.1f models/hour)\n", sweep_sec, num_configs,
+                   num_configs / sweep_sec * 3600.0);
+            // Each model's time is on its own group's ranks: this is the overlap of the groups, not a
+            // speedup over training the models one after another on every rank
+            printf("Summed training time: %.2f s (%.2f models training at once on average), startup paid once: %.2f s\n",
+                   model_sec, sweep_sec > 0.0 ? model_sec / sweep_sec : 0.0, startup_timer.elapsed_ms / 1000.0);
+            printf("Per-model logs: sweep_config<n>.log; rows tagged by config in training_results.csv\n");
+            printf("===================================\n");
+        }
+    }
+    free(results);
 
     // Cleanup
     if (rank == 0)
         printf("\nCleaning up...\n");
-    delete_nn_params(&params);
+    tp_group_free(&tp);
+    if (pipeline_stages > 1)
+        pipe_group_free(&pp);
     cleanup_transformed_data();
     cleanup_cifar10_data();
+    MPI_Comm_free(&job_comm);
 
     // Stop total program timer
     TIMER_STOP(g_total_program_time);
@@ -254,6 +975,12 @@ int main(int argc, char *argv[])
         printf("========================================\n");
     }
 
+    if (use_perf_counters)
+        perf_counters_close();
+
+    // Merge and write the trace (collective)
+    trace_finalize();
+
     // Finalize MPI
     MPI_Finalize();
 
@@ -4,6 +4,10 @@
 #include <math.h>
 #include <omp.h>
 #include "matrix.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "autotune.h"
+#include "alloc.h"
 
 matrix new_matrix(const int rows, const int cols)
 {
@@ -12,14 +16,29 @@ matrix new_matrix(const int rows, const int cols)
     mat.cols = cols;
     assert(rows > 0);
     assert(cols > 0);
-    // Use calloc for zero-initialization (faster than malloc + loop)
-    mat.val = (double *)calloc(rows * cols, sizeof(double));
+    // Use calloc for zero-initialization (large blocks are zeroed lazily, placed by the first kernel that writes them)
+    mat.val = (double *)calloc((size_t)rows * cols, sizeof(double));
+    assert(mat.val != NULL);
+    return mat;
+}
+
+matrix new_matrix_first_touch(const int rows, const int cols)
+{
+    matrix mat;
+    mat.rows = rows;
+    mat.cols = cols;
+    assert(rows > 0);
+    assert(cols > 0);
+    // Aligned, zeroed storage placed by a parallel first touch (see alloc.h)
+    mat.val = (double *)alloc_first_touch((size_t)rows * cols * sizeof(double));
     assert(mat.val != NULL);
     return mat;
 }
 
 matrix matrix_add(const matrix *A, const matrix *B)
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int rows = A->rows;
     const int cols = A->cols;
     assert(rows == B->rows);
@@ -32,28 +51,43 @@ matrix matrix_add(const matrix *A, const matrix *B)
         {
             mget(C, i, j) = mgetp(A, i, j) + mgetp(B, i, j);
         }
+    PERF_END(perf_s, "matrix_add", (double)rows * cols, 3.0 * rows * cols * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_add", "kernel");
     return C;
 }
 
 matrix matrix_sub(const matrix *A, const matrix *B)
 {
+    matrix C = new_matrix(A->rows, A->cols);
+    matrix_sub_into(A, B, &C);
+    return C;
+}
+
+void matrix_sub_into(const matrix *A, const matrix *B, matrix *C)
+{
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int rows = A->rows;
     const int cols = A->cols;
     assert(rows == B->rows);
     assert(cols == B->cols);
-    matrix C = new_matrix(rows, cols);
+    assert(rows == C->rows);
+    assert(cols == C->cols);
 
 #pragma omp parallel for collapse(2)
     for (int i = 1; i <= rows; i++)
         for (int j = 1; j <= cols; j++)
         {
-            mget(C, i, j) = mgetp(A, i, j) - mgetp(B, i, j);
+            mgetp(C, i, j) = mgetp(A, i, j) - mgetp(B, i, j);
         }
-    return C;
+    PERF_END(perf_s, "matrix_sub", (double)rows * cols, 3.0 * rows * cols * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_sub", "kernel");
 }
 
 matrix matrix_mult(const matrix *A, const matrix *B) // Matrix mult v2: cache optimized
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int rowsA = A->rows;
     const int colsA = A->cols;
     const int rowsB = B->rows;
@@ -81,11 +115,15 @@ matrix matrix_mult(const matrix *A, const matrix *B) // Matrix mult v2: cache op
         }
 
     delete_matrix(&Btranspose);
+    PERF_END(perf_s, "matrix_mult", 2.0 * rowsA * colsA * colsB, ((double)rowsA * colsA + 2.0 * rowsB * colsB + (double)rowsA * colsB) * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_mult", "kernel");
     return C;
 }
 
 matrix matrix_transpose(const matrix *A)
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int rows = A->rows;
     const int cols = A->cols;
     matrix At = new_matrix(cols, rows);
@@ -95,6 +133,8 @@ matrix matrix_transpose(const matrix *A)
         for (int j = 1; j <= cols; j++)
             mget(At, j, i) = mgetp(A, i, j);
 
+    PERF_END(perf_s, "matrix_transpose", 0, 2.0 * rows * cols * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_transpose", "kernel");
     return At;
 }
 
@@ -102,7 +142,7 @@ void delete_matrix(matrix *A)
 {
     if (A->val == NULL)
         return;
-    free(A->val);
+    alloc_free(A->val);
     A->val = NULL;
     A->rows = 0;
     A->cols = 0;
@@ -110,6 +150,8 @@ void delete_matrix(matrix *A)
 
 matrix matrix_sum_rows(const matrix *A)
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     matrix v = new_matrix(A->rows, 1);
 
 #pragma omp parallel for
@@ -120,22 +162,205 @@ matrix matrix_sum_rows(const matrix *A)
             sum += mgetp(A, i, j);
         mget(v, i, 1) = sum;
     }
+    PERF_END(perf_s, "matrix_sum_rows", (double)A->rows * A->cols, ((double)A->rows * A->cols + A->rows) * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_sum_rows", "kernel");
     return v;
 }
 
 matrix matrix_scalar_mult(const matrix *A, double scalar)
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     matrix C = new_matrix(A->rows, A->cols);
 
 #pragma omp parallel for collapse(2)
     for (int i = 1; i <= A->rows; i++)
         for (int j = 1; j <= A->cols; j++)
             mget(C, i, j) = mgetp(A, i, j) * scalar;
+    PERF_END(perf_s, "matrix_scalar_mult", (double)A->rows * A->cols, 2.0 * A->rows * A->cols * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_scalar_mult", "kernel");
     return C;
 }
 
 matrix matrix_mult_add_col(const matrix *W, const matrix *A, const matrix *b)
 {
+    matrix Z = new_matrix(W->rows, A->cols);
+    matrix Atranspose = new_matrix(A->cols, A->rows);
+    matrix_mult_add_col_variant(gemm_select_variant(W->rows, W->cols, A->cols), W, A, b, &Z, &Atranspose);
+    delete_matrix(&Atranspose);
+    return Z;
+}
+
+const char *gemm_variant_name(gemm_variant variant)
+{
+    static const char *names[GEMM_VARIANT_COUNT] = {"generic", "small_m", "large_k", "fixed_k"};
+    return names[variant];
+}
+
+int gemm_variant_supports(gemm_variant variant, int M, int K)
+{
+    switch (variant)
+    {
+    case GEMM_SMALL_M:
+        return M <= GEMM_SMALL_M_MAX;
+    case GEMM_LARGE_K:
+        return K >= GEMM_LARGE_K_MIN;
+    case GEMM_FIXED_K:
+        return K == 64 || K == 128 || K == 256;
+    default:
+        return 1;
+    }
+}
+
+gemm_variant gemm_select_variant(int M, int K, int N)
+{
+    // An autotuned choice for this exact shape wins over the shape rules
+    int tuned = tune_variant(TUNE_MULT_ADD_COL, M, K, N);
+    if (tuned >= 0 && gemm_variant_supports((gemm_variant)tuned, M, K))
+        return (gemm_variant)tuned;
+    return gemm_shape_variant(M, K);
+}
+
+gemm_variant gemm_shape_variant(int M, int K)
+{
+    if (gemm_variant_supports(GEMM_SMALL_M, M, K))
+        return GEMM_SMALL_M;
+    if (gemm_variant_supports(GEMM_FIXED_K, M, K))
+        return GEMM_FIXED_K;
+    if (gemm_variant_supports(GEMM_LARGE_K, M, K))
+        return GEMM_LARGE_K;
+    return GEMM_GENERIC;
+}
+
+// Z = W * At^T + b, one tile x tile block of Z per iteration (tuned block size and schedule)
+static void gemm_generic(const matrix *W, const matrix *Atranspose, const matrix *b, matrix *Z)
+{
+    const int M = W->rows;
+    const int K = W->cols;
+    const int N = Z->cols;
+    const int tile = tune_gemm(TUNE_MULT_ADD_COL, M, K, N);
+
+#pragma omp parallel for collapse(2) schedule(runtime)
+    for (int ii = 1; ii <= M; ii += tile)
+        for (int jj = 1; jj <= N; jj += tile)
+        {
+            const int i_end = ii + tile - 1 < M ? ii + tile - 1 : M;
+            const int j_end = jj + tile - 1 < N ? jj + tile - 1 : N;
+            for (int i = ii; i <= i_end; i++)
+                for (int j = jj; j <= j_end; j++)
+                {
+                    double bias = mgetp(b, i, 1);
+                    double sum = bias;
+                    for (int k = 1; k <= K; k++)
+                        sum += mgetp(W, i, k) * mgetp(Atranspose, j, k);
+                    mgetp(Z, i, j) = sum;
+                }
+        }
+}
+
+// Few output rows (e.g. the 10-class layer): one sample per iteration computes all M rows,
+// so the parallel loop runs over the batch instead of the handful of rows
+static void gemm_small_m(const matrix *W, const matrix *Atranspose, const matrix *b, matrix *Z)
+{
+    const int M = W->rows;
+    const int K = W->cols;
+    const int N = Z->cols;
+
+#pragma omp parallel for schedule(static)
+    for (int j = 1; j <= N; j++)
+    {
+        const double *a = &mgetp(Atranspose, j, 1);
+        for (int i = 1; i <= M; i++)
+        {
+            const double *w = &mgetp(W, i, 1);
+            double sum = mgetp(b, i, 1);
+            for (int k = 0; k < K; k++)
+                sum += w[k] * a[k];
+            mgetp(Z, i, j) = sum;
+        }
+    }
+}
+
+// Long reductions (e.g. the 3072-wide input layer): four rows of W stream against each packed
+// (transposed) sample, so every load of the sample feeds four independent accumulators
+static void gemm_large_k(const matrix *W, const matrix *Atranspose, const matrix *b, matrix *Z)
+{
+    const int M = W->rows;
+    const int K = W->cols;
+    const int N = Z->cols;
+    const int row_blocks = (M + 3) / 4;
+
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int ib = 0; ib < row_blocks; ib++)
+        for (int j = 1; j <= N; j++)
+        {
+            const int i0 = ib * 4 + 1;
+            const double *a = &mgetp(Atranspose, j, 1);
+
+            if (i0 + 3 <= M)
+            {
+                const double *w0 = &mgetp(W, i0, 1);
+                const double *w1 = w0 + K;
+                const double *w2 = w1 + K;
+                const double *w3 = w2 + K;
+                double s0 = mgetp(b, i0, 1);
+                double s1 = mgetp(b, i0 + 1, 1);
+                double s2 = mgetp(b, i0 + 2, 1);
+                double s3 = mgetp(b, i0 + 3, 1);
+                for (int k = 0; k < K; k++)
+                {
+                    const double ak = a[k];
+                    s0 += w0[k] * ak;
+                    s1 += w1[k] * ak;
+                    s2 += w2[k] * ak;
+                    s3 += w3[k] * ak;
+                }
+                mgetp(Z, i0, j) = s0;
+                mgetp(Z, i0 + 1, j) = s1;
+                mgetp(Z, i0 + 2, j) = s2;
+                mgetp(Z, i0 + 3, j) = s3;
+            }
+            else
+            {
+                for (int i = i0; i <= M; i++)
+                {
+                    const double *w = &mgetp(W, i, 1);
+                    double sum = mgetp(b, i, 1);
+                    for (int k = 0; k < K; k++)
+                        sum += w[k] * a[k];
+                    mgetp(Z, i, j) = sum;
+                }
+            }
+        }
+}
+
+// Reduction length known at compile time: each instance unrolls the inner loop by 16 with no
+// remainder loop or trip-count checks
+static inline __attribute__((always_inline)) void gemm_fixed_k(const matrix *W, const matrix *Atranspose,
+                                                               const matrix *b, matrix *Z, const int K)
+{
+    const int M = W->rows;
+    const int N = Z->cols;
+
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int i = 1; i <= M; i++)
+        for (int j = 1; j <= N; j++)
+        {
+            const double *w = &mgetp(W, i, 1);
+            const double *a = &mgetp(Atranspose, j, 1);
+            double sum = mgetp(b, i, 1);
+#pragma GCC unroll 16
+            for (int k = 0; k < K; k++)
+                sum += w[k] * a[k];
+            mgetp(Z, i, j) = sum;
+        }
+}
+
+void matrix_mult_add_col_variant(gemm_variant variant, const matrix *W, const matrix *A, const matrix *b,
+                                 matrix *Z, matrix *Atranspose)
+{
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int rowsW = W->rows;
     const int colsW = W->cols;
     const int rowsA = A->rows;
@@ -143,38 +368,48 @@ matrix matrix_mult_add_col(const matrix *W, const matrix *A, const matrix *b)
     assert(colsW == rowsA);
     assert(rowsW == b->rows);
     assert(b->cols == 1);
-
-    matrix Z = new_matrix(rowsW, colsA);
-    matrix Atranspose = new_matrix(colsA, rowsA);
+    assert(Z->rows == rowsW && Z->cols == colsA);
+    assert(Atranspose->rows == colsA && Atranspose->cols == rowsA);
+    assert(gemm_variant_supports(variant, rowsW, colsW));
 
 // Transpose A for cache-friendly access
 #pragma omp parallel for collapse(2)
     for (int i = 1; i <= rowsA; i++)
         for (int j = 1; j <= colsA; j++)
-            mget(Atranspose, j, i) = mgetp(A, i, j);
+            mgetp(Atranspose, j, i) = mgetp(A, i, j);
 
-// Compute W*A + b in one pass
-#pragma omp parallel for collapse(2)
-    for (int i = 1; i <= rowsW; i++)
+    // Every variant sums each element in the same order, so results don't depend on the variant
+    switch (variant)
     {
-        for (int j = 1; j <= colsA; j++)
-        {
-            double bias = mgetp(b, i, 1);
-            double sum = bias;
-            for (int k = 1; k <= colsW; k++)
-                sum += mgetp(W, i, k) * mget(Atranspose, j, k);
-            mget(Z, i, j) = sum;
-        }
+    case GEMM_SMALL_M:
+        gemm_small_m(W, Atranspose, b, Z);
+        break;
+    case GEMM_LARGE_K:
+        gemm_large_k(W, Atranspose, b, Z);
+        break;
+    case GEMM_FIXED_K:
+        if (colsW == 64)
+            gemm_fixed_k(W, Atranspose, b, Z, 64);
+        else if (colsW == 128)
+            gemm_fixed_k(W, Atranspose, b, Z, 128);
+        else
+            gemm_fixed_k(W, Atranspose, b, Z, 256);
+        break;
+    default:
+        gemm_generic(W, Atranspose, b, Z);
+        break;
     }
 
-    delete_matrix(&Atranspose);
-    return Z;
+    PERF_END(perf_s, "matrix_mult_add_col", 2.0 * rowsW * colsW * colsA + (double)rowsW * colsA, ((double)rowsW * colsW + 2.0 * rowsA * colsA + (double)rowsW * colsA + rowsW) * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_mult_add_col", "kernel");
 }
 
 // Computes: result = (A * B^T) * scalar
 // Used in backward pass: dW = (dZ * A^T) / m
 matrix matrix_mult_transB_scale(const matrix *A, const matrix *B, double scalar)
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int rowsA = A->rows;
     const int colsA = A->cols;
     const int rowsB = B->rows;
@@ -194,6 +429,8 @@ matrix matrix_mult_transB_scale(const matrix *A, const matrix *B, double scalar)
             mget(C, i, j) = sum * scalar;
         }
 
+    PERF_END(perf_s, "matrix_mult_transB_scale", 2.0 * rowsA * rowsB * colsA + (double)rowsA * rowsB, ((double)rowsA * colsA + (double)rowsB * colsB + (double)rowsA * rowsB) * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_mult_transB_scale", "kernel");
     return C;
 }
 
@@ -201,6 +438,8 @@ matrix matrix_mult_transB_scale(const matrix *A, const matrix *B, double scalar)
 // Used in backward pass: dA_prev = W^T * dZ
 matrix matrix_multT_B(const matrix *A, const matrix *B)
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int rowsA = A->rows;
     const int colsA = A->cols;
     const int rowsB = B->rows;
@@ -222,5 +461,7 @@ matrix matrix_multT_B(const matrix *A, const matrix *B)
             mget(C, i, j) = sum;
         }
 
+    PERF_END(perf_s, "matrix_multT_B", 2.0 * colsA * colsB * rowsA, ((double)rowsA * colsA + (double)rowsB * colsB + (double)colsA * colsB) * sizeof(double));
+    TRACE_END(trace_begin_us, "matrix_multT_B", "kernel");
     return C;
 }
\ No newline at end of file
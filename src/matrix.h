@@ -1,6 +1,8 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <stddef.h>
+
 typedef struct matrix matrix;
 struct matrix
 {
@@ -10,21 +12,53 @@ struct matrix
 };
 
 // Shortcut evaluate functions
-#define mget(mat, i, j) mat.val[(i - 1) * mat.cols + (j - 1)]
-#define mgetp(mat, i, j) mat->val[(i - 1) * mat->cols + (j - 1)]
+#define mget(mat, i, j) mat.val[(size_t)((i) - 1) * mat.cols + ((j) - 1)]
+#define mgetp(mat, i, j) mat->val[(size_t)((i) - 1) * mat->cols + ((j) - 1)]
 
 // Function declarations
 matrix new_matrix(const int rows, const int cols);
+// Long-lived matrices (parameters, gradients, datasets, batch buffers): NUMA first touch, see alloc.h
+matrix new_matrix_first_touch(const int rows, const int cols);
 matrix matrix_add(const matrix *A, const matrix *B);
 matrix matrix_sub(const matrix *A, const matrix *B);
+void matrix_sub_into(const matrix *A, const matrix *B, matrix *C);
 matrix matrix_mult(const matrix *A, const matrix *B);
 matrix matrix_transpose(const matrix *A);
 void delete_matrix(matrix *A);
 //
 matrix matrix_sum_rows(const matrix *A);
 matrix matrix_scalar_mult(const matrix *A, double scalar);
+// Allocates Z = W * A + b, picking the variant for the shape on every call (the training plan binds
+// each layer's variant once instead, see matrix_mult_add_col_variant)
 matrix matrix_mult_add_col(const matrix *W, const matrix *A, const matrix *b);
 
+// Shape-specialized variants of Z = W * A + b (W is M x K, A is K x N)
+typedef enum
+{
+    GEMM_GENERIC, // Tiled, autotuned block size and schedule
+    GEMM_SMALL_M, // M <= GEMM_SMALL_M_MAX: parallel over samples
+    GEMM_LARGE_K, // K >= GEMM_LARGE_K_MIN: four W rows per packed sample
+    GEMM_FIXED_K, // K in {64, 128, 256}: compile-time reduction length, unrolled by 16
+    GEMM_VARIANT_COUNT
+} gemm_variant;
+
+#define GEMM_SMALL_M_MAX 16
+#define GEMM_LARGE_K_MIN 1024
+
+const char *gemm_variant_name(gemm_variant variant);
+int gemm_variant_supports(gemm_variant variant, int M, int K);
+
+// Autotuned variant for the shape if there is one, otherwise gemm_shape_variant
+gemm_variant gemm_select_variant(int M, int K, int N);
+
+// Shape rules: small M first, then a fixed K, then a large K, else generic
+gemm_variant gemm_shape_variant(int M, int K);
+
+// Computes Z = W * A + b with the given variant into preallocated Z, using Atranspose
+// (A->cols x A->rows) as scratch
+void matrix_mult_add_col_variant(gemm_variant variant, const matrix *W, const matrix *A, const matrix *b,
+                                 matrix *Z, matrix *Atranspose);
+
 // Computes: result = (A * B^T) * scalar
 matrix matrix_mult_transB_scale(const matrix *A, const matrix *B, double scalar);
 
@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "metrics.h"
+#include "trace.h"
+
+// Start the non-blocking reduction of a snapshot (none may be in flight)
+static void start_iallreduce(metrics_t *m, const double *snapshot, int tag);
+
+void metrics_init(metrics_t *m, MPI_Comm comm)
+{
+    memset(m, 0, sizeof(metrics_t));
+    m->comm = comm;
+    m->request = MPI_REQUEST_NULL;
+}
+
+void metrics_reset(metrics_t *m)
+{
+    memset(m->local, 0, sizeof(m->local));
+}
+
+void metrics_add(metrics_t *m, metric_id id, double value)
+{
+    m->local[id] += value;
+}
+
+void metrics_start_reduce(metrics_t *m, int tag)
+{
+    // Only one reduction in flight (the send buffer must stay untouched until it completes)
+    metrics_wait(m);
+
+    start_iallreduce(m, m->local, tag);
+    metrics_reset(m);
+}
+
+void metrics_queue_reduce(metrics_t *m, int tag)
+{
+    if (!m->pending)
+    {
+        metrics_start_reduce(m, tag);
+        return;
+    }
+
+    memcpy(m->queued, m->local, sizeof(m->queued));
+    metrics_reset(m);
+    m->queued_tag = tag;
+    m->has_queued = 1;
+}
+
+void metrics_start_queued(metrics_t *m)
+{
+    if (m->pending || !m->has_queued)
+        return;
+
+    m->has_queued = 0;
+    start_iallreduce(m, m->queued, m->queued_tag);
+}
+
+int metrics_test(metrics_t *m)
+{
+    if (!m->pending)
+        return 0;
+
+    int done;
+    TRACE_BEGIN(trace_begin_us);
+    MPI_Test(&m->request, &done, MPI_STATUS_IGNORE);
+    TRACE_END(trace_begin_us, "MPI_Test(metrics)", "mpi");
+    if (done)
+        m->pending = 0;
+    return done;
+}
+
+void metrics_wait(metrics_t *m)
+{
+    if (!m->pending)
+        return;
+
+    TRACE_BEGIN(trace_begin_us);
+    MPI_Wait(&m->request, MPI_STATUS_IGNORE);
+    TRACE_END(trace_begin_us, "MPI_Wait(metrics)", "mpi");
+    m->pending = 0;
+}
+
+/**
+ * Start the non-blocking reduction of a snapshot (none may be in flight)
+ */
+static void start_iallreduce(metrics_t *m, const double *snapshot, int tag)
+{
+    memcpy(m->send, snapshot, sizeof(m->send));
+    m->tag = tag;
+
+    TRACE_BEGIN(trace_begin_us);
+    MPI_Iallreduce(m->send, m->global, METRIC_COUNT, MPI_DOUBLE, MPI_SUM, m->comm, &m->request);
+    TRACE_END(trace_begin_us, "MPI_Iallreduce(metrics)", "mpi");
+    m->pending = 1;
+}
+
+double metrics_cost(const metrics_t *m)
+{
+    return m->global[METRIC_COST_SAMPLES] > 0 ? m->global[METRIC_COST_SUM] / m->global[METRIC_COST_SAMPLES] : 0.0;
+}
+
+double metrics_train_accuracy(const metrics_t *m)
+{
+    return m->global[METRIC_TRAIN_TOTAL] > 0 ? m->global[METRIC_TRAIN_CORRECT] / m->global[METRIC_TRAIN_TOTAL] * 100.0 : 0.0;
+}
+
+double metrics_test_accuracy(const metrics_t *m)
+{
+    return m->global[METRIC_TEST_TOTAL] > 0 ? m->global[METRIC_TEST_CORRECT] / m->global[METRIC_TEST_TOTAL] * 100.0 : 0.0;
+}
+
+void metrics_print_progress(const metrics_t *m)
+{
+    printf("Iter %5d: Avg Cost = %.6f | Train Acc = %6.2f%% | Test Acc = %6.2f%%\n",
+           m->tag, metrics_cost(m), metrics_train_accuracy(m), metrics_test_accuracy(m));
+}
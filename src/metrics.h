@@ -0,0 +1,57 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <mpi.h>
+
+// Metrics accumulated locally and reduced together with one non-blocking allreduce
+typedef enum
+{
+    METRIC_COST_SUM,     // Sum of per-sample cost
+    METRIC_COST_SAMPLES, // Samples contributing to the cost
+    METRIC_TRAIN_CORRECT,
+    METRIC_TRAIN_TOTAL,
+    METRIC_TEST_CORRECT,
+    METRIC_TEST_TOTAL,
+    METRIC_COUNT
+} metric_id;
+
+typedef struct
+{
+    double local[METRIC_COUNT];  // Accumulating (safe to update while a reduction is in flight)
+    double send[METRIC_COUNT];   // Snapshot being reduced
+    double queued[METRIC_COUNT]; // Snapshot waiting for the reduction in flight
+    double global[METRIC_COUNT]; // Result of the last completed reduction
+    MPI_Comm comm;
+    MPI_Request request;
+    int pending; // Reduction started and not yet completed
+    int tag;     // Caller-defined label of the reduction in flight (e.g. iteration)
+    int has_queued;
+    int queued_tag;
+} metrics_t;
+
+void metrics_init(metrics_t *m, MPI_Comm comm);
+void metrics_reset(metrics_t *m); // Clears the local accumulators
+void metrics_add(metrics_t *m, metric_id id, double value);
+
+// Snapshot and clear the local accumulators, then start the reduction (waits for one in flight)
+void metrics_start_reduce(metrics_t *m, int tag);
+
+// Snapshot and clear the local accumulators; the reduction starts now, or behind the one in flight
+// (metrics_start_queued, once its result has been read). At most one snapshot is queued. Every rank
+// queues in the same order, so the reductions still match across ranks.
+void metrics_queue_reduce(metrics_t *m, int tag);
+void metrics_start_queued(metrics_t *m);
+
+// Progress the reduction in flight; returns 1 if it has completed
+int metrics_test(metrics_t *m);
+void metrics_wait(metrics_t *m);
+
+// Derived values of the last completed reduction
+double metrics_cost(const metrics_t *m);
+double metrics_train_accuracy(const metrics_t *m);
+double metrics_test_accuracy(const metrics_t *m);
+
+// Print the progress line for the last completed reduction (call on one rank only)
+void metrics_print_progress(const metrics_t *m);
+
+#endif // METRICS_H
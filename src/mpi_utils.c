@@ -2,47 +2,48 @@
 #include <stdlib.h>
 
 #include "mpi_utils.h"
+#include "trace.h"
 
-void allreduce_matrix(matrix *A, int num_processes)
+void allreduce_matrix(matrix *A, double local_weight, double total_weight, MPI_Comm comm)
 {
+    TRACE_BEGIN(trace_begin_us);
     int size = A->rows * A->cols;
 
     // Allocate buffer for receiving sum
     double *recv_buffer = (double *)malloc(size * sizeof(double));
 
-    // Sum across all processes
-    MPI_Allreduce(A->val, recv_buffer, size, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    // Weight the local contribution by its share of the samples
+    for (int i = 0; i < size; i++)
+        A->val[i] *= local_weight;
+
+    // Sum across the communicator
+    MPI_Allreduce(A->val, recv_buffer, size, MPI_DOUBLE, MPI_SUM, comm);
 
-    // Average by dividing by number of processes
-    double inv_np = 1.0 / num_processes;
+    // Weighted average by dividing by the total weight (nothing to average if no rank had samples)
+    double inv_total = total_weight > 0.0 ? 1.0 / total_weight : 0.0;
     for (int i = 0; i < size; i++)
-        A->val[i] = recv_buffer[i] * inv_np;
+        A->val[i] = recv_buffer[i] * inv_total;
 
     free(recv_buffer);
+    TRACE_END(trace_begin_us, "allreduce_matrix", "mpi");
 }
 
-void allreduce_gradients(nn_grads *grads, int L, int num_processes)
+void allreduce_gradients(nn_grads *grads, int L, int local_samples, int total_samples, MPI_Comm comm)
 {
+    TRACE_BEGIN(trace_begin_us);
     for (int l = 0; l < L; l++)
     {
-        allreduce_matrix(&grads->dW[l], num_processes);
-        allreduce_matrix(&grads->db[l], num_processes);
+        allreduce_matrix(&grads->dW[l], local_samples, total_samples, comm);
+        allreduce_matrix(&grads->db[l], local_samples, total_samples, comm);
     }
+    TRACE_END(trace_begin_us, "allreduce_gradients", "mpi");
 }
 
-double allreduce_cost(double local_cost, int num_processes)
+int allreduce_max_int(int local_value, MPI_Comm comm)
 {
-    double global_cost;
-    MPI_Allreduce(&local_cost, &global_cost, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    return global_cost / num_processes;
-}
-
-double allreduce_accuracy(int local_correct, int local_total)
-{
-    int global_correct, global_total;
-
-    MPI_Allreduce(&local_correct, &global_correct, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-    MPI_Allreduce(&local_total, &global_total, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
-
-    return (double)global_correct / global_total * 100.0;
+    TRACE_BEGIN(trace_begin_us);
+    int global_value;
+    MPI_Allreduce(&local_value, &global_value, 1, MPI_INT, MPI_MAX, comm);
+    TRACE_END(trace_begin_us, "allreduce_max_int", "mpi");
+    return global_value;
 }
@@ -5,9 +5,8 @@
 #include "matrix.h"
 #include "nn.h"
 
-void allreduce_matrix(matrix *A, int num_processes); // Averages A across all processes (in-place)
-void allreduce_gradients(nn_grads *grads, int L, int num_processes);
-double allreduce_cost(double local_cost, int num_processes);
-double allreduce_accuracy(int local_correct, int local_total);
+void allreduce_matrix(matrix *A, double local_weight, double total_weight, MPI_Comm comm); // Weighted average of A across comm (in-place)
+void allreduce_gradients(nn_grads *grads, int L, int local_samples, int total_samples, MPI_Comm comm); // Averages weighted by local sample counts (total_samples over comm)
+int allreduce_max_int(int local_value, MPI_Comm comm);
 
 #endif // MPI_UTILS_H
\ No newline at end of file
@@ -5,21 +5,28 @@
 
 #include "matrix.h"
 #include "nn.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "plan.h"
+#include "alloc.h"
 
-matrix relu(const matrix *Z)
+void relu_into(const matrix *Z, matrix *A)
 {
-    matrix A = new_matrix(Z->rows, Z->cols);
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
 
 #pragma omp parallel for collapse(2)
     for (int i = 1; i <= Z->rows; i++)
         for (int j = 1; j <= Z->cols; j++)
-            mget(A, i, j) = fmax(0.0, mgetp(Z, i, j));
-    return A;
+            mgetp(A, i, j) = fmax(0.0, mgetp(Z, i, j));
+    PERF_END(perf_s, "relu", (double)Z->rows * Z->cols, 2.0 * Z->rows * Z->cols * sizeof(double));
+    TRACE_END(trace_begin_us, "relu", "kernel");
 }
 
-matrix softmax(const matrix *Z)
+void softmax_into(const matrix *Z, matrix *A)
 {
-    matrix A = new_matrix(Z->rows, Z->cols);
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
 
 // Process column by column (each column is a sample)
 #pragma omp parallel for
@@ -34,78 +41,254 @@ matrix softmax(const matrix *Z)
         double sum = 0.0;
         for (int i = 1; i <= Z->rows; i++)
         {
-            mget(A, i, j) = exp(mgetp(Z, i, j) - max_val);
-            sum += mget(A, i, j);
+            mgetp(A, i, j) = exp(mgetp(Z, i, j) - max_val);
+            sum += mgetp(A, i, j);
         }
 
         // Normalize
         double inv_sum = 1.0 / sum;
         for (int i = 1; i <= Z->rows; i++)
-            mget(A, i, j) *= inv_sum;
+            mgetp(A, i, j) *= inv_sum;
     }
-    return A;
+    PERF_END(perf_s, "softmax", 4.0 * Z->rows * Z->cols, 2.0 * Z->rows * Z->cols * sizeof(double));
+    TRACE_END(trace_begin_us, "softmax", "kernel");
 }
 
-matrix relu_backward(const matrix *dA, const matrix *Z_cache)
+matrix L_model_forward_plan(exec_plan *plan, double *slab, const matrix *X, const nn_params *params)
 {
-    matrix dZ = new_matrix(dA->rows, dA->cols);
+    const int n = X->cols;
+    const int L = params->L;
 
-#pragma omp parallel for collapse(2)
-    for (int i = 1; i <= dA->rows; i++)
-        for (int j = 1; j <= dA->cols; j++)
-            mget(dZ, i, j) = mgetp(Z_cache, i, j) > 0 ? mgetp(dA, i, j) : 0.0;
-    return dZ;
+    for (int l = 0; l < L; l++)
+    {
+        trace_set_layer(l);
+        matrix A_prev = l == 0 ? *X : plan_view(plan, slab, plan->act[l - 1], n);
+        matrix scratch = plan_view(plan, slab, plan->scratch[l], n);
+        matrix A = plan_view(plan, slab, plan->act[l], n);
+        const int hidden = l < L - 1 || !plan->last_stage;
+        matrix Z = hidden ? A : plan_view(plan, slab, plan->logits, n);
+        if (l == 0 && plan->tp)
+            Z = plan_view(plan, slab, plan->shard, n);
+
+        // Layer kernel bound by the plan; hidden layers apply ReLU in place (mask A > 0 == Z > 0)
+        double start = omp_get_wtime();
+        matrix_mult_add_col_variant((gemm_variant)plan->variant[l], &params->W[l], &A_prev, &params->b[l], &Z, &scratch);
+        plan->layer_ms[l] += (omp_get_wtime() - start) * 1000.0;
+        plan->layer_flops[l] += 2.0 * params->W[l].rows * params->W[l].cols * n;
+        plan->layer_calls[l]++;
+
+        // A split layer 0 computed only this rank's rows
+        if (l == 0 && plan->tp)
+            tp_allgather_rows(plan->tp, &Z, &A);
+
+        if (hidden)
+            relu_into(&A, &A);
+        else
+            softmax_into(&Z, &A);
+    }
+    trace_set_layer(-1);
+
+    return plan_view(plan, slab, plan->act[L - 1], n);
 }
 
-linear_cache linear_forward(const matrix *A, const matrix *W, const matrix *b)
+// Dense layer on a chunk of n samples: out = W * in + b (optionally followed by ReLU)
+// in is (W->cols x n) and out is (W->rows x n), both row-major with row stride n
+void dense_forward_chunk(const matrix *W, const matrix *b, const double *in, int n, double *out, int apply_relu)
 {
-    linear_cache cache;
-    cache.A = *A;
-    cache.W = *W;
-    cache.b = *b;
+    // Four output rows at a time share every load of an input row (same summation order per element)
+    int i = 0;
+    for (; i + 4 <= W->rows; i += 4)
+    {
+        double *out0 = &out[i * n], *out1 = out0 + n, *out2 = out1 + n, *out3 = out2 + n;
+        const double *W0 = &W->val[i * W->cols], *W1 = W0 + W->cols, *W2 = W1 + W->cols, *W3 = W2 + W->cols;
+
+        for (int j = 0; j < n; j++)
+        {
+            out0[j] = b->val[i];
+            out1[j] = b->val[i + 1];
+            out2[j] = b->val[i + 2];
+            out3[j] = b->val[i + 3];
+        }
 
-    cache.Z = matrix_mult_add_col(W, A, b);
+        for (int k = 0; k < W->cols; k++)
+        {
+            const double w0 = W0[k], w1 = W1[k], w2 = W2[k], w3 = W3[k];
+            const double *in_row = &in[k * n];
+            for (int j = 0; j < n; j++)
+            {
+                const double a = in_row[j];
+                out0[j] += w0 * a;
+                out1[j] += w1 * a;
+                out2[j] += w2 * a;
+                out3[j] += w3 * a;
+            }
+        }
+    }
+
+    for (; i < W->rows; i++)
+    {
+        double *out_row = &out[i * n];
+        const double *W_row = &W->val[i * W->cols];
+        const double bias = b->val[i];
+
+        for (int j = 0; j < n; j++)
+            out_row[j] = bias;
+
+        // Row i of the output accumulates rows of the input (contiguous in j)
+        for (int k = 0; k < W->cols; k++)
+        {
+            const double w = W_row[k];
+            const double *in_row = &in[k * n];
+            for (int j = 0; j < n; j++)
+                out_row[j] += w * in_row[j];
+        }
+    }
 
-    return cache;
+    if (apply_relu)
+        for (int e = 0; e < W->rows * n; e++)
+            out[e] = fmax(0.0, out[e]);
 }
 
-layer_cache linear_activation_forward(const matrix *A_prev, const matrix *W, const matrix *b, activation_t activation)
+void dense_forward_vector(const matrix *W, const matrix *b, const double *in, double *out, int apply_relu)
 {
-    layer_cache cache;
-    cache.linear = linear_forward(A_prev, W, b);
-
-    switch (activation)
+    // Contiguous dot products (the chunk kernel's row updates degenerate at n = 1), four rows per
+    // pass over the input
+    int i = 0;
+    for (; i + 4 <= W->rows; i += 4)
     {
-    case ACTIVATION_RELU:
-        cache.A = relu(&cache.linear.Z);
-        break;
-    case ACTIVATION_SOFTMAX:
-        cache.A = softmax(&cache.linear.Z);
-        break;
+        const double *W0 = &W->val[i * W->cols], *W1 = W0 + W->cols, *W2 = W1 + W->cols, *W3 = W2 + W->cols;
+        double sum0 = 0.0, sum1 = 0.0, sum2 = 0.0, sum3 = 0.0;
+#pragma omp simd reduction(+ : sum0, sum1, sum2, sum3)
+        for (int k = 0; k < W->cols; k++)
+        {
+            sum0 += W0[k] * in[k];
+            sum1 += W1[k] * in[k];
+            sum2 += W2[k] * in[k];
+            sum3 += W3[k] * in[k];
+        }
+        out[i] = sum0 + b->val[i];
+        out[i + 1] = sum1 + b->val[i + 1];
+        out[i + 2] = sum2 + b->val[i + 2];
+        out[i + 3] = sum3 + b->val[i + 3];
     }
+    for (; i < W->rows; i++)
+    {
+        const double *W_row = &W->val[i * W->cols];
+        double sum = 0.0;
+#pragma omp simd reduction(+ : sum)
+        for (int k = 0; k < W->cols; k++)
+            sum += W_row[k] * in[k];
+        out[i] = sum + b->val[i];
+    }
+
+    if (apply_relu)
+        for (int r = 0; r < W->rows; r++)
+            out[r] = fmax(0.0, out[r]);
+}
 
-    return cache;
+void predict_workspace_init(predict_workspace *ws, const nn_params *params, int chunk_size, int num_threads)
+{
+    const int L = params->L;
+    int *layer_dims = (int *)malloc(sizeof(int) * (L + 1));
+    layer_dims[0] = params->W[0].cols;
+    for (int l = 0; l < L; l++)
+        layer_dims[l + 1] = params->W[l].rows;
+
+    // Inference plan for one chunk: activations die as soon as the next layer has consumed them
+    ws->plan = plan_build(PLAN_INFERENCE, layer_dims, L, chunk_size, NULL);
+    free(layer_dims);
+
+    ws->num_slabs = num_threads > 0 ? num_threads : omp_get_max_threads();
+    ws->slabs = (double **)malloc(sizeof(double *) * ws->num_slabs);
+
+    // Every thread allocates (and so first-touches) the slab it runs its chunks in
+#pragma omp parallel num_threads(ws->num_slabs)
+    ws->slabs[omp_get_thread_num()] = plan_alloc_slab(&ws->plan);
 }
 
-forward_pass L_model_forward(const matrix *X, const nn_params *params)
+void predict_workspace_free(predict_workspace *ws)
 {
-    forward_pass fwd;
-    fwd.caches = (layer_cache *)malloc(sizeof(layer_cache) * params->L);
-    const matrix *A_ptr = X;
+    for (int t = 0; t < ws->num_slabs; t++)
+        alloc_free(ws->slabs[t]);
+    free(ws->slabs);
+    plan_destroy(&ws->plan);
+}
 
-    for (int l = 0; l < params->L - 1; l++)
+void L_model_predict(const matrix *X, const nn_params *params, predict_workspace *ws, int *predictions)
+{
+    const exec_plan *plan = &ws->plan;
+    const int m = X->cols;
+    const int L = params->L;
+    const int chunk_size = plan->batch;
+    const int num_chunks = (m + chunk_size - 1) / chunk_size;
+
+    double flops = 0.0;
+    double bytes = (double)X->rows * m * sizeof(double);
+    for (int l = 0; l < L; l++)
     {
-        fwd.caches[l] = linear_activation_forward(A_ptr, &params->W[l], &params->b[l], ACTIVATION_RELU);
-        A_ptr = &fwd.caches[l].A;
+        flops += 2.0 * params->W[l].rows * params->W[l].cols * m;
+        bytes += (double)params->W[l].rows * params->W[l].cols * sizeof(double);
     }
-    fwd.caches[params->L - 1] = linear_activation_forward(A_ptr, &params->W[params->L - 1], &params->b[params->L - 1], ACTIVATION_SOFTMAX);
-    fwd.AL = fwd.caches[params->L - 1].A;
+    PERF_BEGIN(perf_s);
+
+    // One slab per thread, reused for every chunk
+    const int team = omp_get_max_threads() < ws->num_slabs ? omp_get_max_threads() : ws->num_slabs;
+#pragma omp parallel num_threads(team)
+    {
+        double *slab = ws->slabs[omp_get_thread_num()];
 
-    return fwd;
+#pragma omp for schedule(dynamic)
+        for (int chunk = 0; chunk < num_chunks; chunk++)
+        {
+            TRACE_BEGIN(trace_begin_us);
+            const int start = chunk * chunk_size;
+            const int n = (start + chunk_size <= m) ? chunk_size : m - start;
+
+            // Gather the chunk's columns of X into a contiguous (features x n) block
+            double *input = plan_view(plan, slab, plan->input, n).val;
+            for (int k = 0; k < X->rows; k++)
+            {
+                const double *X_row = &X->val[(size_t)k * m + start];
+                double *in_row = &input[k * n];
+                for (int j = 0; j < n; j++)
+                    in_row[j] = X_row[j];
+            }
+
+            // Hidden layers with ReLU, output layer left as logits
+            const double *in = input;
+            for (int l = 0; l < L; l++)
+            {
+                double *out = plan_view(plan, slab, plan->act[l], n).val;
+                dense_forward_chunk(&params->W[l], &params->b[l], in, n, out, l < L - 1);
+                in = out;
+            }
+
+            // Softmax is monotonic, so argmax over the logits gives the predicted class
+            const int num_classes = params->W[L - 1].rows;
+            for (int j = 0; j < n; j++)
+            {
+                int pred_class = 0;
+                double max_val = in[j];
+                for (int i = 1; i < num_classes; i++)
+                {
+                    if (in[i * n + j] > max_val)
+                    {
+                        max_val = in[i * n + j];
+                        pred_class = i;
+                    }
+                }
+                predictions[start + j] = pred_class;
+            }
+            TRACE_END(trace_begin_us, "predict_chunk", "inference");
+        }
+    }
+    PERF_END(perf_s, "L_model_predict", flops, bytes);
 }
 
 double compute_cost(const matrix *AL, const matrix *Y)
 {
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
     const int m = Y->cols;
     double cost = 0.0;
 
@@ -116,99 +299,194 @@ double compute_cost(const matrix *AL, const matrix *Y)
             if (mgetp(Y, i, j) > 0)
                 cost -= mgetp(Y, i, j) * log(mgetp(AL, i, j) + 1e-8);
 
+    PERF_END(perf_s, "compute_cost", 2.0 * Y->rows * m, 2.0 * Y->rows * m * sizeof(double));
+    TRACE_END(trace_begin_us, "compute_cost", "kernel");
     return cost / m;
 }
 
-linear_grads linear_backward(const matrix *dZ, const linear_cache *cache)
-{
-    linear_grads grads;
-    const int m = cache->A.cols;
-    const double inv_m = 1.0 / m;
+// Smallest amount of work (multiply-adds) worth a separate task in the backward task graph
+#define TASK_MIN_WORK 16384
 
-    // Fused operation for dW = (dZ * A^T) / m
-    grads.dW = matrix_mult_transB_scale(dZ, &cache->A, inv_m);
-
-    // Compute db = sum(dZ, axis=1) / m
-    matrix db_sum = matrix_sum_rows(dZ);
-    grads.db = matrix_scalar_mult(&db_sum, inv_m);
-    delete_matrix(&db_sum);
-
-    // Fused operation for dA_prev = W^T * dZ
-    grads.dA_prev = matrix_multT_B(&cache->W, dZ);
-
-    return grads;
+int backward_grainsize(long work_per_row)
+{
+    long rows = TASK_MIN_WORK / (work_per_row > 0 ? work_per_row : 1);
+    return rows > 1 ? (int)rows : 1;
 }
 
-linear_grads linear_activation_backward(const matrix *dA, const layer_cache *cache, activation_t activation)
+void backward_weight_grad(const matrix *dZ, const matrix *A_prev, double inv_m, double scale, int accumulate,
+                          int grainsize, matrix *dW)
 {
-    matrix dZ;
-    int owns_dZ = 0;
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
+    const int rows = dW->rows;
+    const int cols = dW->cols;
+    const int m = dZ->cols;
+    if (grainsize <= 0)
+        grainsize = backward_grainsize((long)cols * m);
+
+#pragma omp taskloop grainsize(grainsize)
+    for (int i = 1; i <= rows; i++)
+        for (int j = 1; j <= cols; j++)
+        {
+            double sum = 0.0;
+            for (int k = 1; k <= m; k++)
+                sum += mgetp(dZ, i, k) * mgetp(A_prev, j, k);
+            if (accumulate)
+                mgetp(dW, i, j) += scale * (sum * inv_m);
+            else
+                mgetp(dW, i, j) = sum * inv_m;
+        }
+    PERF_END(perf_s, "backward_weight_grad", 2.0 * rows * cols * m,
+             ((double)rows * m + (double)cols * m + (accumulate ? 2.0 : 1.0) * rows * cols) * sizeof(double));
+    TRACE_END(trace_begin_us, "backward_dW", "kernel");
+}
 
-    switch (activation)
+void backward_bias_grad(const matrix *dZ, double inv_m, double scale, int accumulate, matrix *db)
+{
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
+#pragma omp taskloop grainsize(backward_grainsize(dZ->cols))
+    for (int i = 1; i <= dZ->rows; i++)
     {
-    case ACTIVATION_RELU:
-        dZ = relu_backward(dA, &cache->linear.Z);
-        owns_dZ = 1;
-        break;
-    case ACTIVATION_SOFTMAX:
-        // For softmax with cross-entropy, dZ = AL - Y (passed directly as dA)
-        dZ = *dA;
-        owns_dZ = 0;
-        break;
+        double sum = 0.0;
+        for (int j = 1; j <= dZ->cols; j++)
+            sum += mgetp(dZ, i, j);
+        if (accumulate)
+            mgetp(db, i, 1) += scale * (sum * inv_m);
+        else
+            mgetp(db, i, 1) = sum * inv_m;
     }
-
-    linear_grads grads = linear_backward(&dZ, &cache->linear);
-
-    if (owns_dZ)
-        delete_matrix(&dZ);
-
-    return grads;
+    PERF_END(perf_s, "backward_bias_grad", (double)dZ->rows * dZ->cols,
+             ((double)dZ->rows * dZ->cols + (accumulate ? 2.0 : 1.0) * dZ->rows) * sizeof(double));
+    TRACE_END(trace_begin_us, "backward_db", "kernel");
 }
 
-nn_grads L_model_backward(const matrix *AL, const matrix *Y,
-                          const forward_pass *fwd, int L)
+void backward_input_grad(const matrix *W, const matrix *dZ, const matrix *mask, int first_row, int grainsize,
+                         matrix *dZ_prev)
 {
-    nn_grads grads;
-    grads.dW = (matrix *)malloc(sizeof(matrix) * L);
-    grads.db = (matrix *)malloc(sizeof(matrix) * L);
-
-    // dAL = AL - Y (for softmax + cross-entropy)
-    matrix dAL = matrix_sub(AL, Y);
-
-    // Output layer backward (softmax)
-    linear_grads current = linear_activation_backward(&dAL,
-                                                      &fwd->caches[L - 1],
-                                                      ACTIVATION_SOFTMAX);
-    grads.dW[L - 1] = current.dW;
-    grads.db[L - 1] = current.db;
+    TRACE_BEGIN(trace_begin_us);
+    PERF_BEGIN(perf_s);
+    const int rows = dZ_prev->rows;
+    const int cols = dZ_prev->cols;
+    const int n = W->rows;
+    if (grainsize <= 0)
+        grainsize = backward_grainsize((long)cols * n);
+
+#pragma omp taskloop grainsize(grainsize)
+    for (int i = 1; i <= rows; i++)
+        for (int j = 1; j <= cols; j++)
+        {
+            double sum = 0.0;
+            for (int k = 1; k <= n; k++)
+                sum += mgetp(W, k, first_row + i) * mgetp(dZ, k, j);
+            mgetp(dZ_prev, i, j) = mgetp(mask, i, j) > 0 ? sum : 0.0;
+        }
+    PERF_END(perf_s, "backward_input_grad", 2.0 * rows * cols * n,
+             ((double)n * rows + (double)n * cols + 2.0 * rows * cols) * sizeof(double));
+    TRACE_END(trace_begin_us, "backward_dA_prev", "kernel");
+}
 
-    matrix dA = current.dA_prev;
-    delete_matrix(&dAL);
+// Backward task graph from dZ[L-1]: dZ of the layer below (the critical path) starts as soon as
+// dZ[l] is ready, while dW[l] and db[l] overlap with it and with the layers further down.
+// A_prev[l] is the input of layer l and mask[l] marks the active ReLU units of its output.
+// The input's gradient is only computed into dZ_input when that is set (a pipeline stage fed by a
+// ReLU layer: the mask is the input itself). dZ[0] and mask[0] may hold only rows first_row + 1 ..
+// of layer 0 (tensor parallelism). grain_dW and grain_dA hold the rows per task of every layer's
+// kernels (NULL = sized by the work per row). The gradients are added to dW and db, times scale.
+// With hardware counters on, the tasks run one after another on the instrumented thread (each still
+// split into row-block tasks), so that every counter reading covers a single kernel. Each task tags
+// its trace events with its layer and restores the tag of the task it may have interrupted.
+static void backward_task_graph(int L, const matrix *W, matrix *dZ, const matrix *A_prev, const matrix *mask,
+                                int first_row, double scale, const int *grain_dW, const int *grain_dA,
+                                matrix *dW, matrix *db, matrix *dZ_input)
+{
+    const double inv_m = 1.0 / dZ[L - 1].cols;
+    const int overlap = !g_perf_enabled;
 
-    // Hidden layers backward (relu)
-    for (int l = L - 2; l >= 0; l--)
+#pragma omp parallel
+#pragma omp master
     {
-        current = linear_activation_backward(&dA, &fwd->caches[l], ACTIVATION_RELU);
-        grads.dW[l] = current.dW;
-        grads.db[l] = current.db;
-        delete_matrix(&dA);
-        dA = current.dA_prev;
+        for (int l = L - 1; l >= 0; l--)
+        {
+            const int grain_w = grain_dW ? grain_dW[l] : 0;
+            const int grain_a = grain_dA ? grain_dA[l] : 0;
+            if (l > 0)
+            {
+#pragma omp task depend(in : dZ[l]) depend(out : dZ[l - 1]) firstprivate(l) if (overlap)
+                {
+                    const int outer = trace_set_layer(l);
+                    backward_input_grad(&W[l], &dZ[l], &mask[l - 1], l == 1 ? first_row : 0, grain_a, &dZ[l - 1]);
+                    trace_set_layer(outer);
+                }
+            }
+            else if (dZ_input)
+            {
+#pragma omp task depend(in : dZ[0]) if (overlap)
+                {
+                    const int outer = trace_set_layer(0);
+                    backward_input_grad(&W[0], &dZ[0], &A_prev[0], 0, grain_a, dZ_input);
+                    trace_set_layer(outer);
+                }
+            }
+
+#pragma omp task depend(in : dZ[l]) firstprivate(l) if (overlap)
+            {
+                const int outer = trace_set_layer(l);
+                backward_weight_grad(&dZ[l], &A_prev[l], inv_m, scale, 1, grain_w, &dW[l]);
+                trace_set_layer(outer);
+            }
+
+#pragma omp task depend(in : dZ[l]) firstprivate(l) if (overlap)
+            {
+                const int outer = trace_set_layer(l);
+                backward_bias_grad(&dZ[l], inv_m, scale, 1, &db[l]);
+                trace_set_layer(outer);
+            }
+        }
     }
-    delete_matrix(&dA);
-
-    return grads;
 }
 
-void cleanup_forward_pass(forward_pass *fwd, int L)
+void L_model_backward_plan(const exec_plan *plan, double *slab, const matrix *X, const matrix *Y,
+                           const nn_params *params, nn_grads *acc, double scale)
 {
-    if (!fwd || !fwd->caches)
-        return;
+    const int n = X->cols;
+    const int L = params->L;
 
+    // Views of the plan's activations and gradients (the input of layer 0 is X)
+    matrix *dZ = (matrix *)malloc(sizeof(matrix) * L);
+    matrix *A_prev = (matrix *)malloc(sizeof(matrix) * L);
+    matrix *mask = (matrix *)malloc(sizeof(matrix) * L);
     for (int l = 0; l < L; l++)
     {
-        delete_matrix(&fwd->caches[l].linear.Z);
-        delete_matrix(&fwd->caches[l].A);
+        dZ[l] = plan_view(plan, slab, plan->grad[l], n);
+        mask[l] = plan_view(plan, slab, plan->act[l], n);
+        A_prev[l] = l == 0 ? *X : mask[l - 1];
+    }
+
+    // A split layer 0 keeps only this rank's rows of dZ, masked by the same rows of its output
+    int first_row = 0;
+    if (plan->tp)
+    {
+        first_row = plan->tp->row_offset;
+        mask[0].rows = plan->tp->row_count;
+        mask[0].val += (size_t)first_row * n;
+    }
+
+    // The last stage starts from AL - Y; any other pipeline stage has received its output's dZ
+    if (plan->last_stage)
+    {
+        matrix AL = plan_view(plan, slab, plan->act[L - 1], n);
+        matrix_sub_into(&AL, Y, &dZ[L - 1]);
     }
-    free(fwd->caches);
-    fwd->caches = NULL;
-}
\ No newline at end of file
+
+    matrix dZ_input;
+    if (plan->input_grad >= 0)
+        dZ_input = plan_view(plan, slab, plan->input_grad, n);
+
+    backward_task_graph(L, params->W, dZ, A_prev, mask, first_row, scale, plan->grain_dW, plan->grain_dA, acc->dW,
+                        acc->db, plan->input_grad >= 0 ? &dZ_input : NULL);
+
+    free(dZ);
+    free(A_prev);
+    free(mask);
+}
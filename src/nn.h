@@ -2,12 +2,7 @@
 #define NN_H
 
 #include "matrix.h"
-
-typedef enum
-{
-    ACTIVATION_RELU,
-    ACTIVATION_SOFTMAX
-} activation_t;
+#include "plan.h"
 
 typedef struct
 {
@@ -18,56 +13,65 @@ typedef struct
 
 typedef struct
 {
-    matrix A;
-    matrix W;
-    matrix b;
-    matrix Z; // Pre-activation (owned, needs cleanup)
-} linear_cache;
+    matrix *dW;
+    matrix *db;
+} nn_grads;
 
-typedef struct
-{
-    linear_cache linear;
-    matrix A; // Post-activation (owned, needs cleanup)
-} layer_cache;
+// Activation functions
+void relu_into(const matrix *Z, matrix *A); // A may alias Z
+void softmax_into(const matrix *Z, matrix *A);
 
-typedef struct
-{
-    layer_cache *caches;
-    matrix AL; // Final output (alias to last cache.A)
-} forward_pass;
+// Training forward pass inside a plan's slab (plan built with PLAN_TRAINING for at least X->cols
+// samples), with every layer's bound kernel variant; adds the layer timings to the plan and returns
+// a view of AL, valid until the slab is reused
+matrix L_model_forward_plan(exec_plan *plan, double *slab, const matrix *X, const nn_params *params);
 
-typedef struct
-{
-    matrix dA_prev;
-    matrix dW;
-    matrix db;
-} linear_grads;
+// Inference kernels for one layer: out = W * in + b (ReLU if apply_relu), with in (W->cols x n) and
+// out (W->rows x n) contiguous row-major blocks; the vector kernel is the n = 1 case. Each runs on
+// the calling thread (inference parallelizes over chunks), so the GEMM variants, whose loops are
+// parallel, only bind the training forward pass
+void dense_forward_chunk(const matrix *W, const matrix *b, const double *in, int n, double *out, int apply_relu);
+void dense_forward_vector(const matrix *W, const matrix *b, const double *in, double *out, int apply_relu);
 
+// Inference plan and one slab per thread for L_model_predict, built once per model shape and
+// reused by every call
 typedef struct
 {
-    matrix *dW;
-    matrix *db;
-} nn_grads;
+    exec_plan plan;
+    int num_slabs;
+    double **slabs;
+} predict_workspace;
 
-// Activation functions
-matrix relu(const matrix *Z);
-matrix softmax(const matrix *Z);
-matrix relu_backward(const matrix *dA, const matrix *Z_cache);
+// Workspace for the layers of params (W[0]->cols input features) in chunks of chunk_size samples,
+// for teams of up to num_threads threads (<= 0 = omp_get_max_threads())
+void predict_workspace_init(predict_workspace *ws, const nn_params *params, int chunk_size, int num_threads);
+void predict_workspace_free(predict_workspace *ws);
 
-// Forward pass functions
-linear_cache linear_forward(const matrix *A, const matrix *W, const matrix *b);
-layer_cache linear_activation_forward(const matrix *A_prev, const matrix *W, const matrix *b, activation_t activation);
-forward_pass L_model_forward(const matrix *X, const nn_params *params);
+// Inference-only forward pass: streams X through the network in chunks of the workspace's plan
+// (one slab per thread, no caches kept), and writes the argmax class of each sample into predictions
+void L_model_predict(const matrix *X, const nn_params *params, predict_workspace *ws, int *predictions);
 
 // Cost function
 double compute_cost(const matrix *AL, const matrix *Y);
 
-// Backward pass functions
-linear_grads linear_backward(const matrix *dZ, const linear_cache *cache);
-linear_grads linear_activation_backward(const matrix *dA, const layer_cache *cache, activation_t activation);
-nn_grads L_model_backward(const matrix *AL, const matrix *Y, const forward_pass *fwd, int L);
+// Backward kernels of one layer (tasks of the backward task graph), each split into row-block tasks
+// of grainsize rows (<= 0 = backward_grainsize of the work per row); call them from one thread of a
+// parallel region, they return once their tasks are done
+// dW = (dZ * A_prev^T) / m, or dW += scale * (dZ * A_prev^T) / m when accumulating
+void backward_weight_grad(const matrix *dZ, const matrix *A_prev, double inv_m, double scale, int accumulate,
+                          int grainsize, matrix *dW);
+// dZ_prev = (W^T * dZ) masked by the ReLU of the layer below (mask > 0); only rows first_row + 1 ..
+// first_row + dZ_prev->rows of W^T * dZ are computed (the rows a split layer below holds)
+void backward_input_grad(const matrix *W, const matrix *dZ, const matrix *mask, int first_row, int grainsize,
+                         matrix *dZ_prev);
+// db = sum(dZ, axis=1) / m, or db += scale * sum(dZ, axis=1) / m when accumulating
+void backward_bias_grad(const matrix *dZ, double inv_m, double scale, int accumulate, matrix *db);
+int backward_grainsize(long work_per_row);
 
-// Cleanup forward pass caches
-void cleanup_forward_pass(forward_pass *fwd, int L);
+// Backward pass after L_model_forward_plan on the same slab and X; adds scale * gradients to acc
+// (on a pipeline stage other than the last, the output's dZ must be in the slab first; the
+// previous stage's dZ is left in the plan's input_grad buffer)
+void L_model_backward_plan(const exec_plan *plan, double *slab, const matrix *X, const matrix *Y,
+                           const nn_params *params, nn_grads *acc, double scale);
 
 #endif // NN_H
\ No newline at end of file
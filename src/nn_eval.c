@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "nn_eval.h"
+#include "nn_params.h"
+#include "config.h"
+#include "timing.h"
+#include "trace.h"
+#include "affinity.h"
+
+// Helper functions
+static void *async_eval_thread(void *arg);
+static void predict_split(const matrix *X, const nn_params *params, const tp_group *tp, predict_workspace *ws,
+                          int *predictions);
+static void quantize_for_eval(eval_workspace *ws, const nn_params *params, const matrix *X_train);
+
+void eval_workspace_init(eval_workspace *ws, const nn_params *params, const tp_group *tp, int num_threads,
+                         int int8_samples, MPI_Comm comm)
+{
+    // A split layer 0 runs outside the workspace: it holds the layers after it
+    const int split = tp && tp->size > 1;
+    nn_params layers = {params->L - split, params->W + split, params->b + split};
+    predict_workspace_init(&ws->predict, &layers, INFERENCE_CHUNK_SIZE, num_threads);
+
+    // The quantized model needs every layer
+    ws->int8_samples = split ? 0 : int8_samples;
+    ws->comm = comm;
+    ws->quant_ws = NULL;
+}
+
+void eval_workspace_free(eval_workspace *ws)
+{
+    predict_workspace_free(&ws->predict);
+    if (ws->quant_ws)
+    {
+        for (int t = 0; t < ws->predict.num_slabs; t++)
+            quant_workspace_free(&ws->quant_ws[t]);
+        free(ws->quant_ws);
+        delete_quant_model(&ws->quant);
+        ws->quant_ws = NULL;
+    }
+}
+
+int count_correct(const matrix *X, const matrix *Y, const nn_params *params, const tp_group *tp,
+                  eval_workspace *ws)
+{
+    int m = X->cols;
+    int correct_count = 0;
+
+    // Inference-only forward pass (chunked, no caches, fused argmax)
+    int *predictions = (int *)malloc(sizeof(int) * m);
+    if (ws->int8_samples > 0 && ws->quant_ws)
+        quant_predict(&ws->quant, X, ws->quant_ws, ws->predict.num_slabs, predictions);
+    else if (tp && tp->size > 1)
+        predict_split(X, params, tp, &ws->predict, predictions);
+    else
+        L_model_predict(X, params, &ws->predict, predictions);
+
+    // For each example, compare against the true class (argmax of Y)
+#pragma omp parallel for reduction(+ : correct_count)
+    for (int j = 1; j <= m; j++)
+    {
+        int true_class = 0;
+        for (int i = 1; i <= Y->rows; i++)
+        {
+            if (mgetp(Y, i, j) > 0.5)
+            {
+                true_class = i - 1;
+                break;
+            }
+        }
+
+        // Check if correct
+        if (predictions[j - 1] == true_class)
+            correct_count++;
+    }
+
+    // Cleanup
+    free(predictions);
+
+    return correct_count;
+}
+
+void evaluate_local(metrics_t *metrics, const nn_params *params, const tp_group *tp, eval_workspace *ws,
+                    const matrix *X_train, const matrix *Y_train,
+                    const matrix *X_test, const matrix *Y_test)
+{
+    if (ws->int8_samples > 0)
+        quantize_for_eval(ws, params, X_train);
+
+    metrics_add(metrics, METRIC_TRAIN_CORRECT, count_correct(X_train, Y_train, params, tp, ws));
+    metrics_add(metrics, METRIC_TRAIN_TOTAL, X_train->cols);
+    metrics_add(metrics, METRIC_TEST_CORRECT, count_correct(X_test, Y_test, params, tp, ws));
+    metrics_add(metrics, METRIC_TEST_TOTAL, X_test->cols);
+}
+
+/**
+ * Requantize params for this evaluation (calibrated on the first columns of the training shard);
+ * the per-thread workspaces depend only on the layer shapes, so they are created once
+ */
+static void quantize_for_eval(eval_workspace *ws, const nn_params *params, const matrix *X_train)
+{
+    TRACE_BEGIN(trace_begin_us);
+    if (ws->quant_ws)
+        delete_quant_model(&ws->quant);
+
+    const int n = ws->int8_samples < X_train->cols ? ws->int8_samples : X_train->cols;
+    matrix X_calib = new_matrix(X_train->rows, n);
+    for (int k = 0; k < X_train->rows; k++)
+        memcpy(&X_calib.val[(size_t)k * n], &X_train->val[(size_t)k * X_train->cols], sizeof(double) * n);
+    quantize_model(&ws->quant, params, &X_calib, ws->comm);
+    delete_matrix(&X_calib);
+
+    if (!ws->quant_ws)
+    {
+        // Each allocated (and first-touched) by the thread that runs in it
+        const int num_workspaces = ws->predict.num_slabs;
+        ws->quant_ws = (quant_workspace *)malloc(sizeof(quant_workspace) * num_workspaces);
+#pragma omp parallel num_threads(num_workspaces)
+        ws->quant_ws[omp_get_thread_num()] = quant_workspace_create(&ws->quant, INFERENCE_CHUNK_SIZE);
+    }
+    TRACE_END(trace_begin_us, "quantize_for_eval", "inference");
+}
+
+/**
+ * Predictions with layer 0 split across the group: every chunk's slice of layer 0 is allgathered,
+ * then the replicated layers run as usual. The ranks of a group hold the same samples, so they
+ * all take part in the same number of allgathers.
+ */
+static void predict_split(const matrix *X, const nn_params *params, const tp_group *tp, predict_workspace *ws,
+                          int *predictions)
+{
+    const int m = X->cols;
+    const int chunk_size = TP_EVAL_CHUNK_SIZE;
+    matrix X_chunk = new_matrix(X->rows, chunk_size);
+    matrix X_transpose = new_matrix(chunk_size, X->rows);
+    matrix slice = new_matrix(tp->row_count, chunk_size);
+    matrix A = new_matrix(tp->rows, chunk_size);
+
+    // The layers after the split one
+    nn_params rest = {params->L - 1, params->W + 1, params->b + 1};
+
+    // The split layer's kernel, bound once for its shape at the chunk width
+    const gemm_variant variant = gemm_select_variant(tp->row_count, X->rows, chunk_size);
+
+    for (int start = 0; start < m; start += chunk_size)
+    {
+        const int n = (start + chunk_size <= m) ? chunk_size : m - start;
+        matrix X_view = X_chunk, Xt_view = X_transpose, slice_view = slice, A_view = A;
+        X_view.cols = slice_view.cols = A_view.cols = n;
+        Xt_view.rows = n;
+
+#pragma omp parallel for
+        for (int k = 0; k < X->rows; k++)
+            for (int j = 0; j < n; j++)
+                X_view.val[k * n + j] = X->val[(size_t)k * m + start + j];
+
+        matrix_mult_add_col_variant(variant, &params->W[0], &X_view, &params->b[0], &slice_view, &Xt_view);
+        tp_allgather_rows(tp, &slice_view, &A_view);
+        relu_into(&A_view, &A_view);
+        L_model_predict(&A_view, &rest, ws, predictions + start);
+    }
+
+    delete_matrix(&X_chunk);
+    delete_matrix(&X_transpose);
+    delete_matrix(&slice);
+    delete_matrix(&A);
+}
+
+void async_eval_init(async_eval *ev, const nn_params *params, const tp_group *tp,
+                     const matrix *X_train, const matrix *Y_train,
+                     const matrix *X_test, const matrix *Y_test,
+                     int num_threads, int int8_samples, int rank)
+{
+    ev->snapshot = clone_nn_params(params);
+    ev->X_train = X_train;
+    ev->Y_train = Y_train;
+    ev->X_test = X_test;
+    ev->Y_test = Y_test;
+    ev->num_threads = num_threads;
+    ev->rank = rank;
+    ev->in_flight = 0;
+    atomic_init(&ev->done, 0);
+
+    // Separate communicators so evaluation collectives never match training collectives
+    MPI_Comm comm;
+    MPI_Comm_dup(tp->dp_comm, &comm);
+    metrics_init(&ev->metrics, comm);
+    ev->tp = tp_group_dup(tp);
+    eval_workspace_init(&ev->workspace, params, tp, num_threads, int8_samples, comm);
+}
+
+static void *async_eval_thread(void *arg)
+{
+    async_eval *ev = (async_eval *)arg;
+    timer_t_custom timer;
+
+    // A new thread inherits the pinned training thread's single CPU; move to the cores reserved for evaluation
+    affinity_use_helper_cpus();
+
+    // OpenMP settings are per thread, so this only sizes the evaluation team
+    omp_set_num_threads(ev->num_threads);
+
+    TIMER_START(timer);
+    TRACE_BEGIN(trace_begin_us);
+    evaluate_local(&ev->metrics, &ev->snapshot, &ev->tp, &ev->workspace, ev->X_train, ev->Y_train, ev->X_test, ev->Y_test);
+    TRACE_END(trace_begin_us, "evaluate_snapshot", "phase");
+    TIMER_STOP(timer);
+    ACCUM_ADD(g_accuracy_time, timer);
+
+    // One reduction for cost and accuracies; only this thread waits on it
+    TIMER_START(timer);
+    metrics_start_reduce(&ev->metrics, ev->metrics.tag);
+    metrics_wait(&ev->metrics);
+    TIMER_STOP(timer);
+    ACCUM_ADD(g_comm_accuracy_time, timer);
+
+    atomic_store(&ev->done, 1);
+    return NULL;
+}
+
+void async_eval_start(async_eval *ev, const nn_params *params, const metrics_t *epoch_metrics, int iter)
+{
+    // Only one evaluation in flight; the snapshot buffer is reused
+    async_eval_poll(ev, 1);
+
+    copy_nn_params(&ev->snapshot, params);
+    metrics_reset(&ev->metrics);
+    metrics_add(&ev->metrics, METRIC_COST_SUM, epoch_metrics->local[METRIC_COST_SUM]);
+    metrics_add(&ev->metrics, METRIC_COST_SAMPLES, epoch_metrics->local[METRIC_COST_SAMPLES]);
+    ev->metrics.tag = iter;
+    atomic_store(&ev->done, 0);
+
+    pthread_create(&ev->thread, NULL, async_eval_thread, ev);
+    ev->in_flight = 1;
+}
+
+int async_eval_poll(async_eval *ev, int wait)
+{
+    if (!ev->in_flight)
+        return 0;
+    if (!wait && !atomic_load(&ev->done))
+        return 0;
+
+    pthread_join(ev->thread, NULL);
+    ev->in_flight = 0;
+
+    if (ev->rank == 0)
+        metrics_print_progress(&ev->metrics);
+
+    return 1;
+}
+
+void async_eval_destroy(async_eval *ev)
+{
+    async_eval_poll(ev, 1);
+    delete_nn_params(&ev->snapshot);
+    MPI_Comm_free(&ev->metrics.comm);
+    tp_group_free(&ev->tp);
+    eval_workspace_free(&ev->workspace);
+}
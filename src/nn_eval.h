@@ -0,0 +1,77 @@
+#ifndef NN_EVAL_H
+#define NN_EVAL_H
+
+#include <mpi.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "matrix.h"
+#include "nn.h"
+#include "metrics.h"
+#include "tensor_parallel.h"
+#include "quantize.h"
+
+// Inference state for evaluating params (built once, reused by every evaluation)
+typedef struct
+{
+    predict_workspace predict; // The whole network, or the layers after layer 0 when it is split across tp
+    int int8_samples;          // > 0: evaluate the int8 quantization of params, calibrated on this many
+                               // samples of the training shard (ranges merged over comm)
+    MPI_Comm comm;
+    quant_model quant;         // Requantized from params by every evaluate_local
+    quant_workspace *quant_ws; // One per thread, created with the first quantized model
+} eval_workspace;
+
+// Workspace for params on num_threads threads (0 = omp_get_max_threads()); int8_samples > 0 opts in
+// to int8 evaluation (whole models only, calibration collective over comm, or local with MPI_COMM_NULL)
+void eval_workspace_init(eval_workspace *ws, const nn_params *params, const tp_group *tp, int num_threads,
+                         int int8_samples, MPI_Comm comm);
+void eval_workspace_free(eval_workspace *ws);
+
+// Count correctly classified samples of (X, Y) on this process (no communication, unless params
+// holds a slice of layer 0 split across tp: then collective over the group). An int8 workspace
+// classifies with the model quantized by the last evaluate_local.
+int count_correct(const matrix *X, const matrix *Y, const nn_params *params, const tp_group *tp,
+                  eval_workspace *ws);
+
+// Add local train and test correct counts and totals to the metrics (an int8 workspace quantizes
+// params first, collective over its comm)
+void evaluate_local(metrics_t *metrics, const nn_params *params, const tp_group *tp, eval_workspace *ws,
+                    const matrix *X_train, const matrix *Y_train,
+                    const matrix *X_test, const matrix *Y_test);
+
+// Background evaluation of a parameter snapshot, run on its own thread and communicator
+typedef struct
+{
+    nn_params snapshot; // Copy of the parameters being evaluated (owned)
+    const matrix *X_train;
+    const matrix *Y_train;
+    const matrix *X_test;
+    const matrix *Y_test;
+    metrics_t metrics; // Reduced on a duplicate of the data-parallel communicator, used only by the evaluation thread
+    tp_group tp;       // Duplicate of the training group, used only by the evaluation thread
+    eval_workspace workspace; // Sized for num_threads, used only by the evaluation thread
+    int num_threads;   // OpenMP threads used by the evaluation thread
+    int rank;
+
+    pthread_t thread;
+    int in_flight;   // Evaluation started and not yet joined
+    atomic_int done; // Set by the evaluation thread when results are ready
+} async_eval;
+
+void async_eval_init(async_eval *ev, const nn_params *params, const tp_group *tp,
+                     const matrix *X_train, const matrix *Y_train,
+                     const matrix *X_test, const matrix *Y_test,
+                     int num_threads, int int8_samples, int rank);
+
+// Snapshot params and evaluate them in the background (waits for the previous evaluation first)
+// The local cost accumulated in epoch_metrics is reported along with the accuracies
+void async_eval_start(async_eval *ev, const nn_params *params, const metrics_t *epoch_metrics, int iter);
+
+// Report the evaluation in flight if it has finished (or block until it has when wait is set)
+// Returns 1 if results were reported
+int async_eval_poll(async_eval *ev, int wait);
+
+void async_eval_destroy(async_eval *ev);
+
+#endif // NN_EVAL_H
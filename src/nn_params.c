@@ -1,10 +1,16 @@
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "nn_params.h"
 #include "config.h"
 
 nn_params initialize_parameters_he(int *layer_dims, int L, int seed_offset)
+{
+    return initialize_parameters_he_rows(layer_dims, L, seed_offset, 0, layer_dims[1]);
+}
+
+nn_params initialize_parameters_he_rows(int *layer_dims, int L, int seed_offset, int first_row, int num_rows)
 {
     nn_params params;
     params.L = L;
@@ -19,8 +25,12 @@ nn_params initialize_parameters_he(int *layer_dims, int L, int seed_offset)
         int rows = layer_dims[l + 1];
         int cols = layer_dims[l];
 
+        // Layer 0 keeps only rows first_row + 1 .. first_row + num_rows
+        int keep_first = l == 0 ? first_row : 0;
+        int keep_rows = l == 0 ? num_rows : rows;
+
         // Initialize weights with He initialization: W ~ N(0, sqrt(2/n_prev))
-        params.W[l] = new_matrix(rows, cols);
+        params.W[l] = new_matrix_first_touch(keep_rows, cols);
         double std = sqrt(2.0 / cols);
         for (int i = 1; i <= rows; i++)
             for (int j = 1; j <= cols; j++)
@@ -31,11 +41,14 @@ nn_params initialize_parameters_he(int *layer_dims, int L, int seed_offset)
                 // Avoid log(0)
                 if (u1 < 1e-10) u1 = 1e-10;
                 double z = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
-                mget(params.W[l], i, j) = z * std;
+
+                // Every row draws its numbers, so the kept rows match the full initialization
+                if (i > keep_first && i <= keep_first + keep_rows)
+                    mget(params.W[l], i - keep_first, j) = z * std;
             }
 
         // Initialize biases to zero
-        params.b[l] = new_matrix(rows, 1);
+        params.b[l] = new_matrix_first_touch(keep_rows, 1);
     }
 
     return params;
@@ -56,6 +69,56 @@ void update_parameters(nn_params *params, const nn_grads *grads, double learning
     }
 }
 
+nn_params clone_nn_params(const nn_params *src)
+{
+    nn_params dst;
+    dst.L = src->L;
+    dst.W = (matrix *)malloc(sizeof(matrix) * src->L);
+    dst.b = (matrix *)malloc(sizeof(matrix) * src->L);
+
+    for (int l = 0; l < src->L; l++)
+    {
+        dst.W[l] = new_matrix_first_touch(src->W[l].rows, src->W[l].cols);
+        dst.b[l] = new_matrix_first_touch(src->b[l].rows, 1);
+    }
+    copy_nn_params(&dst, src);
+
+    return dst;
+}
+
+void copy_nn_params(nn_params *dst, const nn_params *src)
+{
+    for (int l = 0; l < src->L; l++)
+    {
+        memcpy(dst->W[l].val, src->W[l].val, sizeof(double) * src->W[l].rows * src->W[l].cols);
+        memcpy(dst->b[l].val, src->b[l].val, sizeof(double) * src->b[l].rows * src->b[l].cols);
+    }
+}
+
+nn_grads new_nn_grads(const nn_params *params)
+{
+    nn_grads grads;
+    grads.dW = (matrix *)malloc(sizeof(matrix) * params->L);
+    grads.db = (matrix *)malloc(sizeof(matrix) * params->L);
+
+    for (int l = 0; l < params->L; l++)
+    {
+        grads.dW[l] = new_matrix_first_touch(params->W[l].rows, params->W[l].cols);
+        grads.db[l] = new_matrix_first_touch(params->b[l].rows, 1);
+    }
+
+    return grads;
+}
+
+void zero_nn_grads(nn_grads *grads, int L)
+{
+    for (int l = 0; l < L; l++)
+    {
+        memset(grads->dW[l].val, 0, sizeof(double) * grads->dW[l].rows * grads->dW[l].cols);
+        memset(grads->db[l].val, 0, sizeof(double) * grads->db[l].rows * grads->db[l].cols);
+    }
+}
+
 void delete_nn_params(nn_params *params)
 {
     if (!params)
@@ -7,9 +7,21 @@
 // Initialize network parameters with He initialization
 nn_params initialize_parameters_he(int *layer_dims, int L, int seed_offset);
 
+// Same initialization, keeping only rows first_row + 1 .. first_row + num_rows of layer 0
+// (this rank's slice under tensor parallelism)
+nn_params initialize_parameters_he_rows(int *layer_dims, int L, int seed_offset, int first_row, int num_rows);
+
 // Update parameters using gradient descent
 void update_parameters(nn_params *params, const nn_grads *grads, double learning_rate);
 
+// Deep copies of parameters (clone allocates, copy reuses dst's buffers)
+nn_params clone_nn_params(const nn_params *src);
+void copy_nn_params(nn_params *dst, const nn_params *src);
+
+// Gradient buffers shaped like params (zero-initialized), used for accumulation
+nn_grads new_nn_grads(const nn_params *params);
+void zero_nn_grads(nn_grads *grads, int L);
+
 // Cleanup functions
 void delete_nn_params(nn_params *params);
 void delete_nn_grads(nn_grads *grads, int L);
@@ -1,38 +1,148 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "nn_train.h"
 #include "config.h"
 #include "timing.h"
 #include "mpi_utils.h"
-
-// Compute accuracy across all MPI processes
-static double compute_accuracy(const matrix *X, const matrix *Y, const nn_params *params, int num_processes);
+#include "nn_eval.h"
+#include "metrics.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "alloc.h"
+#include "plan.h"
+#include "tensor_parallel.h"
+#include "pipeline.h"
+#include "param_server.h"
+#include "checkpoint.h"
+
+// Print the progress line of each metrics reduction as it completes, then start the queued one
+// (blocks until none is in flight if wait is set)
+static void report_progress(metrics_t *metrics, int wait, int rank);
+
+// Stretch a step to slowdown times its compute time (artificial straggler)
+static void straggle(double slowdown, double compute_ms);
+
+int train_micro_batch_size(int local_batch_size, int micro_batch_size, int pipeline_stages)
+{
+    // A pipeline needs several micro-batches per stage to keep its stages busy
+    if (pipeline_stages > 1 && micro_batch_size <= 0)
+    {
+        const int per_batch = PIPELINE_MICRO_BATCHES_PER_STAGE * pipeline_stages;
+        micro_batch_size = (local_batch_size + per_batch - 1) / per_batch;
+    }
+    if (micro_batch_size <= 0 || micro_batch_size > local_batch_size)
+        micro_batch_size = local_batch_size;
+    return micro_batch_size;
+}
 
 nn_params train_model(const matrix *X_train, const matrix *Y_train,
                       const matrix *X_test, const matrix *Y_test,
                       int *layer_dims, int L,
                       double learning_rate, int num_iterations,
-                      int print_every, int num_samples, int num_threads,
-                      int rank, int num_processes)
+                      int batch_size, int micro_batch_size,
+                      int print_every, int eval_threads, int int8_eval_samples, int num_samples, int num_threads,
+                      const tp_group *tp, const pipe_group *pp,
+                      int async_staleness, int async_servers, double slowdown,
+                      int seed, nn_params *resume_params, int start_iteration,
+                      const char *checkpoint_path, int checkpoint_every,
+                      const char *config, train_summary *summary, MPI_Comm comm)
 {
-    // Initialize timing accumulators
+    int rank, num_processes;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_processes);
+
+    // Initialize timing accumulators and kernel counter totals (per model)
     init_timing_accumulators();
+    perf_counters_reset();
     timer_t_custom timer;
     timer_t_custom training_timer;
     TIMER_START(training_timer);
 
-    // Calculate local batch size per process
-    int local_batch_size = BATCH_SIZE / num_processes;
-    int num_train_samples = X_train->cols;
-    int num_batches = (num_train_samples + local_batch_size - 1) / local_batch_size;
+    // Data-parallel replicas: tensor-parallel groups, or pipelines
+    const int dp_size = pp ? pp->dp_size : tp->dp_size;
+    const int dp_rank = pp ? pp->dp_rank : tp->dp_rank;
+    MPI_Comm dp_comm = pp ? pp->dp_comm : tp->dp_comm;
 
-    // Allocate mini-batch matrices
-    matrix X_batch = new_matrix(X_train->rows, local_batch_size);
-    matrix Y_batch = new_matrix(Y_train->rows, local_batch_size);
+    // Split the global batch across the data-parallel replicas (first batch_size % dp_size replicas
+    // take one extra sample); the ranks of a group or pipeline share their replica's samples
+    int local_batch_size = batch_size / dp_size + (dp_rank < batch_size % dp_size ? 1 : 0);
+    int num_train_samples = X_train->cols;
 
-    // Initialize parameters (use rank to differentiate seeds and avoid identical initialization)
-    nn_params params = initialize_parameters_he(layer_dims, L, rank);
+    // All processes must step together, so use the largest local batch count; every rank then splits
+    // its shard into that many near-equal batches (at most local_batch_size samples each), so all
+    // shards are covered once per epoch at the same rate instead of smaller ones idling at the end
+    int num_batches = allreduce_max_int((num_train_samples + local_batch_size - 1) / local_batch_size, comm);
+
+    // Samples of each step summed over the data-parallel replicas: the same every epoch, so the
+    // gradient average needs no count reduction per step (a step with none updates nothing)
+    int *step_samples = (int *)malloc(sizeof(int) * num_batches);
+    for (int batch = 0; batch < num_batches; batch++)
+        step_samples[batch] = (int)((long)(batch + 1) * num_train_samples / num_batches) -
+                              (int)((long)batch * num_train_samples / num_batches);
+    MPI_Allreduce(MPI_IN_PLACE, step_samples, num_batches, MPI_INT, MPI_SUM, dp_comm);
+
+    // Micro-batches bound activation memory; gradients are accumulated over the local batch
+    micro_batch_size = train_micro_batch_size(local_batch_size, micro_batch_size, pp ? pp->stages : 1);
+    int num_micro_batches = (local_batch_size + micro_batch_size - 1) / micro_batch_size;
+
+    // Allocate micro-batch matrices
+    matrix X_batch = new_matrix_first_touch(X_train->rows, micro_batch_size);
+    matrix Y_batch = new_matrix_first_touch(Y_train->rows, micro_batch_size);
+
+    // Initialize parameters (use the replica to differentiate seeds and avoid identical initialization;
+    // the ranks of a group hold the same replicated layers and disjoint rows of layer 0), unless
+    // resuming from a checkpoint
+    nn_params params = resume_params ? *resume_params
+                                     : initialize_parameters_he_rows(layer_dims, L, seed + dp_rank, tp->row_offset, tp->row_count);
+
+    // Local gradient accumulator (reused for every mini-batch)
+    nn_grads grads = new_nn_grads(&params);
+
+    // The layers this rank trains (all of them unless it is a pipeline stage)
+    const int first_layer = pp ? pp->first_layer[pp->stage] : 0;
+    const int last_layer = pp ? pp->first_layer[pp->stage + 1] : L;
+    nn_params stage_params = {last_layer - first_layer, params.W + first_layer, params.b + first_layer};
+    nn_grads stage_grads = {grads.dW + first_layer, grads.db + first_layer};
+
+    // Every micro-batch runs from one plan: all activations and gradients live in a single slab
+    // (a pipeline stage keeps one slab per micro-batch in flight in its runner)
+    exec_plan plan;
+    double *slab = NULL;
+    pipe_runner runner;
+    if (pp)
+    {
+        pipe_runner_init(&runner, pp, layer_dims, L, micro_batch_size);
+    }
+    else
+    {
+        plan = plan_build(PLAN_TRAINING, layer_dims, L, micro_batch_size, tp);
+        slab = plan_alloc_slab(&plan);
+    }
+    const exec_plan *step_plan = pp ? &runner.plan : &plan;
+
+    // Asynchronous mode: parameters hosted in RMA windows, every rank steps at its own pace
+    param_server ps;
+    if (async_staleness >= 0)
+        param_server_init(&ps, &params, async_servers, async_staleness, tp->dp_comm);
+
+    // Epoch metrics, accumulated locally and reduced only at print boundaries (a pipeline's cost
+    // comes from its last stage and its accuracy from its first)
+    metrics_t metrics;
+    metrics_init(&metrics, pp ? comm : tp->dp_comm);
+
+    // Background evaluation of parameter snapshots (eval_threads == 0 evaluates inline); inline and
+    // final evaluations share one inference workspace (a pipeline's first stage evaluates)
+    async_eval eval;
+    if (eval_threads > 0)
+        async_eval_init(&eval, &params, tp, X_train, Y_train, X_test, Y_test, eval_threads,
+                        int8_eval_samples, rank);
+    eval_workspace predict_ws;
+    const int evaluates = !pp || pp->stage == 0;
+    if (evaluates)
+        eval_workspace_init(&predict_ws, &params, tp, 0, int8_eval_samples,
+                            async_staleness >= 0 ? MPI_COMM_NULL : tp->dp_comm); // No barrier under --async
 
     if (rank == 0)
     {
@@ -45,6 +155,8 @@ nn_params train_model(const matrix *X_train, const matrix *Y_train,
                 printf(" -> ");
         }
         printf("\n");
+        if (config && config[0])
+            printf("Configuration: %s\n", config);
         printf("Learning rate: %.4f\n", learning_rate);
         printf("Iterations: %d\n", num_iterations);
         printf("Total samples: %d\n", num_samples);
@@ -53,108 +165,239 @@ nn_params train_model(const matrix *X_train, const matrix *Y_train,
         printf("Local test samples: %d\n", X_test->cols);
         printf("MPI processes: %d\n", num_processes);
         printf("OpenMP threads per process: %d\n", num_threads);
-        printf("Mini-batch size: %d (global), %d (local per process)\n", BATCH_SIZE, local_batch_size);
+        if (tp->size > 1)
+        {
+            // Layer 1's weights and gradient traffic shrink by the group size
+            const double MB = 1024.0 * 1024.0;
+            double exchanged = 0.0, exchanged_full = 0.0;
+            for (int l = 0; l < L; l++)
+            {
+                exchanged += (double)(params.W[l].rows * params.W[l].cols + params.b[l].rows) * sizeof(double);
+                exchanged_full += (double)(layer_dims[l + 1] * layer_dims[l] + layer_dims[l + 1]) * sizeof(double);
+            }
+            printf("Tensor parallelism: layer 1 split over groups of %d ranks (%d rows on rank 0), %d data-parallel replicas\n",
+                   tp->size, tp->row_count, tp->dp_size);
+            printf("Layer 1 weights per rank: %.2f MB (%.2f MB unsplit)\n",
+                   (double)params.W[0].rows * params.W[0].cols * sizeof(double) / MB,
+                   (double)layer_dims[1] * layer_dims[0] * sizeof(double) / MB);
+            printf("Gradients allreduced per step: %.2f MB per rank across %d replicas (%.2f MB unsplit)\n",
+                   exchanged / MB, tp->dp_size, exchanged_full / MB);
+        }
+        if (pp)
+            printf("Pipeline parallelism: %d stages, %d data-parallel replicas\n", pp->stages, pp->dp_size);
+        if (async_staleness >= 0)
+            printf("Asynchronous SGD: staleness bound %d steps, parameters on %d server rank(s)\n",
+                   async_staleness, ps.num_servers);
+        if (eval_threads > 0)
+            printf("Evaluation: background, %d of the OpenMP threads per process (%d train)\n", eval_threads,
+                   num_threads - eval_threads);
+        else
+            printf("Evaluation: inline\n");
+        if (int8_eval_samples > 0)
+            printf("Progress accuracy: int8 model, calibrated on %d samples per replica\n", int8_eval_samples);
+        printf("Mini-batch size: %d (global), %d (local per process)\n", batch_size, local_batch_size);
+        printf("Micro-batch size: %d (%d micro-batches per local batch)\n", micro_batch_size, num_micro_batches);
         printf("Batches per epoch: %d\n", num_batches);
+        printf("Memory placement (rank 0):\n");
+        alloc_print_placement("X_train", X_train->val, (size_t)X_train->rows * X_train->cols * sizeof(double));
+        alloc_print_placement("X_test", X_test->val, (size_t)X_test->rows * X_test->cols * sizeof(double));
+        for (int l = 0; l < L; l++)
+        {
+            char name[16];
+            snprintf(name, sizeof(name), "W%d", l + 1);
+            alloc_print_placement(name, params.W[l].val, (size_t)params.W[l].rows * params.W[l].cols * sizeof(double));
+        }
+        plan_print(step_plan);
         printf("=============================================\n\n\n");
     }
 
+    // Snapshots of the model, written by rank 0 in the background
+    checkpoint_writer ckpt;
+    if (checkpoint_path)
+        checkpoint_writer_init(&ckpt, checkpoint_path, layer_dims, L, seed, tp, pp, rank);
+
     // Training loop
     if (rank == 0)
+    {
         printf("========== TRAINING LOOP ==========\n");
+        if (start_iteration > 0)
+            printf("Resuming at iteration %d\n", start_iteration);
+    }
 
-    for (int iter = 0; iter < num_iterations; iter++)
+    for (int iter = start_iteration; iter < num_iterations; iter++)
     {
-        double epoch_cost = 0.0;
-
         // Process each mini-batch
         for (int batch = 0; batch < num_batches; batch++)
         {
-            int start_idx = batch * local_batch_size;
-            int current_batch_size = local_batch_size;
-
-            // Handle last batch which might be smaller
-            if (start_idx + local_batch_size > num_train_samples)
+            trace_set_step(iter * num_batches + batch);
+            TRACE_BEGIN(trace_begin_us);
+
+            // This rank's share of the epoch's batch-th step (empty only if the shard has fewer
+            // samples than there are steps)
+            int start_idx = (int)((long)batch * num_train_samples / num_batches);
+            int current_batch_size = (int)((long)(batch + 1) * num_train_samples / num_batches) - start_idx;
+
+            // Don't run further ahead of the slowest rank than the staleness bound
+            if (async_staleness >= 0)
+                param_server_wait(&ps);
+
+            zero_nn_grads(&stage_grads, stage_params.L);
+            double local_cost = 0.0;
+            timer_t_custom step_timer;
+            TIMER_START(step_timer);
+
+            // Stream the micro-batches through the pipeline (it splits its own time into forward,
+            // cost, backward and stage-to-stage waits)
+            if (pp && current_batch_size > 0)
+                local_cost = pipe_step(&runner, X_train, Y_train, start_idx, current_batch_size, &stage_params, &stage_grads);
+
+            // Accumulate gradients over the micro-batches of the local batch
+            for (int micro_start = 0; !pp && micro_start < current_batch_size; micro_start += micro_batch_size)
             {
-                current_batch_size = num_train_samples - start_idx;
-            }
-
-            // Extract mini-batch (copy columns from training data)
-            for (int j = 0; j < current_batch_size; j++)
-            {
-                int src_col = start_idx + j + 1; // 1-indexed column in source
-                int dst_col = j + 1;             // 1-indexed column in batch
-
-                // Copy X column
+                int current_micro_size = micro_batch_size;
+                if (micro_start + micro_batch_size > current_batch_size)
+                    current_micro_size = current_batch_size - micro_start;
+
+                // Each micro-batch contributes proportionally to the local batch mean
+                double weight = (double)current_micro_size / current_batch_size;
+
+                // Create matrix views for the current micro-batch size (the column
+                // stride must match before the columns are copied in)
+                matrix X_batch_view = X_batch;
+                matrix Y_batch_view = Y_batch;
+                X_batch_view.cols = current_micro_size;
+                Y_batch_view.cols = current_micro_size;
+
+                // Extract micro-batch (copy columns from training data), row blocks split statically
+                // like the batch buffers' first touch so every thread writes the pages it placed
+                const int first_col = start_idx + micro_start + 1; // 1-indexed column in source
+#pragma omp parallel for schedule(static)
                 for (int i = 1; i <= X_train->rows; i++)
-                    mget(X_batch, i, dst_col) = mgetp(X_train, i, src_col);
+                    for (int j = 1; j <= current_micro_size; j++)
+                        mget(X_batch_view, i, j) = mgetp(X_train, i, first_col + j - 1);
 
-                // Copy Y column
                 for (int i = 1; i <= Y_train->rows; i++)
-                    mget(Y_batch, i, dst_col) = mgetp(Y_train, i, src_col);
+                    for (int j = 1; j <= current_micro_size; j++)
+                        mget(Y_batch_view, i, j) = mgetp(Y_train, i, first_col + j - 1);
+
+                // Forward propagation (local)
+                TIMER_START(timer);
+                matrix AL = L_model_forward_plan(&plan, slab, &X_batch_view, &params);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_forward_time, timer);
+
+                // Compute cost (local)
+                TIMER_START(timer);
+                local_cost += weight * compute_cost(&AL, &Y_batch_view);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_cost_time, timer);
+
+                // Backward propagation (local), accumulated into the batch gradients
+                TIMER_START(timer);
+                L_model_backward_plan(&plan, slab, &X_batch_view, &Y_batch_view, &params, &grads, weight);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_backward_time, timer);
             }
 
-            // Create matrix views for the current batch size if it's smaller
-            matrix X_batch_view = X_batch;
-            matrix Y_batch_view = Y_batch;
-            if (current_batch_size < local_batch_size)
+            TIMER_STOP(step_timer);
+            if (slowdown > 1.0)
+                straggle(slowdown, step_timer.elapsed_ms);
+
+            // Accumulate cost locally (reduced with the other metrics at print boundaries)
+            if (!pp || runner.plan.last_stage)
             {
-                X_batch_view.cols = current_batch_size;
-                Y_batch_view.cols = current_batch_size;
+                metrics_add(&metrics, METRIC_COST_SUM, local_cost * current_batch_size);
+                metrics_add(&metrics, METRIC_COST_SAMPLES, current_batch_size);
             }
 
-            // Forward propagation (local)
-            TIMER_START(timer);
-            forward_pass fwd = L_model_forward(&X_batch_view, &params);
-            TIMER_STOP(timer);
-            ACCUM_ADD(g_forward_time, timer);
-
-            // Compute cost (local, then allreduce)
-            TIMER_START(timer);
-            double local_cost = compute_cost(&fwd.AL, &Y_batch_view);
-            double cost = allreduce_cost(local_cost, num_processes);
-            epoch_cost += cost;
-            TIMER_STOP(timer);
-            ACCUM_ADD(g_cost_time, timer);
-
-            // Backward propagation (local, then allreduce)
-            TIMER_START(timer);
-            nn_grads grads = L_model_backward(&fwd.AL, &Y_batch_view, &fwd, params.L);
-            allreduce_gradients(&grads, params.L, num_processes);
-            TIMER_STOP(timer);
-            ACCUM_ADD(g_backward_time, timer);
-
-            // Update parameters (local, but same on all processes)
-            TIMER_START(timer);
-            update_parameters(&params, &grads, learning_rate);
-            TIMER_STOP(timer);
-            ACCUM_ADD(g_update_time, timer);
-
-            // Cleanup batch
-            cleanup_forward_pass(&fwd, params.L);
-            delete_nn_grads(&grads, params.L);
-        }
+            if (async_staleness >= 0)
+            {
+                // Apply this replica's share of a global step (its mean gradient over dp_size) to the
+                // hosted parameters and read them back
+                TIMER_START(timer);
+                param_server_push_pull(&ps, &params, &grads, learning_rate / dp_size);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_comm_gradients_time, timer);
+            }
+            else if (step_samples[batch] > 0)
+            {
+                // Average gradients across processes (weighted by local batch sizes)
+                TIMER_START(timer);
+                allreduce_gradients(&stage_grads, stage_params.L, current_batch_size, step_samples[batch], dp_comm);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_comm_gradients_time, timer);
+
+                // Update parameters (local, but same on all processes)
+                TIMER_START(timer);
+                update_parameters(&stage_params, &stage_grads, learning_rate);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_update_time, timer);
+            }
 
-        // Average cost over all batches
-        epoch_cost /= num_batches;
+            // Progress an inline metrics reduction and report it once complete
+            report_progress(&metrics, 0, rank);
+            TRACE_END(trace_begin_us, "train_step", "phase");
+        }
 
         // Print progress
         if (print_every > 0 && iter % print_every == 0)
         {
-            // Compute accuracy across all processes
-            TIMER_START(timer);
-            double train_acc = compute_accuracy(X_train, Y_train, &params, num_processes);
-            double test_acc = compute_accuracy(X_test, Y_test, &params, num_processes);
-            TIMER_STOP(timer);
-            ACCUM_ADD(g_accuracy_time, timer);
-
-            if (rank == 0)
-                printf("Iter %5d: Avg Cost = %.6f | Train Acc = %6.2f%% | Test Acc = %6.2f%%\n", iter, epoch_cost, train_acc, test_acc);
+            if (eval_threads > 0)
+            {
+                // Evaluate a snapshot in the background; results are printed when ready
+                async_eval_start(&eval, &params, &metrics, iter);
+            }
+            else
+            {
+                // Report a finished reduction without waiting; if the previous boundary's snapshot is
+                // still queued behind it (two boundaries behind), drain it so at most one stays queued
+                report_progress(&metrics, metrics.has_queued, rank);
+
+                // Local accuracy counts, then one non-blocking reduction overlapped with the next epoch,
+                // queued behind one still in flight so no rank blocks at the boundary (a barrier under
+                // --async); a pipeline's first stage evaluates the whole model
+                TIMER_START(timer);
+                if (pp)
+                    pipe_share_params(pp, &params);
+                if (evaluates)
+                    evaluate_local(&metrics, &params, tp, &predict_ws, X_train, Y_train, X_test, Y_test);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_accuracy_time, timer);
+
+                TIMER_START(timer);
+                metrics_queue_reduce(&metrics, iter);
+                TIMER_STOP(timer);
+                ACCUM_ADD(g_comm_cost_time, timer);
+            }
         }
+        else if (eval_threads > 0)
+        {
+            // Report a finished background evaluation without waiting for it
+            async_eval_poll(&eval, 0);
+        }
+
+        // Cost is reported per epoch
+        metrics_reset(&metrics);
+
+        // Periodic checkpoint (the final model is saved after training)
+        if (checkpoint_path && checkpoint_every > 0 && (iter + 1) % checkpoint_every == 0 && iter + 1 < num_iterations)
+            checkpoint_save(&ckpt, &params, tp, pp, iter + 1, (long)(iter + 1) * num_batches, learning_rate);
     }
 
-    // Cleanup mini-batch matrices
+    // Wait for the last inline reduction
+    report_progress(&metrics, 1, rank);
+
+    // Wait for the last background evaluation
+    if (eval_threads > 0)
+        async_eval_destroy(&eval);
+
+    // Cleanup mini-batch matrices, slab and gradient accumulator (the plan holds the layer timings)
     delete_matrix(&X_batch);
     delete_matrix(&Y_batch);
+    free(step_samples);
+    if (!pp)
+        alloc_free(slab);
+    delete_nn_grads(&grads, params.L);
 
     TIMER_STOP(training_timer);
 
@@ -162,11 +405,35 @@ nn_params train_model(const matrix *X_train, const matrix *Y_train,
     {
         printf("------------------------------------------------------------\n");
         printf("[TIMER] Total training time: %.2f seconds\n", training_timer.elapsed_ms / 1000.0);
+        printf("[TIMER] Training throughput: %.1f samples/s\n",
+               (double)(num_iterations - start_iteration) * num_train_samples * dp_size / (training_timer.elapsed_ms / 1000.0));
+    }
+
+    // Compute final accuracy across all processes (every rank returns the full model)
+    if (pp)
+        pipe_share_params(pp, &params);
+    if (async_staleness >= 0)
+        param_server_sync(&ps, &params);
+    if (checkpoint_path)
+        checkpoint_save(&ckpt, &params, tp, pp, num_iterations, (long)num_iterations * num_batches, learning_rate);
+    metrics_t final_metrics;
+    metrics_init(&final_metrics, pp ? comm : tp->dp_comm);
+    if (evaluates)
+    {
+        predict_ws.int8_samples = 0; // Final accuracy of the trained (double) model
+        evaluate_local(&final_metrics, &params, tp, &predict_ws, X_train, Y_train, X_test, Y_test);
+        eval_workspace_free(&predict_ws);
     }
+    TIMER_START(timer);
+    metrics_start_reduce(&final_metrics, num_iterations);
+    metrics_wait(&final_metrics);
+    TIMER_STOP(timer);
+    ACCUM_ADD(g_comm_accuracy_time, timer);
 
-    // Compute final accuracy across all processes
-    double final_train_acc = compute_accuracy(X_train, Y_train, &params, num_processes);
-    double final_test_acc = compute_accuracy(X_test, Y_test, &params, num_processes);
+    // Per-rank timing statistics (collective)
+    reduce_timing_accumulators(comm);
+    double final_train_acc = metrics_train_accuracy(&final_metrics);
+    double final_test_acc = metrics_test_accuracy(&final_metrics);
 
     if (rank == 0)
     {
@@ -175,57 +442,66 @@ nn_params train_model(const matrix *X_train, const matrix *Y_train,
         printf("Final Test Accuracy:  %.2f%%\n", final_test_acc);
         printf("=======================================\n\n");
         print_timing_summary();
+        plan_print_layer_timing(step_plan);
+        print_perf_counters_summary();
 
         // Log results to CSV
         log_results_to_csv("training_results.csv", num_samples, num_iterations, learning_rate,
                            final_train_acc, final_test_acc, training_timer.elapsed_ms / 1000.0,
-                           num_threads, num_processes);
+                           num_threads, num_processes, config);
+    }
+    if (checkpoint_path)
+        checkpoint_writer_destroy(&ckpt);
+    if (summary)
+    {
+        summary->train_accuracy = final_train_acc;
+        summary->test_accuracy = final_test_acc;
+        summary->training_time_sec = training_timer.elapsed_ms / 1000.0;
+    }
+    if (async_staleness >= 0)
+    {
+        param_server_report(&ps);
+        param_server_free(&ps);
+    }
+    if (pp)
+    {
+        pipe_report(&runner, comm);
+        pipe_runner_destroy(&runner);
+    }
+    else
+    {
+        plan_destroy(&plan);
     }
 
     return params;
 }
 
-static double compute_accuracy(const matrix *X, const matrix *Y, const nn_params *params, int num_processes)
+static void report_progress(metrics_t *metrics, int wait, int rank)
 {
-    forward_pass fwd = L_model_forward(X, params);
-
-    int m = X->cols;
-    int correct_count = 0;
-
-    // For each example
-    for (int j = 1; j <= m; j++)
+    while (metrics->pending)
     {
-        // Find predicted class (argmax of AL)
-        int pred_class = 0;
-        double max_prob = mget(fwd.AL, 1, j);
-        for (int i = 2; i <= fwd.AL.rows; i++)
-        {
-            if (mget(fwd.AL, i, j) > max_prob)
-            {
-                max_prob = mget(fwd.AL, i, j);
-                pred_class = i - 1;
-            }
-        }
-
-        // Find true class (argmax of Y)
-        int true_class = 0;
-        for (int i = 1; i <= Y->rows; i++)
-        {
-            if (mgetp(Y, i, j) > 0.5)
-            {
-                true_class = i - 1;
-                break;
-            }
-        }
-
-        // Check if correct
-        if (pred_class == true_class)
-            correct_count++;
+        timer_t_custom timer;
+        TIMER_START(timer);
+        int done = 1;
+        if (wait)
+            metrics_wait(metrics);
+        else
+            done = metrics_test(metrics);
+        TIMER_STOP(timer);
+        ACCUM_ADD(g_comm_cost_time, timer);
+
+        if (!done)
+            return;
+
+        if (rank == 0)
+            metrics_print_progress(metrics);
+        metrics_start_queued(metrics);
     }
+}
 
-    // Cleanup
-    cleanup_forward_pass(&fwd, params->L);
-
-    // Allreduce and return accuracy percentage
-    return allreduce_accuracy(correct_count, m);
-}
\ No newline at end of file
+static void straggle(double slowdown, double compute_ms)
+{
+    TRACE_BEGIN(trace_begin_us);
+    usleep((useconds_t)((slowdown - 1.0) * compute_ms * 1000.0));
+    TRACE_END(trace_begin_us, "straggle", "phase");
+}
@@ -1,15 +1,44 @@
 #ifndef NN_TRAIN_H
 #define NN_TRAIN_H
 
+#include <mpi.h>
 #include "matrix.h"
 #include "nn_params.h"
+#include "tensor_parallel.h"
+#include "pipeline.h"
+
+// Final results of a training run
+typedef struct
+{
+    double train_accuracy;
+    double test_accuracy;
+    double training_time_sec;
+} train_summary;
+
+// Train neural network model (layer 0 split across tp's group, gradients averaged over its
+// data-parallel communicator; with pp, this rank trains only its pipeline stage's layers).
+// async_staleness >= 0 trains asynchronously through async_servers parameter-server ranks, letting
+// ranks run up to that many steps apart; slowdown > 1 stretches this rank's steps (straggler).
+// int8_eval_samples > 0 reports in-training accuracy of the int8-quantized model, calibrated on that
+// many samples per replica (final accuracy stays double precision).
+// The model trains on comm (MPI_COMM_WORLD, or one group of a sweep) from weights drawn with seed,
+// or from resume_params (taken over) at iteration start_iteration; with checkpoint_path, a
+// checkpoint is written every checkpoint_every iterations and after training. Its CSV row is
+// tagged with config and its results are stored in summary (if not NULL).
+// Micro-batch width train_model runs a local batch of local_batch_size samples in (micro_batch_size
+// <= 0 is the whole batch, or the pipeline default with pipeline_stages > 1)
+int train_micro_batch_size(int local_batch_size, int micro_batch_size, int pipeline_stages);
 
-// Train neural network model
 nn_params train_model(const matrix *X_train, const matrix *Y_train,
                           const matrix *X_test, const matrix *Y_test,
                           int *layer_dims, int L,
                           double learning_rate, int num_iterations,
-                          int print_every, int num_samples, int num_threads,
-                          int rank, int num_processes);
+                          int batch_size, int micro_batch_size,
+                          int print_every, int eval_threads, int int8_eval_samples, int num_samples, int num_threads,
+                          const tp_group *tp, const pipe_group *pp,
+                          int async_staleness, int async_servers, double slowdown,
+                          int seed, nn_params *resume_params, int start_iteration,
+                          const char *checkpoint_path, int checkpoint_every,
+                          const char *config, train_summary *summary, MPI_Comm comm);
 
-#endif // NN_TRAIN_H
\ No newline at end of file
+#endif // NN_TRAIN_H
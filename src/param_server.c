@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <mpi.h>
+
+#include "param_server.h"
+#include "config.h"
+#include "trace.h"
+
+// Helper functions
+static void pack_params(const nn_params *params, double *flat);
+static void unpack_params(const double *flat, nn_params *params);
+static void pull(param_server *ps, nn_params *params);
+
+void param_server_init(param_server *ps, nn_params *params, int num_servers, int staleness, MPI_Comm comm)
+{
+    MPI_Comm_dup(comm, &ps->comm);
+    MPI_Comm_rank(ps->comm, &ps->rank);
+    MPI_Comm_size(ps->comm, &ps->size);
+    if (num_servers < 1)
+        num_servers = 1;
+    if (num_servers > ps->size)
+        num_servers = ps->size;
+    ps->num_servers = num_servers;
+    ps->staleness = staleness;
+
+    ps->num_params = 0;
+    for (int l = 0; l < params->L; l++)
+        ps->num_params += (long)params->W[l].rows * params->W[l].cols + params->b[l].rows;
+
+    // Servers spread evenly over the ranks (and so over the nodes), each with an equal slice
+    ps->server_rank = (int *)malloc(sizeof(int) * num_servers);
+    ps->shard_start = (long *)malloc(sizeof(long) * (num_servers + 1));
+    int shard = -1;
+    for (int s = 0; s <= num_servers; s++)
+    {
+        ps->shard_start[s] = ps->num_params * s / num_servers;
+        if (s < num_servers)
+        {
+            ps->server_rank[s] = (int)((long)s * ps->size / num_servers);
+            if (ps->server_rank[s] == ps->rank)
+                shard = s;
+        }
+    }
+
+    // Every rank starts from rank 0's parameters
+    for (int l = 0; l < params->L; l++)
+    {
+        MPI_Bcast(params->W[l].val, params->W[l].rows * params->W[l].cols, MPI_DOUBLE, 0, ps->comm);
+        MPI_Bcast(params->b[l].val, params->b[l].rows, MPI_DOUBLE, 0, ps->comm);
+    }
+    ps->flat = (double *)malloc(sizeof(double) * ps->num_params);
+    pack_params(params, ps->flat);
+
+    long shard_size = shard >= 0 ? ps->shard_start[shard + 1] - ps->shard_start[shard] : 0;
+    double *base;
+    MPI_Win_allocate(shard_size * sizeof(double), sizeof(double), MPI_INFO_NULL, ps->comm, &base, &ps->win);
+    int *clock_base;
+    MPI_Win_allocate(ps->rank == 0 ? ps->size * sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, ps->comm,
+                     &clock_base, &ps->clock_win);
+
+    // One passive-target epoch for the whole run; the initial contents are visible after the barrier
+    MPI_Win_lock_all(0, ps->win);
+    MPI_Win_lock_all(0, ps->clock_win);
+    if (shard >= 0)
+        memcpy(base, ps->flat + ps->shard_start[shard], shard_size * sizeof(double));
+    if (ps->rank == 0)
+        memset(clock_base, 0, ps->size * sizeof(int));
+    MPI_Win_sync(ps->win);
+    MPI_Win_sync(ps->clock_win);
+    MPI_Barrier(ps->comm);
+
+    ps->clock = 0;
+    ps->clocks = (int *)calloc(ps->size, sizeof(int));
+    ps->wait_ms = ps->push_ms = ps->pull_ms = 0.0;
+    ps->staleness_sum = 0;
+    ps->max_staleness = 0;
+}
+
+void param_server_free(param_server *ps)
+{
+    MPI_Win_unlock_all(ps->win);
+    MPI_Win_unlock_all(ps->clock_win);
+    MPI_Win_free(&ps->win);
+    MPI_Win_free(&ps->clock_win);
+    free(ps->server_rank);
+    free(ps->shard_start);
+    free(ps->flat);
+    free(ps->clocks);
+    MPI_Comm_free(&ps->comm);
+}
+
+void param_server_wait(param_server *ps)
+{
+    TRACE_BEGIN(trace_begin_us);
+    double begin = MPI_Wtime();
+    int slowest;
+    for (;;)
+    {
+        // Atomic read of every rank's clock
+        MPI_Get_accumulate(NULL, 0, MPI_INT, ps->clocks, ps->size, MPI_INT, 0, 0, ps->size, MPI_INT, MPI_NO_OP,
+                           ps->clock_win);
+        MPI_Win_flush(0, ps->clock_win);
+
+        slowest = ps->clocks[0];
+        for (int r = 1; r < ps->size; r++)
+            if (ps->clocks[r] < slowest)
+                slowest = ps->clocks[r];
+        if (slowest >= ps->clock - ps->staleness)
+            break;
+        usleep(ASYNC_POLL_US);
+    }
+
+    // Staleness the step runs with
+    const int lag = ps->clock - slowest;
+    ps->staleness_sum += lag;
+    if (lag > ps->max_staleness)
+        ps->max_staleness = lag;
+    ps->wait_ms += (MPI_Wtime() - begin) * 1000.0;
+    TRACE_END(trace_begin_us, "param_server_wait", "mpi");
+}
+
+void param_server_push_pull(param_server *ps, nn_params *params, const nn_grads *grads, double learning_rate)
+{
+    TRACE_BEGIN(trace_begin_us);
+    double begin = MPI_Wtime();
+
+    // Flatten -learning_rate * gradients in the parameters' order
+    long k = 0;
+    for (int l = 0; l < params->L; l++)
+    {
+        const int size_W = params->W[l].rows * params->W[l].cols;
+        for (int i = 0; i < size_W; i++)
+            ps->flat[k++] = -learning_rate * grads->dW[l].val[i];
+        for (int i = 0; i < params->b[l].rows; i++)
+            ps->flat[k++] = -learning_rate * grads->db[l].val[i];
+    }
+
+    for (int s = 0; s < ps->num_servers; s++)
+    {
+        const int count = (int)(ps->shard_start[s + 1] - ps->shard_start[s]);
+        MPI_Accumulate(ps->flat + ps->shard_start[s], count, MPI_DOUBLE, ps->server_rank[s], 0, count, MPI_DOUBLE,
+                       MPI_SUM, ps->win);
+    }
+    MPI_Win_flush_all(ps->win);
+    ps->push_ms += (MPI_Wtime() - begin) * 1000.0;
+
+    // The step counts only once its update is in place
+    ps->clock++;
+    MPI_Accumulate(&ps->clock, 1, MPI_INT, 0, ps->rank, 1, MPI_INT, MPI_REPLACE, ps->clock_win);
+    MPI_Win_flush(0, ps->clock_win);
+
+    pull(ps, params);
+    TRACE_END(trace_begin_us, "param_server_push_pull", "mpi");
+}
+
+void param_server_sync(param_server *ps, nn_params *params)
+{
+    MPI_Barrier(ps->comm);
+    pull(ps, params);
+}
+
+void param_server_report(const param_server *ps)
+{
+    // Per rank: steps, wait, push, pull, lag sum, max lag
+    double local[6] = {ps->clock, ps->wait_ms, ps->push_ms, ps->pull_ms, (double)ps->staleness_sum, ps->max_staleness};
+    double *all = NULL;
+    if (ps->rank == 0)
+        all = (double *)malloc(sizeof(double) * 6 * ps->size);
+    MPI_Gather(local, 6, MPI_DOUBLE, all, 6, MPI_DOUBLE, 0, ps->comm);
+
+    if (ps->rank == 0)
+    {
+        printf("\n========== ASYNC SGD (staleness bound %d, %d server%s) ==========\n", ps->staleness, ps->num_servers,
+               ps->num_servers > 1 ? "s" : "");
+        printf("Servers:");
+        for (int s = 0; s < ps->num_servers; s++)
+            printf(" rank %d (%ld params)", ps->server_rank[s], ps->shard_start[s + 1] - ps->shard_start[s]);
+        printf("\n");
+        printf("%-6s %7s %12s %10s %10s %9s %8s\n", "Rank", "Steps", "Bound(ms)", "Push(ms)", "Pull(ms)", "Mean lag", "Max lag");
+        for (int r = 0; r < ps->size; r++)
+        {
+            const double *v = &all[6 * r];
+            printf("%-6d %7.0f %12.2f %10.2f %10.2f %9.2f %8.0f\n", r, v[0], v[1], v[2], v[3],
+                   v[0] > 0 ? v[4] / v[0] : 0.0, v[5]);
+        }
+        printf("(lag: steps the slowest rank had pushed fewer than this one when it started a step)\n");
+        printf("==================================================================\n");
+        free(all);
+    }
+}
+
+static void pack_params(const nn_params *params, double *flat)
+{
+    long k = 0;
+    for (int l = 0; l < params->L; l++)
+    {
+        const int size_W = params->W[l].rows * params->W[l].cols;
+        memcpy(flat + k, params->W[l].val, size_W * sizeof(double));
+        k += size_W;
+        memcpy(flat + k, params->b[l].val, params->b[l].rows * sizeof(double));
+        k += params->b[l].rows;
+    }
+}
+
+static void unpack_params(const double *flat, nn_params *params)
+{
+    long k = 0;
+    for (int l = 0; l < params->L; l++)
+    {
+        const int size_W = params->W[l].rows * params->W[l].cols;
+        memcpy(params->W[l].val, flat + k, size_W * sizeof(double));
+        k += size_W;
+        memcpy(params->b[l].val, flat + k, params->b[l].rows * sizeof(double));
+        k += params->b[l].rows;
+    }
+}
+
+/**
+ * Read the hosted parameters (atomically per element, as other ranks may be accumulating) into params
+ */
+static void pull(param_server *ps, nn_params *params)
+{
+    double begin = MPI_Wtime();
+    for (int s = 0; s < ps->num_servers; s++)
+    {
+        const int count = (int)(ps->shard_start[s + 1] - ps->shard_start[s]);
+        MPI_Get_accumulate(NULL, 0, MPI_DOUBLE, ps->flat + ps->shard_start[s], count, MPI_DOUBLE, ps->server_rank[s], 0,
+                           count, MPI_DOUBLE, MPI_NO_OP, ps->win);
+    }
+    MPI_Win_flush_all(ps->win);
+    unpack_params(ps->flat, params);
+    ps->pull_ms += (MPI_Wtime() - begin) * 1000.0;
+}
@@ -0,0 +1,58 @@
+#ifndef PARAM_SERVER_H
+#define PARAM_SERVER_H
+
+#include <mpi.h>
+#include "nn.h"
+
+// Asynchronous stale-bounded SGD over MPI one-sided communication
+// The parameters, flattened layer by layer (W then b), are sharded across a few server ranks, each
+// exposing its shard in an RMA window. Every rank trains on its own data and, after each step,
+// accumulates -learning_rate * gradient into the shards (MPI_Accumulate, atomic per element) and
+// reads the current parameters back, without waiting for the other ranks. A clock window on rank 0
+// counts the steps each rank has pushed; a rank may start step k only once every rank has pushed
+// k - staleness steps (stale synchronous parallel: 0 keeps the ranks in lockstep, a large bound
+// lets stragglers fall behind freely).
+
+typedef struct
+{
+    MPI_Comm comm;
+    int rank;
+    int size;
+    int staleness;     // Most steps a rank may run ahead of the slowest
+    int num_servers;
+    int *server_rank;  // Rank hosting each shard
+    long *shard_start; // First flat index of each shard (num_servers + 1 entries)
+    long num_params;
+    MPI_Win win;       // This rank's shard (empty on non-servers)
+    MPI_Win clock_win; // Steps pushed by every rank (hosted on rank 0)
+    double *flat;      // Pack buffer for pushes and pulls
+    int clock;         // Steps pushed by this rank
+    int *clocks;       // Last read of the clock window
+
+    // Totals over all steps
+    double wait_ms; // Blocked on the staleness bound
+    double push_ms;
+    double pull_ms;
+    long staleness_sum; // Steps the slowest rank was behind, summed over the steps this rank started
+    int max_staleness;
+} param_server;
+
+// Host params in num_servers shards spread over comm and start every rank from rank 0's parameters
+// (collective)
+void param_server_init(param_server *ps, nn_params *params, int num_servers, int staleness, MPI_Comm comm);
+void param_server_free(param_server *ps); // Collective
+
+// Block until every rank is within the staleness bound of this rank's next step
+void param_server_wait(param_server *ps);
+
+// Add -learning_rate * grads to the hosted parameters, then read them back into params
+// (advances this rank's clock)
+void param_server_push_pull(param_server *ps, nn_params *params, const nn_grads *grads, double learning_rate);
+
+// Read the final parameters once every rank has pushed its last step (collective)
+void param_server_sync(param_server *ps, nn_params *params);
+
+// Steps, wait time and staleness of every rank, printed on rank 0 (collective)
+void param_server_report(const param_server *ps);
+
+#endif // PARAM_SERVER_H
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <omp.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf_counters.h"
+
+#define PERF_MAX_THREADS 256
+#define PERF_MAX_KERNELS 32
+
+// Event slots in perf_sample.counts
+enum
+{
+    EVENT_CYCLES,
+    EVENT_INSTRUCTIONS,
+    EVENT_LLC_MISSES,
+    EVENT_FP_SCALAR_DOUBLE,
+    EVENT_FP_128_PACKED_DOUBLE,
+    EVENT_FP_256_PACKED_DOUBLE
+};
+
+// Totals for one kernel
+typedef struct
+{
+    const char *name;
+    int calls;
+    double time_ms;
+    double flops;
+    double bytes;
+    double counts[PERF_NUM_EVENTS];
+} perf_kernel_stats;
+
+// Global variables
+int g_perf_enabled = 0;
+static int num_counter_threads = 0;
+static int event_available[PERF_NUM_EVENTS];
+static int event_fds[PERF_MAX_THREADS][PERF_NUM_EVENTS];
+static int group_slot[PERF_MAX_THREADS][PERF_NUM_EVENTS]; // Position in the thread's group read (-1 if not opened)
+static int group_leader[PERF_MAX_THREADS];
+static int group_size[PERF_MAX_THREADS];
+static perf_kernel_stats kernels[PERF_MAX_KERNELS];
+static int num_kernels = 0;
+static _Thread_local int is_instrumented_thread = 0;
+
+// Helper functions
+static void read_counters(double *counts);
+static perf_kernel_stats *find_kernel(const char *name);
+
+#ifdef __linux__
+static int open_event(unsigned int type, unsigned long long config, int group_fd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    // pid = 0, cpu = -1: count the calling thread on any CPU; members are scheduled with their leader
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/**
+ * FP_ARITH_INST_RETIRED raw events exist on Intel cores only
+ */
+static int is_intel_cpu(void)
+{
+    FILE *file = fopen("/proc/cpuinfo", "r");
+    if (!file)
+        return 0;
+
+    char line[256];
+    int intel = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strncmp(line, "vendor_id", 9) == 0)
+        {
+            intel = strstr(line, "GenuineIntel") != NULL;
+            break;
+        }
+    }
+    fclose(file);
+    return intel;
+}
+#endif
+
+int perf_counters_init(int num_threads)
+{
+    g_perf_enabled = 1;
+    is_instrumented_thread = 1;
+    num_counter_threads = 0;
+    memset(event_available, 0, sizeof(event_available));
+
+#ifdef __linux__
+    if (num_threads > PERF_MAX_THREADS)
+        num_threads = PERF_MAX_THREADS;
+
+    const unsigned int types[PERF_NUM_EVENTS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+        PERF_TYPE_RAW, PERF_TYPE_RAW, PERF_TYPE_RAW};
+    const unsigned long long configs[PERF_NUM_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES,
+        0x01C7, 0x04C7, 0x10C7}; // FP_ARITH_INST_RETIRED: scalar, 128-bit and 256-bit packed double
+    const int num_events = is_intel_cpu() ? PERF_NUM_EVENTS : EVENT_FP_SCALAR_DOUBLE;
+
+    for (int e = 0; e < PERF_NUM_EVENTS; e++)
+        event_available[e] = e < num_events;
+
+    // Each thread of the team opens its own group (perf events follow a single thread); the first
+    // event that opens leads it, so all of the thread's counters cover the same interval
+#pragma omp parallel num_threads(num_threads)
+    {
+        int t = omp_get_thread_num();
+        group_leader[t] = -1;
+        group_size[t] = 0;
+        for (int e = 0; e < PERF_NUM_EVENTS; e++)
+        {
+            event_fds[t][e] = e < num_events ? open_event(types[e], configs[e], group_leader[t]) : -1;
+            group_slot[t][e] = -1;
+            if (event_fds[t][e] < 0)
+            {
+#pragma omp atomic write
+                event_available[e] = 0;
+                continue;
+            }
+            if (group_leader[t] < 0)
+                group_leader[t] = event_fds[t][e];
+            group_slot[t][e] = group_size[t]++;
+        }
+    }
+    num_counter_threads = num_threads;
+#else
+    (void)num_threads;
+#endif
+
+    return event_available[EVENT_CYCLES] && event_available[EVENT_INSTRUCTIONS];
+}
+
+void perf_counters_close(void)
+{
+#ifdef __linux__
+    for (int t = 0; t < num_counter_threads; t++)
+        for (int e = 0; e < PERF_NUM_EVENTS; e++)
+            if (event_fds[t][e] >= 0)
+                close(event_fds[t][e]);
+#endif
+    num_counter_threads = 0;
+    g_perf_enabled = 0;
+}
+
+/**
+ * Sum every event over all threads (one group read per thread), scaled for multiplexing
+ */
+static void read_counters(double *counts)
+{
+    memset(counts, 0, sizeof(double) * PERF_NUM_EVENTS);
+
+#ifdef __linux__
+    for (int t = 0; t < num_counter_threads; t++)
+    {
+        if (group_leader[t] < 0)
+            continue;
+
+        unsigned long long group[3 + PERF_NUM_EVENTS]; // nr, time enabled, time running, values
+        const ssize_t size = (ssize_t)((3 + group_size[t]) * sizeof(unsigned long long));
+        if (read(group_leader[t], group, size) != size || group[2] == 0)
+            continue;
+
+        const double scale = (double)group[1] / group[2];
+        for (int e = 0; e < PERF_NUM_EVENTS; e++)
+            if (event_available[e] && group_slot[t][e] >= 0)
+                counts[e] += (double)group[3 + group_slot[t][e]] * scale;
+    }
+#endif
+}
+
+static perf_kernel_stats *find_kernel(const char *name)
+{
+    for (int k = 0; k < num_kernels; k++)
+        if (kernels[k].name == name || strcmp(kernels[k].name, name) == 0)
+            return &kernels[k];
+
+    if (num_kernels == PERF_MAX_KERNELS)
+        return NULL;
+
+    perf_kernel_stats *stats = &kernels[num_kernels++];
+    memset(stats, 0, sizeof(perf_kernel_stats));
+    stats->name = name;
+    return stats;
+}
+
+void perf_kernel_begin(perf_sample *sample)
+{
+    // Only the thread whose team owns the counters is instrumented
+    if (!is_instrumented_thread)
+        return;
+
+    read_counters(sample->counts);
+    clock_gettime(CLOCK_MONOTONIC, &sample->start);
+}
+
+void perf_kernel_end(const char *name, const perf_sample *sample, double flops, double bytes)
+{
+    if (!is_instrumented_thread)
+        return;
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double counts[PERF_NUM_EVENTS];
+    read_counters(counts);
+
+    perf_kernel_stats *stats = find_kernel(name);
+    if (!stats)
+        return;
+
+    stats->calls++;
+    stats->time_ms += (end.tv_sec - sample->start.tv_sec) * 1000.0 + (end.tv_nsec - sample->start.tv_nsec) / 1e6;
+    stats->flops += flops;
+    stats->bytes += bytes;
+    for (int e = 0; e < PERF_NUM_EVENTS; e++)
+        stats->counts[e] += counts[e] - sample->counts[e];
+}
+
+void perf_counters_reset(void)
+{
+    num_kernels = 0;
+}
+
+void print_perf_counters_summary(void)
+{
+    if (!g_perf_enabled)
+        return;
+
+    int have_counters = event_available[EVENT_CYCLES] && event_available[EVENT_INSTRUCTIONS];
+    int have_llc = event_available[EVENT_LLC_MISSES];
+    int have_fp = event_available[EVENT_FP_SCALAR_DOUBLE];
+
+    printf("\n========== KERNEL PERFORMANCE COUNTERS ==========\n");
+    if (!have_counters)
+        printf("Hardware counters unavailable (check /proc/sys/kernel/perf_event_paranoid);\n"
+               "showing analytic FLOP and byte counts only\n");
+    printf("Threads counted: %d | FLOPs and bytes are analytic, DRAM bytes = LLC misses * 64\n", num_counter_threads);
+    printf("%-26s %7s %10s %8s %6s %10s %8s %8s %8s\n",
+           "Kernel", "Calls", "Time(ms)", "GFLOP/s", "IPC", "LLC miss", "B/FLOP", "DRAM B/F", "HW GF/s");
+
+    for (int k = 0; k < num_kernels; k++)
+    {
+        const perf_kernel_stats *s = &kernels[k];
+        double seconds = s->time_ms / 1000.0;
+        double gflops = seconds > 0.0 ? s->flops / seconds / 1e9 : 0.0;
+        double hw_flops = s->counts[EVENT_FP_SCALAR_DOUBLE] + 2.0 * s->counts[EVENT_FP_128_PACKED_DOUBLE] +
+                          4.0 * s->counts[EVENT_FP_256_PACKED_DOUBLE];
+
+        printf("%-26s %7d %10.3f %8.3f ", s->name, s->calls, s->time_ms, gflops);
+        if (have_counters)
+            printf("%6.2f ", s->counts[EVENT_CYCLES] > 0 ? s->counts[EVENT_INSTRUCTIONS] / s->counts[EVENT_CYCLES] : 0.0);
+        else
+            printf("%6s ", "n/a");
+        if (have_llc)
+            printf("%10.0f ", s->counts[EVENT_LLC_MISSES]);
+        else
+            printf("%10s ", "n/a");
+        printf("%8.3f ", s->flops > 0 ? s->bytes / s->flops : 0.0);
+        if (have_llc)
+            printf("%8.3f ", s->flops > 0 ? s->counts[EVENT_LLC_MISSES] * 64.0 / s->flops : 0.0);
+        else
+            printf("%8s ", "n/a");
+        if (have_fp)
+            printf("%8.3f\n", seconds > 0.0 ? hw_flops / seconds / 1e9 : 0.0);
+        else
+            printf("%8s\n", "n/a");
+    }
+    printf("=================================================\n\n");
+}
@@ -0,0 +1,49 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <time.h>
+
+// Optional hardware performance counters per kernel (Linux perf_event_open)
+// Counters are opened for every OpenMP thread of the calling thread's team as one event
+// group per thread (a single read returns them all) and summed around each instrumented
+// kernel call. Kernel FLOPs and bytes are counted analytically,
+// so the table still reports GFLOP/s when counters are not permitted.
+
+// Hardware events sampled per kernel (cycles, instructions, LLC misses, three FP widths)
+#define PERF_NUM_EVENTS 6
+
+// Non-zero once perf_counters_init has been called (checked before every probe)
+extern int g_perf_enabled;
+
+typedef struct
+{
+    struct timespec start;
+    double counts[PERF_NUM_EVENTS]; // Counter values summed over all threads at kernel start
+} perf_sample;
+
+// Enable instrumentation; returns 1 if hardware counters could be opened, 0 otherwise
+int perf_counters_init(int num_threads);
+void perf_counters_close(void);
+
+void perf_kernel_begin(perf_sample *sample);
+void perf_kernel_end(const char *name, const perf_sample *sample, double flops, double bytes);
+
+// Print the per-kernel table (IPC, GFLOP/s, bytes/FLOP)
+void print_perf_counters_summary(void);
+
+// Clear the per-kernel totals (each model of a sweep reports its own table)
+void perf_counters_reset(void);
+
+// Macros to instrument a kernel (no work beyond one branch when disabled)
+#define PERF_BEGIN(var)             \
+    perf_sample var;                \
+    if (g_perf_enabled)             \
+    perf_kernel_begin(&var)
+#define PERF_END(var, name, flops, bytes)                                     \
+    do                                                                        \
+    {                                                                         \
+        if (g_perf_enabled)                                                   \
+            perf_kernel_end((name), &(var), (double)(flops), (double)(bytes)); \
+    } while (0)
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,364 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <mpi.h>
+
+#include "pipeline.h"
+#include "alloc.h"
+#include "timing.h"
+#include "trace.h"
+
+// Message tags between neighbouring stages (messages of one kind arrive in micro-batch order)
+#define TAG_ACTIVATION 1
+#define TAG_GRADIENT 2
+
+// Helper functions
+static void split_layers(const int *layer_dims, int L, int stages, int *first_layer);
+static void pipe_forward(pipe_runner *run, const matrix *X, const matrix *Y, int start, int count,
+                         int micro, const nn_params *stage_params, double *cost);
+static void pipe_backward(pipe_runner *run, int count, int micro, int num_micro,
+                          const nn_params *stage_params, nn_grads *stage_grads);
+static void wait_request(pipe_runner *run, MPI_Request *request);
+static int micro_size(const pipe_runner *run, int count, int micro);
+
+pipe_group pipe_group_create(int stages, const int *layer_dims, int L, MPI_Comm comm)
+{
+    int rank, num_processes;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_processes);
+    assert(stages > 0 && num_processes % stages == 0 && stages <= L);
+
+    pipe_group pp;
+    pp.stages = stages;
+    pp.stage = rank % stages;
+    pp.dp_size = num_processes / stages;
+    pp.dp_rank = rank / stages;
+    MPI_Comm_split(comm, pp.dp_rank, pp.stage, &pp.comm);
+    MPI_Comm_split(comm, pp.stage, pp.dp_rank, &pp.dp_comm);
+
+    pp.first_layer = (int *)malloc(sizeof(int) * (stages + 1));
+    split_layers(layer_dims, L, stages, pp.first_layer);
+    return pp;
+}
+
+void pipe_group_free(pipe_group *pp)
+{
+    MPI_Comm_free(&pp->comm);
+    MPI_Comm_free(&pp->dp_comm);
+    free(pp->first_layer);
+    pp->first_layer = NULL;
+}
+
+void pipe_share_params(const pipe_group *pp, nn_params *params)
+{
+    TRACE_BEGIN(trace_begin_us);
+    for (int s = 0; s < pp->stages; s++)
+        for (int l = pp->first_layer[s]; l < pp->first_layer[s + 1]; l++)
+        {
+            MPI_Bcast(params->W[l].val, params->W[l].rows * params->W[l].cols, MPI_DOUBLE, s, pp->comm);
+            MPI_Bcast(params->b[l].val, params->b[l].rows, MPI_DOUBLE, s, pp->comm);
+        }
+    TRACE_END(trace_begin_us, "pipe_share_params", "mpi");
+}
+
+void pipe_runner_init(pipe_runner *run, const pipe_group *pp, const int *layer_dims, int L, int micro_batch_size)
+{
+    run->pp = pp;
+    run->plan = plan_build_stage(layer_dims, L, pp->first_layer[pp->stage], pp->first_layer[pp->stage + 1], micro_batch_size);
+    run->micro_batch_size = micro_batch_size;
+
+    // 1F1B keeps at most (stages - stage) micro-batches in flight
+    run->num_slabs = pp->stages - pp->stage;
+    run->slabs = (double **)malloc(sizeof(double *) * run->num_slabs);
+    run->send = (MPI_Request *)malloc(sizeof(MPI_Request) * run->num_slabs);
+    run->recv = (MPI_Request *)malloc(sizeof(MPI_Request) * run->num_slabs);
+    for (int i = 0; i < run->num_slabs; i++)
+    {
+        run->slabs[i] = plan_alloc_slab(&run->plan);
+        run->send[i] = MPI_REQUEST_NULL;
+        run->recv[i] = MPI_REQUEST_NULL;
+    }
+    run->Y_batch = new_matrix(layer_dims[L], micro_batch_size);
+
+    run->compute_ms = run->wait_ms = run->step_ms = 0.0;
+    run->samples = 0;
+    run->micro_batches = 0;
+    run->steps = 0;
+}
+
+void pipe_runner_destroy(pipe_runner *run)
+{
+    for (int i = 0; i < run->num_slabs; i++)
+    {
+        MPI_Wait(&run->send[i], MPI_STATUS_IGNORE);
+        MPI_Wait(&run->recv[i], MPI_STATUS_IGNORE);
+        alloc_free(run->slabs[i]);
+    }
+    free(run->slabs);
+    free(run->send);
+    free(run->recv);
+    delete_matrix(&run->Y_batch);
+    plan_destroy(&run->plan);
+}
+
+double pipe_step(pipe_runner *run, const matrix *X, const matrix *Y, int start, int count,
+                 const nn_params *stage_params, nn_grads *stage_grads)
+{
+    TRACE_BEGIN(trace_begin_us);
+    const pipe_group *pp = run->pp;
+    const exec_plan *plan = &run->plan;
+    const int num_micro = (count + run->micro_batch_size - 1) / run->micro_batch_size;
+    int warmup = pp->stages - pp->stage - 1;
+    if (warmup > num_micro)
+        warmup = num_micro;
+    double step_start = MPI_Wtime();
+    double cost = 0.0;
+
+    // Inputs of the first micro-batches go straight into their slabs
+    for (int i = 0; pp->stage > 0 && i < run->num_slabs && i < num_micro; i++)
+    {
+        matrix input = plan_view(plan, run->slabs[i], plan->input, micro_size(run, count, i));
+        MPI_Irecv(input.val, input.rows * input.cols, MPI_DOUBLE, pp->stage - 1, TAG_ACTIVATION, pp->comm, &run->recv[i]);
+    }
+
+    // 1F1B: warm-up forwards, then one forward and one backward at a time, then the remaining backwards
+    for (int i = 0; i < warmup; i++)
+        pipe_forward(run, X, Y, start, count, i, stage_params, &cost);
+    for (int i = 0; i < num_micro; i++)
+    {
+        if (warmup + i < num_micro)
+            pipe_forward(run, X, Y, start, count, warmup + i, stage_params, &cost);
+        pipe_backward(run, count, i, num_micro, stage_params, stage_grads);
+    }
+
+    // Outgoing messages must land before the slabs are reused by the next step
+    for (int i = 0; i < run->num_slabs; i++)
+        wait_request(run, &run->send[i]);
+
+    run->step_ms += (MPI_Wtime() - step_start) * 1000.0;
+    run->samples += count;
+    run->micro_batches += num_micro;
+    run->steps++;
+    TRACE_END(trace_begin_us, "pipe_step", "phase");
+    return cost;
+}
+
+void pipe_report(const pipe_runner *run, MPI_Comm comm)
+{
+    const pipe_group *pp = run->pp;
+    int rank, num_processes;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_processes);
+
+    // Per rank: stage, compute, bubble, step time, samples
+    double local[5] = {pp->stage, run->compute_ms, run->wait_ms, run->step_ms, (double)run->samples};
+    double *all = NULL;
+    if (rank == 0)
+        all = (double *)malloc(sizeof(double) * 5 * num_processes);
+    MPI_Gather(local, 5, MPI_DOUBLE, all, 5, MPI_DOUBLE, 0, comm);
+
+    if (rank == 0)
+    {
+        const double micro_per_step = run->steps > 0 ? (double)run->micro_batches / run->steps : 0.0;
+        printf("\n========== PIPELINE (%d stages x %d replicas, 1F1B) ==========\n", pp->stages, pp->dp_size);
+        printf("%-6s %-8s %9s %12s %12s %9s\n", "Stage", "Layers", "In flight", "Compute(ms)", "Bubble(ms)", "Bubble%");
+
+        double slowest_ms = 0.0, samples = 0.0;
+        for (int s = 0; s < pp->stages; s++)
+        {
+            // Mean over the replicas of the stage
+            double compute = 0.0, wait = 0.0, step = 0.0;
+            int replicas = 0;
+            for (int r = 0; r < num_processes; r++)
+            {
+                const double *v = &all[5 * r];
+                if ((int)v[0] != s)
+                    continue;
+                compute += v[1];
+                wait += v[2];
+                step += v[3];
+                replicas++;
+                if (v[3] > slowest_ms)
+                    slowest_ms = v[3];
+                if (s == 0)
+                    samples += v[4];
+            }
+            compute /= replicas;
+            wait /= replicas;
+            step /= replicas;
+
+            char layers[16];
+            snprintf(layers, sizeof(layers), "%d-%d", pp->first_layer[s] + 1, pp->first_layer[s + 1]);
+            printf("%-6d %-8s %9d %12.2f %12.2f %8.1f%%\n", s, layers, pp->stages - s, compute, wait,
+                   step > 0.0 ? 100.0 * wait / step : 0.0);
+        }
+
+        const double ideal = micro_per_step > 0 ? (pp->stages - 1) / (micro_per_step + pp->stages - 1) : 0.0;
+        printf("Micro-batches per step: %.1f (ideal 1F1B bubble: %.1f%%)\n", micro_per_step, 100.0 * ideal);
+        printf("Throughput: %.1f samples/s (%.0f samples, %.2f s in pipeline steps on the slowest rank)\n",
+               slowest_ms > 0.0 ? samples / (slowest_ms / 1000.0) : 0.0, samples, slowest_ms / 1000.0);
+        printf("==============================================================\n");
+        free(all);
+    }
+}
+
+/**
+ * Contiguous layer ranges minimizing the largest stage's multiply-adds (every stage gets a layer)
+ */
+static void split_layers(const int *layer_dims, int L, int stages, int *first_layer)
+{
+    // best[s][l]: smallest maximum stage cost splitting layers 0 .. l - 1 into s stages
+    double *best = (double *)malloc(sizeof(double) * (stages + 1) * (L + 1));
+    int *cut = (int *)malloc(sizeof(int) * (stages + 1) * (L + 1));
+#define BEST(s, l) best[(s) * (L + 1) + (l)]
+#define CUT(s, l) cut[(s) * (L + 1) + (l)]
+
+    for (int l = 1; l <= L; l++)
+    {
+        BEST(1, l) = BEST(1, l - 1) * (l > 1) + (double)layer_dims[l - 1] * layer_dims[l];
+        CUT(1, l) = 0;
+    }
+    for (int s = 2; s <= stages; s++)
+        for (int l = s; l <= L; l++)
+        {
+            BEST(s, l) = -1.0;
+            double last = 0.0;
+            for (int c = l - 1; c >= s - 1; c--)
+            {
+                // Layers c .. l - 1 in stage s
+                last += (double)layer_dims[c] * layer_dims[c + 1];
+                double worst = BEST(s - 1, c) > last ? BEST(s - 1, c) : last;
+                if (BEST(s, l) < 0.0 || worst < BEST(s, l))
+                {
+                    BEST(s, l) = worst;
+                    CUT(s, l) = c;
+                }
+            }
+        }
+
+    first_layer[stages] = L;
+    for (int s = stages, l = L; s >= 1; s--)
+    {
+        first_layer[s - 1] = CUT(s, l);
+        l = CUT(s, l);
+    }
+
+#undef BEST
+#undef CUT
+    free(best);
+    free(cut);
+}
+
+static int micro_size(const pipe_runner *run, int count, int micro)
+{
+    const int start = micro * run->micro_batch_size;
+    return start + run->micro_batch_size <= count ? run->micro_batch_size : count - start;
+}
+
+static void wait_request(pipe_runner *run, MPI_Request *request)
+{
+    if (*request == MPI_REQUEST_NULL)
+        return;
+    TRACE_BEGIN(trace_begin_us);
+    timer_t_custom timer;
+    TIMER_START(timer);
+    MPI_Wait(request, MPI_STATUS_IGNORE);
+    TIMER_STOP(timer);
+    ACCUM_ADD(g_comm_pipeline_time, timer);
+    run->wait_ms += timer.elapsed_ms;
+    TRACE_END(trace_begin_us, "pipe_wait", "mpi");
+}
+
+static void pipe_forward(pipe_runner *run, const matrix *X, const matrix *Y, int start, int count,
+                         int micro, const nn_params *stage_params, double *cost)
+{
+    const pipe_group *pp = run->pp;
+    exec_plan *plan = &run->plan;
+    const int slot = micro % run->num_slabs;
+    double *slab = run->slabs[slot];
+    const int n = micro_size(run, count, micro);
+    const int first = start + micro * run->micro_batch_size;
+
+    // The slab's previous micro-batch may still be sending its input gradient
+    wait_request(run, &run->send[slot]);
+
+    matrix input = plan_view(plan, slab, plan->input, n);
+    if (pp->stage == 0)
+    {
+        for (int i = 0; i < X->rows; i++)
+            for (int j = 0; j < n; j++)
+                input.val[i * n + j] = X->val[(size_t)i * X->cols + first + j];
+    }
+    else
+    {
+        wait_request(run, &run->recv[slot]);
+    }
+
+    timer_t_custom timer;
+    TIMER_START(timer);
+    matrix AL = L_model_forward_plan(plan, slab, &input, stage_params);
+    TIMER_STOP(timer);
+    ACCUM_ADD(g_forward_time, timer);
+    run->compute_ms += timer.elapsed_ms;
+
+    if (plan->last_stage)
+    {
+        TIMER_START(timer);
+        matrix Y_view = run->Y_batch;
+        Y_view.cols = n;
+        for (int i = 0; i < Y->rows; i++)
+            for (int j = 0; j < n; j++)
+                Y_view.val[i * n + j] = Y->val[(size_t)i * Y->cols + first + j];
+        *cost += (double)n / count * compute_cost(&AL, &Y_view);
+        TIMER_STOP(timer);
+        ACCUM_ADD(g_cost_time, timer);
+        run->compute_ms += timer.elapsed_ms;
+    }
+
+    // Output to the next stage, whose dZ comes back into the slab
+    if (!plan->last_stage)
+    {
+        matrix dZ = plan_view(plan, slab, plan->grad[plan->L - 1], n);
+        MPI_Isend(AL.val, AL.rows * n, MPI_DOUBLE, pp->stage + 1, TAG_ACTIVATION, pp->comm, &run->send[slot]);
+        MPI_Irecv(dZ.val, dZ.rows * n, MPI_DOUBLE, pp->stage + 1, TAG_GRADIENT, pp->comm, &run->recv[slot]);
+    }
+}
+
+static void pipe_backward(pipe_runner *run, int count, int micro, int num_micro,
+                          const nn_params *stage_params, nn_grads *stage_grads)
+{
+    const pipe_group *pp = run->pp;
+    const exec_plan *plan = &run->plan;
+    const int slot = micro % run->num_slabs;
+    double *slab = run->slabs[slot];
+    const int n = micro_size(run, count, micro);
+
+    // The output's dZ, and the output itself off the wire (backward buffers may reuse its memory)
+    wait_request(run, &run->recv[slot]);
+    wait_request(run, &run->send[slot]);
+
+    timer_t_custom timer;
+    TIMER_START(timer);
+    matrix input = plan_view(plan, slab, plan->input, n);
+    matrix Y_view = run->Y_batch;
+    Y_view.cols = n;
+    L_model_backward_plan(plan, slab, &input, &Y_view, stage_params, stage_grads, (double)n / count);
+    TIMER_STOP(timer);
+    ACCUM_ADD(g_backward_time, timer);
+    run->compute_ms += timer.elapsed_ms;
+
+    if (pp->stage > 0)
+    {
+        // dZ of the previous stage's output, then the slab's next input (the input buffer is never shared)
+        matrix dZ_input = plan_view(plan, slab, plan->input_grad, n);
+        MPI_Isend(dZ_input.val, dZ_input.rows * n, MPI_DOUBLE, pp->stage - 1, TAG_GRADIENT, pp->comm, &run->send[slot]);
+
+        const int next = micro + run->num_slabs;
+        if (next < num_micro)
+        {
+            matrix next_input = plan_view(plan, slab, plan->input, micro_size(run, count, next));
+            MPI_Irecv(next_input.val, next_input.rows * next_input.cols, MPI_DOUBLE, pp->stage - 1, TAG_ACTIVATION,
+                      pp->comm, &run->recv[slot]);
+        }
+    }
+}
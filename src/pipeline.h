@@ -0,0 +1,72 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <mpi.h>
+#include "matrix.h"
+#include "nn.h"
+#include "plan.h"
+
+// Pipeline parallelism
+// Ranks form pipelines of consecutive ranks, one stage per rank, and each stage owns a contiguous
+// range of layers (split to balance their multiply-adds). The stages of a pipeline hold the same
+// data shard (the first stage reads X, the last Y) and stream the micro-batches of every mini-batch
+// with a 1F1B schedule: after a warm-up of forwards, every stage alternates one forward and one
+// backward, so at most (stages - stage) micro-batches are in flight on a stage, each in its own slab
+// of the stage's plan. Activations and gradients move between stages with non-blocking
+// point-to-point messages. Ranks at the same stage of every pipeline form a data-parallel
+// communicator over which the stage's gradients are averaged.
+
+typedef struct
+{
+    int stages;       // Ranks per pipeline (1 = no pipelining)
+    int stage;        // This rank's stage
+    MPI_Comm comm;    // The pipeline
+    int dp_size;      // Number of pipelines (data-parallel replicas)
+    int dp_rank;      // Pipeline index
+    MPI_Comm dp_comm; // Ranks at the same stage of every pipeline
+    int *first_layer; // First layer of every stage (stages + 1 entries, the last one is L)
+} pipe_group;
+
+// Split comm into pipelines of stages ranks (collective; stages must divide the communicator size
+// and be at most L)
+pipe_group pipe_group_create(int stages, const int *layer_dims, int L, MPI_Comm comm);
+void pipe_group_free(pipe_group *pp);
+
+// Broadcast every stage's layers to the whole pipeline, e.g. before evaluating the full model
+// (collective over the pipeline)
+void pipe_share_params(const pipe_group *pp, nn_params *params);
+
+// Executor of the 1F1B schedule on one stage
+typedef struct
+{
+    const pipe_group *pp;
+    exec_plan plan; // The stage's layers
+    int micro_batch_size;
+    int num_slabs;         // Most micro-batches in flight
+    double **slabs;        // One per micro-batch in flight
+    MPI_Request *send;     // Per slab: output or input gradient in flight
+    MPI_Request *recv;     // Per slab: input (forward) or output gradient (backward) in flight
+    matrix Y_batch;        // Labels of the current micro-batch (last stage)
+
+    // Totals over all steps
+    double compute_ms; // Forward and backward work
+    double wait_ms;    // Blocked on the neighbouring stages (the stage's bubble)
+    double step_ms;    // Wall time of the steps
+    long samples;      // Samples through the pipeline
+    int micro_batches;
+    int steps;
+} pipe_runner;
+
+void pipe_runner_init(pipe_runner *run, const pipe_group *pp, const int *layer_dims, int L, int micro_batch_size);
+void pipe_runner_destroy(pipe_runner *run);
+
+// Stream one mini-batch (the replica's samples start + 1 .. start + count of X and Y) through the
+// pipeline. The mean gradients of the stage's layers over the mini-batch are added to stage_grads;
+// returns the mini-batch's mean cost on the last stage (0 on the others)
+double pipe_step(pipe_runner *run, const matrix *X, const matrix *Y, int start, int count,
+                 const nn_params *stage_params, nn_grads *stage_grads);
+
+// Work, bubble time and throughput of every stage, printed on rank 0 (collective over comm)
+void pipe_report(const pipe_runner *run, MPI_Comm comm);
+
+#endif // PIPELINE_H
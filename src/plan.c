@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "plan.h"
+#include "alloc.h"
+#include "autotune.h"
+
+static const char *op_names[OP_KIND_COUNT] = {
+    "gather", "linear", "allgather", "relu", "softmax", "cost", "argmax",
+    "output_grad", "input_grad", "weight_grad", "bias_grad", "send", "recv"};
+
+// Helper functions
+static exec_plan build(plan_mode mode, const int *layer_dims, int L, int batch, const tp_group *tp,
+                       int first_layer, int pipelined, int last_stage);
+static int add_buffer(exec_plan *plan, const char *name, int layer, int rows, int cols);
+static void add_op(exec_plan *plan, plan_op_kind kind, int layer, int stage, int input0, int input1, int output, int temp);
+static void mark_live(exec_plan *plan, int buffer, int stage);
+static void place_buffers(exec_plan *plan);
+static int compare_by_size(const void *a, const void *b);
+
+// Buffer table used by compare_by_size
+static const plan_buffer *sort_buffers;
+
+exec_plan plan_build(plan_mode mode, const int *layer_dims, int L, int batch, const tp_group *tp)
+{
+    return build(mode, layer_dims, L, batch, tp, 0, 0, 1);
+}
+
+exec_plan plan_build_stage(const int *layer_dims, int L, int first, int last, int batch)
+{
+    assert(0 <= first && first < last && last <= L);
+    return build(PLAN_TRAINING, layer_dims + first, last - first, batch, NULL, first, 1, last == L);
+}
+
+static exec_plan build(plan_mode mode, const int *layer_dims, int L, int batch, const tp_group *tp,
+                       int first_layer, int pipelined, int last_stage)
+{
+    exec_plan plan;
+    memset(&plan, 0, sizeof(plan));
+    plan.mode = mode;
+    plan.L = L;
+    plan.batch = batch;
+    plan.input = -1;
+    plan.logits = -1;
+    plan.shard = -1;
+    plan.input_grad = -1;
+    plan.first_layer = first_layer;
+    plan.pipelined = pipelined;
+    plan.last_stage = last_stage;
+    plan.tp = (mode == PLAN_TRAINING && tp && tp->size > 1) ? tp : NULL;
+    assert(!plan.tp || L > 1);
+
+    // At most 4 buffers and 5 ops per layer, plus the input and output buffers and ops
+    // (and the shard buffer and allgather op of a split layer 0, or a pipeline stage's transfers)
+    plan.buffers = (plan_buffer *)malloc(sizeof(plan_buffer) * (4 * L + 3));
+    plan.ops = (plan_op *)malloc(sizeof(plan_op) * (5 * L + 6));
+    plan.scratch = (int *)malloc(sizeof(int) * L);
+    plan.act = (int *)malloc(sizeof(int) * L);
+    plan.grad = (int *)malloc(sizeof(int) * L);
+    for (int l = 0; l < L; l++)
+        plan.scratch[l] = plan.act[l] = plan.grad[l] = -1;
+
+    plan.dims = (int *)malloc(sizeof(int) * (L + 1));
+    plan.variant = (int *)malloc(sizeof(int) * L);
+    plan.layer_ms = (double *)calloc(L, sizeof(double));
+    plan.layer_flops = (double *)calloc(L, sizeof(double));
+    plan.layer_calls = (int *)calloc(L, sizeof(int));
+    for (int l = 0; l <= L; l++)
+        plan.dims[l] = layer_dims[l];
+    for (int l = 0; l < L; l++)
+        plan.variant[l] = mode == PLAN_TRAINING ? gemm_select_variant(plan_layer_rows(&plan, l), layer_dims[l], batch)
+                                                : GEMM_GENERIC;
+    plan.grain_dW = (int *)malloc(sizeof(int) * L);
+    plan.grain_dA = (int *)malloc(sizeof(int) * L);
+    for (int l = 0; l < L; l++)
+    {
+        plan.grain_dW[l] = tune_grainsize(TUNE_BACKWARD_WEIGHT, plan_layer_rows(&plan, l), batch, layer_dims[l]);
+        // The network's input gets no gradient (a later pipeline stage's input does)
+        plan.grain_dA[l] = l > 0 || (pipelined && first_layer > 0)
+                               ? tune_grainsize(TUNE_BACKWARD_INPUT, l == 1 ? plan_layer_rows(&plan, 0) : layer_dims[l],
+                                                layer_dims[l + 1], batch)
+                               : 0;
+    }
+
+    int stage = 0;
+    if (mode == PLAN_INFERENCE)
+    {
+        plan.input = add_buffer(&plan, "X", -1, layer_dims[0], batch);
+        add_op(&plan, OP_GATHER, -1, stage++, -1, -1, plan.input, -1);
+
+        for (int l = 0; l < L; l++)
+        {
+            plan.act[l] = add_buffer(&plan, "A", l, layer_dims[l + 1], batch);
+            add_op(&plan, OP_LINEAR, l, stage++, l == 0 ? plan.input : plan.act[l - 1], -1, plan.act[l], -1);
+        }
+        add_op(&plan, OP_ARGMAX, L - 1, stage++, plan.act[L - 1], -1, -1, -1);
+    }
+    else
+    {
+        // A pipeline stage keeps its input in the slab (gathered on the first stage, received on
+        // the others), as every micro-batch in flight needs its own copy until its backward
+        int input = -1;
+        if (pipelined)
+        {
+            plan.input = input = add_buffer(&plan, "In", -1, layer_dims[0], batch);
+            add_op(&plan, first_layer == 0 ? OP_GATHER : OP_RECV, -1, stage++, -1, -1, plan.input, -1);
+        }
+
+        // Forward: hidden layers apply ReLU in place, so their backward mask is A > 0 (same as Z > 0)
+        for (int l = 0; l < L; l++)
+        {
+            plan.scratch[l] = add_buffer(&plan, "At", l, batch, layer_dims[l]);
+            plan.act[l] = add_buffer(&plan, "A", l, layer_dims[l + 1], batch);
+            if (l == 0 && plan.tp)
+            {
+                plan.shard = add_buffer(&plan, "S", l, plan.tp->row_count, batch);
+                add_op(&plan, OP_LINEAR, l, stage++, input, -1, plan.shard, plan.scratch[l]);
+                add_op(&plan, OP_ALLGATHER, l, stage++, plan.shard, -1, plan.act[l], -1);
+                add_op(&plan, OP_RELU, l, stage++, plan.act[l], -1, plan.act[l], -1);
+            }
+            else if (l < L - 1 || !last_stage)
+            {
+                add_op(&plan, OP_LINEAR, l, stage++, l == 0 ? input : plan.act[l - 1], -1, plan.act[l], plan.scratch[l]);
+                add_op(&plan, OP_RELU, l, stage++, plan.act[l], -1, plan.act[l], -1);
+            }
+            else
+            {
+                plan.logits = add_buffer(&plan, "Z", l, layer_dims[l + 1], batch);
+                add_op(&plan, OP_LINEAR, l, stage++, l == 0 ? input : plan.act[l - 1], -1, plan.logits, plan.scratch[l]);
+                add_op(&plan, OP_SOFTMAX, l, stage++, plan.logits, -1, plan.act[l], -1);
+            }
+        }
+
+        // Backward starts from the output gradient, computed here on the last stage; any other stage
+        // sends its output on and receives the output's dZ back (both in flight together)
+        plan.grad[L - 1] = add_buffer(&plan, "dZ", L - 1, layer_dims[L], batch);
+        if (last_stage)
+        {
+            add_op(&plan, OP_COST, L - 1, stage++, plan.act[L - 1], -1, -1, -1);
+            add_op(&plan, OP_OUTPUT_GRAD, L - 1, stage++, plan.act[L - 1], -1, plan.grad[L - 1], -1);
+        }
+        else
+        {
+            add_op(&plan, OP_SEND, L - 1, stage, plan.act[L - 1], -1, -1, -1);
+            add_op(&plan, OP_RECV, L - 1, stage++, -1, -1, plan.grad[L - 1], -1);
+        }
+
+        // Then one task-graph stage for everything else (with the input's gradient for the
+        // previous stage, masked by its ReLU output, which is this stage's input)
+        for (int l = L - 1; l >= 0; l--)
+        {
+            if (l > 0)
+            {
+                plan.grad[l - 1] = add_buffer(&plan, "dZ", l - 1, plan_layer_rows(&plan, l - 1), batch);
+                add_op(&plan, OP_INPUT_GRAD, l, stage, plan.grad[l], plan.act[l - 1], plan.grad[l - 1], -1);
+            }
+            else if (pipelined && first_layer > 0)
+            {
+                plan.input_grad = add_buffer(&plan, "dIn", -1, layer_dims[0], batch);
+                add_op(&plan, OP_INPUT_GRAD, l, stage, plan.grad[l], input, plan.input_grad, -1);
+            }
+            add_op(&plan, OP_WEIGHT_GRAD, l, stage, plan.grad[l], l == 0 ? input : plan.act[l - 1], -1, -1);
+            add_op(&plan, OP_BIAS_GRAD, l, stage, plan.grad[l], -1, -1, -1);
+        }
+        stage++;
+
+        if (plan.input_grad >= 0)
+            add_op(&plan, OP_SEND, -1, stage++, plan.input_grad, -1, -1, -1);
+    }
+    plan.num_stages = stage;
+
+    // Lower bound: the most memory live at any one stage
+    for (int s = 0; s < plan.num_stages; s++)
+    {
+        size_t live = 0;
+        for (int b = 0; b < plan.num_buffers; b++)
+            if (plan.buffers[b].first_stage <= s && s <= plan.buffers[b].last_stage)
+                live += plan.buffers[b].bytes;
+        if (live > plan.peak_bytes)
+            plan.peak_bytes = live;
+    }
+
+    place_buffers(&plan);
+    return plan;
+}
+
+int plan_layer_rows(const exec_plan *plan, int l)
+{
+    return (l == 0 && plan->tp) ? plan->tp->row_count : plan->dims[l + 1];
+}
+
+void plan_destroy(exec_plan *plan)
+{
+    free(plan->ops);
+    free(plan->buffers);
+    free(plan->scratch);
+    free(plan->act);
+    free(plan->grad);
+    free(plan->dims);
+    free(plan->variant);
+    free(plan->grain_dW);
+    free(plan->grain_dA);
+    free(plan->layer_ms);
+    free(plan->layer_flops);
+    free(plan->layer_calls);
+    plan->ops = NULL;
+    plan->buffers = NULL;
+    plan->scratch = plan->act = plan->grad = NULL;
+    plan->dims = plan->variant = plan->grain_dW = plan->grain_dA = plan->layer_calls = NULL;
+    plan->layer_ms = plan->layer_flops = NULL;
+    plan->num_ops = plan->num_buffers = 0;
+}
+
+void plan_print(const exec_plan *plan)
+{
+    printf("Execution plan (%s, batch %d): %d ops in %d stages, %d buffers\n",
+           plan->mode == PLAN_TRAINING ? "training" : "inference", plan->batch,
+           plan->num_ops, plan->num_stages, plan->num_buffers);
+    if (plan->pipelined)
+        printf("  Pipeline stage with layers %d-%d\n", plan->first_layer + 1, plan->first_layer + plan->L);
+
+    for (int i = 0; i < plan->num_ops; i++)
+    {
+        const plan_op *op = &plan->ops[i];
+        printf("  [stage %2d] %-12s", op->stage, op_names[op->kind]);
+        if (op->layer >= 0)
+            printf(" layer %d ", plan->first_layer + op->layer + 1);
+        else
+            printf("         ");
+        for (int k = 0; k < PLAN_MAX_OP_INPUTS; k++)
+            if (op->inputs[k] >= 0)
+                printf(" %s", plan->buffers[op->inputs[k]].name);
+        if (op->output >= 0)
+            printf(" -> %s", plan->buffers[op->output].name);
+        if (op->temp >= 0)
+            printf(" (scratch %s)", plan->buffers[op->temp].name);
+        if (op->kind == OP_LINEAR && plan->mode == PLAN_TRAINING)
+            printf(" [%s]", gemm_variant_name((gemm_variant)plan->variant[op->layer]));
+        if (op->kind == OP_WEIGHT_GRAD && plan->grain_dW[op->layer] > 0)
+            printf(" [%d rows/task]", plan->grain_dW[op->layer]);
+        if (op->kind == OP_INPUT_GRAD && plan->grain_dA[op->layer] > 0)
+            printf(" [%d rows/task]", plan->grain_dA[op->layer]);
+        printf("\n");
+    }
+
+    printf("  %-6s %12s %10s %8s %10s\n", "Buffer", "Shape", "KB", "Stages", "Offset KB");
+    for (int b = 0; b < plan->num_buffers; b++)
+    {
+        const plan_buffer *buf = &plan->buffers[b];
+        char shape[32], stages[16];
+        snprintf(shape, sizeof(shape), "%dx%d", buf->rows, buf->cols);
+        snprintf(stages, sizeof(stages), "%d-%d", buf->first_stage, buf->last_stage);
+        printf("  %-6s %12s %10.1f %8s %10.1f\n", buf->name, shape, buf->bytes / 1024.0, stages, buf->offset / 1024.0);
+    }
+
+    printf("  Activation memory: %.2f MB separately, %.2f MB peak live, %.2f MB slab\n",
+           plan->naive_bytes / (1024.0 * 1024.0), plan->peak_bytes / (1024.0 * 1024.0),
+           plan->slab_bytes / (1024.0 * 1024.0));
+}
+
+void plan_print_layer_timing(const exec_plan *plan)
+{
+    printf("Forward time per layer (rank 0):\n");
+    printf("  %-6s %-18s %-8s %8s %12s %10s %9s\n", "Layer", "Shape (MxKxN)", "Variant", "Calls", "Total(ms)", "Avg(ms)", "GFLOP/s");
+    for (int l = 0; l < plan->L; l++)
+    {
+        char shape[32];
+        snprintf(shape, sizeof(shape), "%dx%dx%d", plan_layer_rows(plan, l), plan->dims[l], plan->batch);
+        printf("  %-6d %-18s %-8s %8d %12.3f %10.3f %9.2f\n", plan->first_layer + l + 1, shape,
+               gemm_variant_name((gemm_variant)plan->variant[l]), plan->layer_calls[l], plan->layer_ms[l],
+               plan->layer_calls[l] > 0 ? plan->layer_ms[l] / plan->layer_calls[l] : 0.0,
+               plan->layer_ms[l] > 0.0 ? plan->layer_flops[l] / (plan->layer_ms[l] * 1e6) : 0.0);
+    }
+}
+
+double *plan_alloc_slab(const exec_plan *plan)
+{
+    double *slab = (double *)alloc_first_touch(plan->slab_bytes);
+    assert(slab != NULL);
+    return slab;
+}
+
+matrix plan_view(const exec_plan *plan, double *slab, int buffer, int cols)
+{
+    const plan_buffer *buf = &plan->buffers[buffer];
+    assert(cols <= plan->batch);
+
+    matrix view;
+    view.rows = buf->rows;
+    view.cols = cols;
+
+    // Transposed layer inputs hold one sample per row
+    for (int l = 0; l < plan->L; l++)
+    {
+        if (plan->scratch[l] == buffer)
+        {
+            view.rows = cols;
+            view.cols = buf->cols;
+        }
+    }
+    view.val = (double *)((char *)slab + buf->offset);
+    return view;
+}
+
+static int add_buffer(exec_plan *plan, const char *name, int layer, int rows, int cols)
+{
+    plan_buffer *buf = &plan->buffers[plan->num_buffers];
+    if (layer >= 0)
+        snprintf(buf->name, sizeof(buf->name), "%s%d", name, plan->first_layer + layer + 1);
+    else
+        snprintf(buf->name, sizeof(buf->name), "%s", name);
+    buf->rows = rows;
+    buf->cols = cols;
+    buf->bytes = ((size_t)rows * cols * sizeof(double) + ALLOC_ALIGNMENT - 1) / ALLOC_ALIGNMENT * ALLOC_ALIGNMENT;
+    buf->first_stage = -1;
+    buf->last_stage = -1;
+    buf->offset = 0;
+    plan->naive_bytes += buf->bytes;
+    return plan->num_buffers++;
+}
+
+static void add_op(exec_plan *plan, plan_op_kind kind, int layer, int stage, int input0, int input1, int output, int temp)
+{
+    plan_op *op = &plan->ops[plan->num_ops++];
+    op->kind = kind;
+    op->layer = layer;
+    op->stage = stage;
+    op->inputs[0] = input0;
+    op->inputs[1] = input1;
+    op->output = output;
+    op->temp = temp;
+
+    mark_live(plan, input0, stage);
+    mark_live(plan, input1, stage);
+    mark_live(plan, output, stage);
+    mark_live(plan, temp, stage);
+}
+
+static void mark_live(exec_plan *plan, int buffer, int stage)
+{
+    if (buffer < 0)
+        return;
+    plan_buffer *buf = &plan->buffers[buffer];
+    if (buf->first_stage < 0 || stage < buf->first_stage)
+        buf->first_stage = stage;
+    if (stage > buf->last_stage)
+        buf->last_stage = stage;
+}
+
+/**
+ * Greedy offset assignment: largest buffer first, each at the lowest offset that doesn't
+ * overlap a placed buffer with an overlapping lifetime
+ */
+static void place_buffers(exec_plan *plan)
+{
+    const int n = plan->num_buffers;
+    int *order = (int *)malloc(sizeof(int) * n);
+    int *placed = (int *)malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++)
+        order[i] = i;
+    sort_buffers = plan->buffers;
+    qsort(order, n, sizeof(int), compare_by_size);
+
+    int num_placed = 0;
+    plan->slab_bytes = 0;
+    for (int i = 0; i < n; i++)
+    {
+        plan_buffer *buf = &plan->buffers[order[i]];
+        size_t offset = 0;
+
+        // Move past every conflicting placed buffer until a gap fits (repeat until stable)
+        int moved = 1;
+        while (moved)
+        {
+            moved = 0;
+            for (int p = 0; p < num_placed; p++)
+            {
+                const plan_buffer *other = &plan->buffers[placed[p]];
+                int live_together = buf->first_stage <= other->last_stage && other->first_stage <= buf->last_stage;
+                int overlap = offset < other->offset + other->bytes && other->offset < offset + buf->bytes;
+                if (live_together && overlap)
+                {
+                    offset = other->offset + other->bytes;
+                    moved = 1;
+                }
+            }
+        }
+
+        buf->offset = offset;
+        placed[num_placed++] = order[i];
+        if (offset + buf->bytes > plan->slab_bytes)
+            plan->slab_bytes = offset + buf->bytes;
+    }
+
+    free(order);
+    free(placed);
+}
+
+static int compare_by_size(const void *a, const void *b)
+{
+    const plan_buffer *x = &sort_buffers[*(const int *)a];
+    const plan_buffer *y = &sort_buffers[*(const int *)b];
+    if (x->bytes != y->bytes)
+        return x->bytes < y->bytes ? 1 : -1;
+    return *(const int *)a - *(const int *)b;
+}
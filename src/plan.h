@@ -0,0 +1,136 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <stddef.h>
+#include "matrix.h"
+#include "tensor_parallel.h"
+
+// Static execution plan, built once from layer_dims and the batch width
+// Lists every op and every intermediate buffer with its lifetime (first and last stage that uses
+// it), then packs all buffers into one pre-sized slab: buffers whose lifetimes don't overlap share
+// memory (greedy placement, largest buffer first). Ops of the same stage may run concurrently,
+// so the whole backward task graph is a single stage.
+// The ops list describes the schedule (it yields the buffer lifetimes and is what plan_print
+// shows); nothing interprets it. The executors (L_model_forward_plan, L_model_backward_plan,
+// L_model_predict, the pipeline runner) run the same steps in code and take from the plan only
+// the buffer ids, the slab and the kernels bound to every layer.
+// With tensor parallelism, layer 0 computes only this rank's rows (the shard buffer), allgathers
+// them into the full activations and keeps only the matching rows of its dZ.
+
+typedef enum
+{
+    PLAN_TRAINING, // Forward with caches, cost and backward with gradient accumulation
+    PLAN_INFERENCE // Forward only, on chunks of samples, without caches
+} plan_mode;
+
+typedef enum
+{
+    OP_GATHER,      // Copy a chunk of samples into a contiguous block (inference, first pipeline stage)
+    OP_LINEAR,      // Z = W * A_prev + b (inference: followed by ReLU for hidden layers)
+    OP_ALLGATHER,   // Full layer output from every group rank's slice (tensor parallelism)
+    OP_RELU,        // A = relu(Z), in place
+    OP_SOFTMAX,     // AL = softmax(Z)
+    OP_COST,        // Cross-entropy of AL against Y
+    OP_ARGMAX,      // Predicted class of every sample (inference)
+    OP_OUTPUT_GRAD, // dZ = AL - Y
+    OP_INPUT_GRAD,  // dZ_prev = (W^T * dZ) masked by the ReLU of the layer below
+    OP_WEIGHT_GRAD, // dW += scale * dZ * A_prev^T / m
+    OP_BIAS_GRAD,   // db += scale * sum(dZ, axis=1) / m
+    OP_SEND,        // Non-blocking send to the neighbouring pipeline stage
+    OP_RECV,        // Non-blocking receive from the neighbouring pipeline stage
+    OP_KIND_COUNT
+} plan_op_kind;
+
+#define PLAN_MAX_OP_INPUTS 2
+
+typedef struct
+{
+    plan_op_kind kind;
+    int layer;
+    int stage;
+    int inputs[PLAN_MAX_OP_INPUTS]; // Buffer ids (-1 = external: X, Y or parameters)
+    int output;                     // Buffer id (-1 = external)
+    int temp;                       // Scratch buffer used only inside the op (-1 = none)
+} plan_op;
+
+typedef struct
+{
+    char name[16];
+    int rows;
+    int cols;        // At the plan's batch width
+    size_t bytes;    // Padded to the allocation alignment
+    int first_stage;
+    int last_stage;
+    size_t offset;   // Byte offset in the slab
+} plan_buffer;
+
+typedef struct
+{
+    plan_mode mode;
+    int L;
+    int batch;
+    int num_stages;
+    plan_op *ops;
+    int num_ops;
+    plan_buffer *buffers;
+    int num_buffers;
+
+    // Buffer ids by role (-1 where unused)
+    int input;    // Gathered input chunk (inference)
+    int *scratch; // Transposed input of layer l (training)
+    int *act;     // Output of layer l (ReLU in place; softmax output for the last layer)
+    int logits;   // Pre-softmax output of the last layer (training)
+    int *grad;    // dZ of layer l (training; this rank's rows only for a split layer 0)
+    int shard;    // This rank's rows of layer 0's output (tensor parallelism)
+
+    const tp_group *tp; // Group splitting layer 0 (NULL or size 1 = not split)
+
+    // Pipeline stage (see plan_build_stage)
+    int pipelined;   // The input is a buffer of the slab
+    int first_layer; // Network index of the plan's layer 0
+    int last_stage;  // Ends with softmax and the cost (always set without pipelining)
+    int input_grad;  // Masked dZ of the previous stage's output (-1 on the first stage)
+
+    size_t naive_bytes; // Every buffer allocated separately
+    size_t peak_bytes;  // Largest total of buffers live in one stage (lower bound for the slab)
+    size_t slab_bytes;  // Packed slab
+
+    // Forward kernel of layer l, bound once for its shape at the plan's batch width (training; an
+    // inference plan runs the per-chunk dense kernels and leaves every layer generic)
+    int *dims;    // layer_dims (L + 1 entries)
+    int *variant; // gemm_variant of layer l
+
+    // Rows per task of layer l's backward kernels (tuned for the shape, or 0 = sized by the work)
+    int *grain_dW;
+    int *grain_dA;
+
+    // Forward GEMM time per layer, accumulated by L_model_forward_plan
+    double *layer_ms;
+    double *layer_flops;
+    int *layer_calls;
+} exec_plan;
+
+// tp splits layer 0 across a tensor-parallel group (training only; NULL = not split)
+exec_plan plan_build(plan_mode mode, const int *layer_dims, int L, int batch, const tp_group *tp);
+
+// Training plan for one pipeline stage: layers first .. last - 1 of the network. The stage's input
+// is a buffer of the slab (several micro-batches are in flight, one slab each); unless the stage
+// ends the network, its output is sent on and its output's dZ received back, and unless it starts
+// the network, it computes the dZ of the previous stage's output to send back.
+exec_plan plan_build_stage(const int *layer_dims, int L, int first, int last, int batch);
+
+// Rows of layer l's weights held by this rank
+int plan_layer_rows(const exec_plan *plan, int l);
+void plan_destroy(exec_plan *plan);
+void plan_print(const exec_plan *plan);
+
+// Forward time of every layer with the kernel variant it is bound to
+void plan_print_layer_timing(const exec_plan *plan);
+
+// Slab for one executor of the plan (zeroed and aligned; release with alloc_free)
+double *plan_alloc_slab(const exec_plan *plan);
+
+// Buffer as a matrix in a slab, for a batch of cols <= plan->batch samples
+matrix plan_view(const exec_plan *plan, double *slab, int buffer, int cols);
+
+#endif // PLAN_H
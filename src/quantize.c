@@ -0,0 +1,597 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include <mpi.h>
+
+#include "quantize.h"
+#include "config.h"
+#include "alloc.h"
+#include "trace.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define QUANT_X86 1
+#endif
+
+// C[j * rows + i] = sum_k A[j][k] * W[i][k] for n samples of Kp (a multiple of QUANT_K_ALIGN) inputs
+typedef void (*qgemm_fn)(const int8_t *W, int rows, int Kp, const uint8_t *A, int n, int32_t *C);
+
+// Helper functions
+static void qgemm_portable(const int8_t *W, int rows, int Kp, const uint8_t *A, int n, int32_t *C);
+static qgemm_fn select_kernel(const char **name);
+static uint8_t quantize_input(double x, double scale, int zero);
+static int count_matches(const int *predictions, const matrix *Y);
+
+/**
+ * Portable kernel: four rows at a time share every load of a sample's inputs
+ */
+static void qgemm_portable(const int8_t *W, int rows, int Kp, const uint8_t *A, int n, int32_t *C)
+{
+    int i = 0;
+    for (; i + 4 <= rows; i += 4)
+    {
+        const int8_t *W0 = &W[(size_t)i * Kp], *W1 = W0 + Kp, *W2 = W1 + Kp, *W3 = W2 + Kp;
+        for (int j = 0; j < n; j++)
+        {
+            const uint8_t *a = &A[(size_t)j * Kp];
+            int32_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+            for (int k = 0; k < Kp; k++)
+            {
+                const int32_t v = a[k];
+                sum0 += v * W0[k];
+                sum1 += v * W1[k];
+                sum2 += v * W2[k];
+                sum3 += v * W3[k];
+            }
+            int32_t *c = &C[(size_t)j * rows + i];
+            c[0] = sum0;
+            c[1] = sum1;
+            c[2] = sum2;
+            c[3] = sum3;
+        }
+    }
+    for (; i < rows; i++)
+    {
+        const int8_t *W_row = &W[(size_t)i * Kp];
+        for (int j = 0; j < n; j++)
+        {
+            const uint8_t *a = &A[(size_t)j * Kp];
+            int32_t sum = 0;
+            for (int k = 0; k < Kp; k++)
+                sum += (int32_t)a[k] * W_row[k];
+            C[(size_t)j * rows + i] = sum;
+        }
+    }
+}
+
+#ifdef QUANT_X86
+__attribute__((target("avx2,avxvnni"))) static inline int32_t hsum_epi32_256(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+    return _mm_cvtsi128_si32(s);
+}
+
+/**
+ * AVX-VNNI kernel (256-bit vpdpbusd): 32 products per instruction and row, four rows per sample load
+ */
+__attribute__((target("avx2,avxvnni"))) static void qgemm_avx_vnni(const int8_t *W, int rows, int Kp,
+                                                                      const uint8_t *A, int n, int32_t *C)
+{
+    int i = 0;
+    for (; i + 4 <= rows; i += 4)
+    {
+        const int8_t *W0 = &W[(size_t)i * Kp], *W1 = W0 + Kp, *W2 = W1 + Kp, *W3 = W2 + Kp;
+        for (int j = 0; j < n; j++)
+        {
+            const uint8_t *a = &A[(size_t)j * Kp];
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+            for (int k = 0; k < Kp; k += 32)
+            {
+                const __m256i v = _mm256_loadu_si256((const __m256i *)(a + k));
+                acc0 = _mm256_dpbusd_avx_epi32(acc0, v, _mm256_loadu_si256((const __m256i *)(W0 + k)));
+                acc1 = _mm256_dpbusd_avx_epi32(acc1, v, _mm256_loadu_si256((const __m256i *)(W1 + k)));
+                acc2 = _mm256_dpbusd_avx_epi32(acc2, v, _mm256_loadu_si256((const __m256i *)(W2 + k)));
+                acc3 = _mm256_dpbusd_avx_epi32(acc3, v, _mm256_loadu_si256((const __m256i *)(W3 + k)));
+            }
+            int32_t *c = &C[(size_t)j * rows + i];
+            c[0] = hsum_epi32_256(acc0);
+            c[1] = hsum_epi32_256(acc1);
+            c[2] = hsum_epi32_256(acc2);
+            c[3] = hsum_epi32_256(acc3);
+        }
+    }
+    for (; i < rows; i++)
+    {
+        const int8_t *W_row = &W[(size_t)i * Kp];
+        for (int j = 0; j < n; j++)
+        {
+            const uint8_t *a = &A[(size_t)j * Kp];
+            __m256i acc = _mm256_setzero_si256();
+            for (int k = 0; k < Kp; k += 32)
+                acc = _mm256_dpbusd_avx_epi32(acc, _mm256_loadu_si256((const __m256i *)(a + k)),
+                                              _mm256_loadu_si256((const __m256i *)(W_row + k)));
+            C[(size_t)j * rows + i] = hsum_epi32_256(acc);
+        }
+    }
+}
+
+/**
+ * AVX-512 VNNI kernel (512-bit vpdpbusd): 64 products per instruction and row
+ */
+__attribute__((target("avx512f,avx512bw,avx512vnni"))) static void qgemm_avx512_vnni(const int8_t *W, int rows, int Kp,
+                                                                                     const uint8_t *A, int n,
+                                                                                     int32_t *C)
+{
+    int i = 0;
+    for (; i + 4 <= rows; i += 4)
+    {
+        const int8_t *W0 = &W[(size_t)i * Kp], *W1 = W0 + Kp, *W2 = W1 + Kp, *W3 = W2 + Kp;
+        for (int j = 0; j < n; j++)
+        {
+            const uint8_t *a = &A[(size_t)j * Kp];
+            __m512i acc0 = _mm512_setzero_si512(), acc1 = _mm512_setzero_si512();
+            __m512i acc2 = _mm512_setzero_si512(), acc3 = _mm512_setzero_si512();
+            for (int k = 0; k < Kp; k += 64)
+            {
+                const __m512i v = _mm512_loadu_si512((const void *)(a + k));
+                acc0 = _mm512_dpbusd_epi32(acc0, v, _mm512_loadu_si512((const void *)(W0 + k)));
+                acc1 = _mm512_dpbusd_epi32(acc1, v, _mm512_loadu_si512((const void *)(W1 + k)));
+                acc2 = _mm512_dpbusd_epi32(acc2, v, _mm512_loadu_si512((const void *)(W2 + k)));
+                acc3 = _mm512_dpbusd_epi32(acc3, v, _mm512_loadu_si512((const void *)(W3 + k)));
+            }
+            int32_t *c = &C[(size_t)j * rows + i];
+            c[0] = _mm512_reduce_add_epi32(acc0);
+            c[1] = _mm512_reduce_add_epi32(acc1);
+            c[2] = _mm512_reduce_add_epi32(acc2);
+            c[3] = _mm512_reduce_add_epi32(acc3);
+        }
+    }
+    for (; i < rows; i++)
+    {
+        const int8_t *W_row = &W[(size_t)i * Kp];
+        for (int j = 0; j < n; j++)
+        {
+            const uint8_t *a = &A[(size_t)j * Kp];
+            __m512i acc = _mm512_setzero_si512();
+            for (int k = 0; k < Kp; k += 64)
+                acc = _mm512_dpbusd_epi32(acc, _mm512_loadu_si512((const void *)(a + k)),
+                                          _mm512_loadu_si512((const void *)(W_row + k)));
+            C[(size_t)j * rows + i] = _mm512_reduce_add_epi32(acc);
+        }
+    }
+}
+#endif
+
+/**
+ * Widest integer kernel this CPU runs (checked once)
+ */
+static qgemm_fn select_kernel(const char **name)
+{
+    static qgemm_fn kernel = NULL;
+    static const char *kernel_name = "portable";
+    if (!kernel)
+    {
+        qgemm_fn chosen = qgemm_portable;
+        const char *chosen_name = "portable";
+#ifdef QUANT_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512bw"))
+        {
+            chosen = qgemm_avx512_vnni;
+            chosen_name = "avx512-vnni";
+        }
+        else if (__builtin_cpu_supports("avxvnni"))
+        {
+            chosen = qgemm_avx_vnni;
+            chosen_name = "avx-vnni";
+        }
+#endif
+        kernel_name = chosen_name;
+        kernel = chosen;
+    }
+    if (name)
+        *name = kernel_name;
+    return kernel;
+}
+
+const char *quant_kernel_name(void)
+{
+    const char *name;
+    select_kernel(&name);
+    return name;
+}
+
+static uint8_t quantize_input(double x, double scale, int zero)
+{
+    const long q = lrint(x / scale) + zero;
+    return (uint8_t)(q < 0 ? 0 : q > 255 ? 255 : q);
+}
+
+void quantize_model(quant_model *q, const nn_params *params, const matrix *X_calib, MPI_Comm comm)
+{
+    TRACE_BEGIN(trace_begin_us);
+    select_kernel(NULL); // Picked before any parallel forward pass
+    const int L = params->L;
+    const int n = X_calib->cols;
+    q->L = L;
+    q->layers = (quant_layer *)calloc(L, sizeof(quant_layer));
+
+    // Calibration: the double forward pass over the sample, in cache-sized chunks, recording every
+    // layer's input range
+    int widest = X_calib->rows;
+    for (int l = 0; l < L; l++)
+        widest = params->W[l].rows > widest ? params->W[l].rows : widest;
+    double *buf[2];
+    buf[0] = (double *)malloc(sizeof(double) * widest * INFERENCE_CHUNK_SIZE);
+    buf[1] = (double *)malloc(sizeof(double) * widest * INFERENCE_CHUNK_SIZE);
+    for (int start = 0; start < n; start += INFERENCE_CHUNK_SIZE)
+    {
+        const int cn = start + INFERENCE_CHUNK_SIZE <= n ? INFERENCE_CHUNK_SIZE : n - start;
+        for (int k = 0; k < X_calib->rows; k++)
+            memcpy(&buf[0][(size_t)k * cn], &X_calib->val[(size_t)k * n + start], sizeof(double) * cn);
+
+        int cur = 0;
+        for (int l = 0; l < L; l++)
+        {
+            quant_layer *ql = &q->layers[l];
+            const double *in = buf[cur];
+            for (size_t e = 0; e < (size_t)params->W[l].cols * cn; e++)
+            {
+                ql->in_min = fmin(ql->in_min, in[e]);
+                ql->in_max = fmax(ql->in_max, in[e]);
+            }
+            dense_forward_chunk(&params->W[l], &params->b[l], in, cn, buf[1 - cur], l < L - 1);
+            cur = 1 - cur;
+        }
+    }
+    free(buf[0]);
+    free(buf[1]);
+
+    // One range per layer over every rank's sample (shards differ, the quantized model must not)
+    if (comm != MPI_COMM_NULL)
+    {
+        double *range = (double *)malloc(sizeof(double) * 2 * L);
+        for (int l = 0; l < L; l++)
+        {
+            range[l] = q->layers[l].in_min;
+            range[L + l] = q->layers[l].in_max;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, range, L, MPI_DOUBLE, MPI_MIN, comm);
+        MPI_Allreduce(MPI_IN_PLACE, range + L, L, MPI_DOUBLE, MPI_MAX, comm);
+        for (int l = 0; l < L; l++)
+        {
+            q->layers[l].in_min = range[l];
+            q->layers[l].in_max = range[L + l];
+        }
+        free(range);
+    }
+
+    q->max_width = 0;
+    for (int l = 0; l < L; l++)
+    {
+        quant_layer *ql = &q->layers[l];
+        const matrix *W = &params->W[l];
+        ql->rows = W->rows;
+        ql->cols = W->cols;
+        ql->cols_padded = (W->cols + QUANT_K_ALIGN - 1) / QUANT_K_ALIGN * QUANT_K_ALIGN;
+        if (ql->cols_padded > q->max_width)
+            q->max_width = ql->cols_padded;
+        if (ql->rows > q->max_width)
+            q->max_width = ql->rows;
+
+        // Input grid: pixels keep 1/255 exactly; otherwise the calibrated range over 256 levels
+        if (l == 0 && ql->in_min >= 0.0 && ql->in_max <= 1.0)
+        {
+            ql->in_scale = 1.0 / 255.0;
+            ql->in_zero = 0;
+        }
+        else
+        {
+            const double range = ql->in_max - ql->in_min;
+            ql->in_scale = range > 0.0 ? range / 255.0 : 1.0;
+            ql->in_zero = (int)lrint(-ql->in_min / ql->in_scale);
+        }
+
+        ql->W = (int8_t *)alloc_first_touch((size_t)ql->rows * ql->cols_padded);
+        ql->bias = (int32_t *)malloc(sizeof(int32_t) * ql->rows);
+        ql->out_scale = (float *)malloc(sizeof(float) * ql->rows);
+        ql->requant = (float *)malloc(sizeof(float) * ql->rows);
+        for (int i = 0; i < ql->rows; i++)
+        {
+            const double *W_row = &W->val[(size_t)i * W->cols];
+            double max_abs = 0.0;
+            for (int k = 0; k < W->cols; k++)
+                max_abs = fmax(max_abs, fabs(W_row[k]));
+            const double row_scale = max_abs > 0.0 ? max_abs / 127.0 : 1.0;
+
+            int32_t row_sum = 0;
+            for (int k = 0; k < W->cols; k++)
+            {
+                const long w = lrint(W_row[k] / row_scale);
+                ql->W[(size_t)i * ql->cols_padded + k] = (int8_t)(w < -127 ? -127 : w > 127 ? 127 : w);
+                row_sum += ql->W[(size_t)i * ql->cols_padded + k];
+            }
+
+            const double out_scale = row_scale * ql->in_scale;
+            ql->bias[i] = (int32_t)lrint(params->b[l].val[i] / out_scale) - ql->in_zero * row_sum;
+            ql->out_scale[i] = (float)out_scale;
+        }
+    }
+
+    // Hidden outputs are requantized straight onto the next layer's input grid
+    for (int l = 0; l < L - 1; l++)
+        for (int i = 0; i < q->layers[l].rows; i++)
+            q->layers[l].requant[i] = (float)(q->layers[l].out_scale[i] / q->layers[l + 1].in_scale);
+
+    const quant_layer *first = &q->layers[0];
+    q->pixel_grid = first->in_scale == 1.0 / 255.0 && first->in_zero == 0;
+    for (int p = 0; p < 256; p++)
+        q->pixel_lut[p] = quantize_input(p / 255.0, first->in_scale, first->in_zero);
+    TRACE_END(trace_begin_us, "quantize_model", "inference");
+}
+
+void delete_quant_model(quant_model *q)
+{
+    for (int l = 0; l < q->L; l++)
+    {
+        alloc_free(q->layers[l].W);
+        free(q->layers[l].bias);
+        free(q->layers[l].out_scale);
+        free(q->layers[l].requant);
+    }
+    free(q->layers);
+    q->layers = NULL;
+    q->L = 0;
+}
+
+quant_workspace quant_workspace_create(const quant_model *q, int chunk)
+{
+    quant_workspace ws;
+    ws.chunk = chunk;
+    ws.act[0] = (uint8_t *)alloc_first_touch((size_t)chunk * q->max_width);
+    ws.act[1] = (uint8_t *)alloc_first_touch((size_t)chunk * q->max_width);
+    ws.acc = (int32_t *)alloc_first_touch(sizeof(int32_t) * chunk * q->max_width);
+    return ws;
+}
+
+void quant_workspace_free(quant_workspace *ws)
+{
+    alloc_free(ws->act[0]);
+    alloc_free(ws->act[1]);
+    alloc_free(ws->acc);
+}
+
+void quant_load_matrix(const quant_model *q, quant_workspace *ws, const matrix *X, int start, int n)
+{
+    // Rows of X are read in order; the transposed writes stay in the (cache-resident) workspace
+    const quant_layer *first = &q->layers[0];
+    uint8_t *a = ws->act[0];
+    for (int k = 0; k < first->cols; k++)
+    {
+        const double *X_row = &X->val[(size_t)k * X->cols + start];
+        for (int j = 0; j < n; j++)
+            a[(size_t)j * first->cols_padded + k] = quantize_input(X_row[j], first->in_scale, first->in_zero);
+    }
+    for (int j = 0; j < n; j++)
+        memset(a + (size_t)j * first->cols_padded + first->cols, 0, first->cols_padded - first->cols);
+}
+
+void quant_load_images(const quant_model *q, quant_workspace *ws, const uint8_t *images, size_t stride, int n)
+{
+    const quant_layer *first = &q->layers[0];
+    for (int j = 0; j < n; j++)
+    {
+        const uint8_t *image = images + (size_t)j * stride;
+        uint8_t *a = &ws->act[0][(size_t)j * first->cols_padded];
+        if (q->pixel_grid)
+        {
+            memcpy(a, image, first->cols);
+        }
+        else
+        {
+            for (int k = 0; k < first->cols; k++)
+                a[k] = q->pixel_lut[image[k]];
+        }
+        memset(a + first->cols, 0, first->cols_padded - first->cols);
+    }
+}
+
+void quant_forward(const quant_model *q, quant_workspace *ws, int n, double *logits, int *classes)
+{
+    qgemm_fn qgemm = select_kernel(NULL);
+    int cur = 0;
+    for (int l = 0; l < q->L; l++)
+    {
+        const quant_layer *ql = &q->layers[l];
+        qgemm(ql->W, ql->rows, ql->cols_padded, ws->act[cur], n, ws->acc);
+
+        if (l < q->L - 1)
+        {
+            // ReLU and requantization onto the next input grid (zero point 0), padding zeroed
+            const int next_padded = q->layers[l + 1].cols_padded;
+            uint8_t *next = ws->act[1 - cur];
+            for (int j = 0; j < n; j++)
+            {
+                const int32_t *c = &ws->acc[(size_t)j * ql->rows];
+                uint8_t *a = &next[(size_t)j * next_padded];
+                for (int i = 0; i < ql->rows; i++)
+                {
+                    const float v = (float)(c[i] + ql->bias[i]) * ql->requant[i];
+                    a[i] = v <= 0.0f ? 0 : v >= 255.0f ? 255 : (uint8_t)(v + 0.5f);
+                }
+                memset(a + ql->rows, 0, next_padded - ql->rows);
+            }
+            cur = 1 - cur;
+        }
+        else
+        {
+            for (int j = 0; j < n; j++)
+            {
+                const int32_t *c = &ws->acc[(size_t)j * ql->rows];
+                int pred_class = 0;
+                double max_val = 0.0;
+                for (int i = 0; i < ql->rows; i++)
+                {
+                    const double z = (double)(c[i] + ql->bias[i]) * ql->out_scale[i];
+                    if (logits)
+                        logits[(size_t)i * n + j] = z;
+                    if (i == 0 || z > max_val)
+                    {
+                        max_val = z;
+                        pred_class = i;
+                    }
+                }
+                if (classes)
+                    classes[j] = pred_class;
+            }
+        }
+    }
+}
+
+void quant_predict(const quant_model *q, const matrix *X, quant_workspace *ws, int num_workspaces, int *predictions)
+{
+    const int m = X->cols;
+    const int chunk_size = ws[0].chunk;
+    const int num_chunks = (m + chunk_size - 1) / chunk_size;
+
+#pragma omp parallel num_threads(num_workspaces)
+    {
+        quant_workspace *thread_ws = &ws[omp_get_thread_num()];
+
+#pragma omp for schedule(dynamic)
+        for (int chunk = 0; chunk < num_chunks; chunk++)
+        {
+            TRACE_BEGIN(trace_begin_us);
+            const int start = chunk * chunk_size;
+            const int n = (start + chunk_size <= m) ? chunk_size : m - start;
+            quant_load_matrix(q, thread_ws, X, start, n);
+            quant_forward(q, thread_ws, n, NULL, &predictions[start]);
+            TRACE_END(trace_begin_us, "quant_predict_chunk", "inference");
+        }
+    }
+}
+
+/**
+ * Number of predictions equal to the true class (argmax of the one-hot columns of Y)
+ */
+static int count_matches(const int *predictions, const matrix *Y)
+{
+    int correct = 0;
+    for (int j = 1; j <= Y->cols; j++)
+    {
+        int true_class = 0;
+        for (int i = 1; i <= Y->rows; i++)
+        {
+            if (mgetp(Y, i, j) > 0.5)
+            {
+                true_class = i - 1;
+                break;
+            }
+        }
+        correct += predictions[j - 1] == true_class;
+    }
+    return correct;
+}
+
+void quant_report(const nn_params *params, const matrix *X_train, const matrix *Y_train,
+                  const matrix *X_test, const matrix *Y_test, int calib_samples, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Calibration sample: the first columns of the local training shard (ranges merged over comm)
+    const int n = calib_samples < X_train->cols ? calib_samples : X_train->cols;
+    matrix X_calib = new_matrix(X_train->rows, n);
+    for (int k = 0; k < X_train->rows; k++)
+        memcpy(&X_calib.val[(size_t)k * n], &X_train->val[(size_t)k * X_train->cols], sizeof(double) * n);
+
+    double begin = MPI_Wtime();
+    quant_model q;
+    quantize_model(&q, params, &X_calib, comm);
+    const double quantize_ms = (MPI_Wtime() - begin) * 1000.0;
+    delete_matrix(&X_calib);
+
+    // Workspaces for both splits, each allocated (and first-touched) by the thread that runs in it
+    const int num_workspaces = omp_get_max_threads();
+    quant_workspace *quant_ws = (quant_workspace *)malloc(sizeof(quant_workspace) * num_workspaces);
+#pragma omp parallel num_threads(num_workspaces)
+    quant_ws[omp_get_thread_num()] = quant_workspace_create(&q, INFERENCE_CHUNK_SIZE);
+
+    // Per split: correct (double, int8), equal predictions, samples; then eval times (double, int8)
+    const matrix *X[2] = {X_train, X_test};
+    const matrix *Y[2] = {Y_train, Y_test};
+    double counts[8] = {0};
+    double times[2] = {0.0, 0.0};
+    predict_workspace predict_ws;
+    predict_workspace_init(&predict_ws, params, INFERENCE_CHUNK_SIZE, 0);
+    for (int s = 0; s < 2; s++)
+    {
+        const int m = X[s]->cols;
+        int *pred_double = (int *)malloc(sizeof(int) * (m > 0 ? m : 1));
+        int *pred_int8 = (int *)malloc(sizeof(int) * (m > 0 ? m : 1));
+        if (m > 0)
+        {
+            begin = MPI_Wtime();
+            L_model_predict(X[s], params, &predict_ws, pred_double);
+            times[0] += (MPI_Wtime() - begin) * 1000.0;
+            begin = MPI_Wtime();
+            quant_predict(&q, X[s], quant_ws, num_workspaces, pred_int8);
+            times[1] += (MPI_Wtime() - begin) * 1000.0;
+        }
+
+        int agree = 0;
+        for (int j = 0; j < m; j++)
+            agree += pred_double[j] == pred_int8[j];
+        counts[4 * s] = count_matches(pred_double, Y[s]);
+        counts[4 * s + 1] = count_matches(pred_int8, Y[s]);
+        counts[4 * s + 2] = agree;
+        counts[4 * s + 3] = m;
+        free(pred_double);
+        free(pred_int8);
+    }
+    predict_workspace_free(&predict_ws);
+    for (int t = 0; t < num_workspaces; t++)
+        quant_workspace_free(&quant_ws[t]);
+    free(quant_ws);
+    MPI_Allreduce(MPI_IN_PLACE, counts, 8, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, times, 2, MPI_DOUBLE, MPI_MAX, comm);
+
+    if (rank == 0)
+    {
+        size_t double_bytes = 0, int8_bytes = 0;
+        for (int l = 0; l < q.L; l++)
+        {
+            const quant_layer *ql = &q.layers[l];
+            double_bytes += sizeof(double) * ((size_t)ql->rows * ql->cols + ql->rows);
+            int8_bytes += (size_t)ql->rows * ql->cols + (sizeof(int32_t) + 2 * sizeof(float)) * ql->rows;
+        }
+
+        printf("\n========== INT8 QUANTIZATION ==========\n");
+        printf("Kernel: %s (u8 x s8 -> int32), calibrated on %d training samples per rank (ranges merged) in %.2f ms\n",
+               quant_kernel_name(), n, quantize_ms);
+        printf("Layer input ranges:");
+        for (int l = 0; l < q.L; l++)
+            printf(" [%.3g, %.3g]", q.layers[l].in_min, q.layers[l].in_max);
+        printf("\nParameters: %.2f MB double -> %.2f MB int8 (%.1fx smaller)\n", double_bytes / 1e6,
+               int8_bytes / 1e6, (double)double_bytes / int8_bytes);
+        printf("%-16s %10s %10s %10s %10s\n", "", "Double", "Int8", "Delta(pp)", "Agree");
+        const char *names[2] = {"Train accuracy", "Test accuracy"};
+        for (int s = 0; s < 2; s++)
+        {
+            const double total = counts[4 * s + 3] > 0 ? counts[4 * s + 3] : 1.0;
+            const double acc_double = 100.0 * counts[4 * s] / total;
+            const double acc_int8 = 100.0 * counts[4 * s + 1] / total;
+            printf("%-16s %9.2f%% %9.2f%% %+10.2f %9.2f%%\n", names[s], acc_double, acc_int8, acc_int8 - acc_double,
+                   100.0 * counts[4 * s + 2] / total);
+        }
+        printf("%-16s %8.2f ms %7.2f ms %9.2fx\n", "Evaluation time", times[0], times[1],
+               times[1] > 0.0 ? times[0] / times[1] : 0.0);
+        printf("=======================================\n");
+    }
+    delete_quant_model(&q);
+}
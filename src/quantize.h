@@ -0,0 +1,83 @@
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stdint.h>
+#include <mpi.h>
+#include "matrix.h"
+#include "nn.h"
+
+// Post-training int8 quantization for inference
+// Weights are symmetric int8 with one scale per output row (max |W[i,:]| / 127). Activations are
+// uint8 with one scale and zero point per layer input, from the range seen on a calibration sample
+// (hidden inputs follow a ReLU, so their zero point is 0; inputs within [0, 1] keep the exact pixel
+// grid 1/255, so uint8 images feed layer 0 unchanged). Activations are stored sample-major, making
+// every output a dot product of contiguous u8 and s8 runs accumulated in int32, which is what the
+// x86 VNNI instruction vpdpbusd computes (4 u8 x s8 products per int32 lane). The bias and the
+// zero-point correction fold into one int32 per row; each output is rescaled once, then either
+// requantized for the next layer or returned as a logit.
+
+#define QUANT_K_ALIGN 64 // Input widths are zero-padded to whole 512-bit vectors
+
+typedef struct
+{
+    int rows;
+    int cols;
+    int cols_padded;  // cols rounded up to QUANT_K_ALIGN
+    int8_t *W;        // rows x cols_padded, zero-padded
+    int32_t *bias;    // b / (row scale * input scale) - input zero point * sum of the row
+    float *out_scale; // Row scale * input scale (int32 accumulator -> real output)
+    float *requant;   // out_scale / next layer's input scale (hidden layers)
+    double in_scale;  // Input quantization: real = in_scale * (q - in_zero)
+    int in_zero;
+    double in_max;    // Calibrated input range
+    double in_min;
+} quant_layer;
+
+typedef struct
+{
+    int L;
+    quant_layer *layers;
+    int max_width;          // Widest padded input or output (workspace sizing)
+    uint8_t pixel_lut[256]; // Layer 0 input of pixel value p (identity on the pixel grid)
+    int pixel_grid;         // Layer 0 input scale is exactly 1/255 with zero point 0
+} quant_model;
+
+// Buffers for chunks of up to chunk samples (one per thread)
+typedef struct
+{
+    int chunk;
+    uint8_t *act[2]; // Layer inputs, sample-major (chunk x max_width), ping-ponged
+    int32_t *acc;    // Accumulators, sample-major (chunk x max_width)
+} quant_workspace;
+
+// Integer kernel picked for this CPU: "avx512-vnni", "avx-vnni" or "portable"
+const char *quant_kernel_name(void);
+
+// Quantize params, calibrating activation ranges on the samples (columns) of X_calib; with a
+// communicator the ranges are merged over its ranks first, so every rank builds the same model
+// (collective over comm unless MPI_COMM_NULL)
+void quantize_model(quant_model *q, const nn_params *params, const matrix *X_calib, MPI_Comm comm);
+void delete_quant_model(quant_model *q);
+
+quant_workspace quant_workspace_create(const quant_model *q, int chunk);
+void quant_workspace_free(quant_workspace *ws);
+
+// Layer 0 inputs of n samples into ws: columns start .. start + n - 1 of X, or uint8 images
+// (image j at images + j * stride)
+void quant_load_matrix(const quant_model *q, quant_workspace *ws, const matrix *X, int start, int n);
+void quant_load_images(const quant_model *q, quant_workspace *ws, const uint8_t *images, size_t stride, int n);
+
+// Forward pass over the n samples loaded into ws; writes the logits (num_classes x n) and/or the
+// argmax classes (either may be NULL)
+void quant_forward(const quant_model *q, quant_workspace *ws, int n, double *logits, int *classes);
+
+// Int8 counterpart of L_model_predict: chunks of ws[0].chunk samples on a team of num_workspaces
+// threads, each running in its own workspace (created once per model)
+void quant_predict(const quant_model *q, const matrix *X, quant_workspace *ws, int num_workspaces, int *predictions);
+
+// Quantize the trained model on calib_samples samples of this rank's training shard and compare
+// it with the double model on the local train and test data (collective over comm; rank 0 prints)
+void quant_report(const nn_params *params, const matrix *X_train, const matrix *Y_train,
+                  const matrix *X_test, const matrix *Y_test, int calib_samples, MPI_Comm comm);
+
+#endif // QUANTIZE_H
@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "config.h"
+#include "inference.h"
+#include "trace.h"
+
+// One connection's request; the connection thread waits on it while a worker serves it
+typedef struct serve_request
+{
+    const uint8_t *image;
+    float *probs;
+    double arrival_ms;
+    int done;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct serve_request *next; // Queue link
+} serve_request;
+
+typedef struct
+{
+    const serve_config *config;
+    int num_inputs;
+    int num_classes;
+    inference_engine *engines; // One per worker
+
+    // FIFO of requests waiting for a batch
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_cond; // Requests arrived, or stopping
+    serve_request *head;
+    serve_request *tail;
+    int queued;
+    int clients; // Connected clients (each has at most one request queued)
+    int stopping;
+
+    // Open connections (shut down to unblock their reads when the server stops)
+    pthread_mutex_t conn_lock;
+    pthread_cond_t conn_cond;
+    int conn_fds[SERVE_MAX_CONNECTIONS];
+    int num_conns;
+
+    // Totals (under queue_lock)
+    long requests;
+    long batches;
+    int max_batch_seen;
+    double queue_ms;   // Arrival to batch start, summed over requests
+    double compute_ms; // Batch forward passes
+} serve_state;
+
+typedef struct
+{
+    serve_state *state;
+    int worker;
+} worker_arg;
+
+typedef struct
+{
+    serve_state *state;
+    int fd;
+} conn_arg;
+
+static volatile sig_atomic_t g_stop = 0;
+
+// Helper functions
+static void handle_stop(int sig);
+static double now_ms(void);
+static int read_full(int fd, void *buf, size_t bytes);
+static int write_full(int fd, const void *buf, size_t bytes);
+static void *worker_thread(void *arg);
+static void *connection_thread(void *arg);
+
+int serve_run(const serve_config *config)
+{
+    serve_state state;
+    memset(&state, 0, sizeof(state));
+    state.config = config;
+
+    // Each worker runs its own engine (plan slabs are per engine)
+    const int batch_chunk = config->max_batch < INFERENCE_CHUNK_SIZE ? config->max_batch : INFERENCE_CHUNK_SIZE;
+    state.engines = (inference_engine *)malloc(sizeof(inference_engine) * config->num_workers);
+    for (int w = 0; w < config->num_workers; w++)
+    {
+        if (inference_init(&state.engines[w], config->model_path, INFERENCE_THROUGHPUT, batch_chunk,
+                           config->threads_per_worker) != 0)
+        {
+            for (int v = 0; v < w; v++)
+                inference_free(&state.engines[v]);
+            free(state.engines);
+            return 1;
+        }
+        if (config->calib_images)
+            inference_quantize(&state.engines[w], config->calib_images, config->calib_stride, config->calib_count);
+    }
+    state.num_inputs = state.engines[0].num_inputs;
+    state.num_classes = state.engines[0].num_classes;
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(config->socket_path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Error: Socket path %s is too long\n", config->socket_path);
+        listen_fd = -1;
+    }
+    else
+    {
+        strcpy(addr.sun_path, config->socket_path);
+        unlink(config->socket_path);
+    }
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(listen_fd, SERVE_MAX_CONNECTIONS) != 0)
+    {
+        fprintf(stderr, "Error: Cannot listen on %s (%s)\n", config->socket_path, strerror(errno));
+        if (listen_fd >= 0)
+            close(listen_fd);
+        for (int w = 0; w < config->num_workers; w++)
+            inference_free(&state.engines[w]);
+        free(state.engines);
+        return 1;
+    }
+
+    pthread_mutex_init(&state.queue_lock, NULL);
+    pthread_mutex_init(&state.conn_lock, NULL);
+    pthread_cond_init(&state.conn_cond, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&state.queue_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_t *workers = (pthread_t *)malloc(sizeof(pthread_t) * config->num_workers);
+    worker_arg *worker_args = (worker_arg *)malloc(sizeof(worker_arg) * config->num_workers);
+    for (int w = 0; w < config->num_workers; w++)
+    {
+        worker_args[w].state = &state;
+        worker_args[w].worker = w;
+        pthread_create(&workers[w], NULL, worker_thread, &worker_args[w]);
+    }
+
+    g_stop = 0;
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    signal(SIGPIPE, SIG_IGN); // Clients that disconnect early show up as write errors
+
+    printf("Serving %s on %s: %d-byte images -> %d class probabilities\n", config->model_path, config->socket_path,
+           state.num_inputs, state.num_classes);
+    if (config->calib_images)
+        printf("Int8 model (%s kernel), calibrated on %d images\n", quant_kernel_name(), config->calib_count);
+    printf("Dynamic batching: up to %d requests, waiting at most %d us; %d worker%s x %d thread%s\n",
+           config->max_batch, config->max_wait_us, config->num_workers, config->num_workers > 1 ? "s" : "",
+           config->threads_per_worker, config->threads_per_worker > 1 ? "s" : "");
+    fflush(stdout);
+    double begin = now_ms();
+
+    // Accept until stopped (polling so the stop flag is seen)
+    while (!g_stop)
+    {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        pthread_mutex_lock(&state.conn_lock);
+        const int accepted = state.num_conns < SERVE_MAX_CONNECTIONS;
+        if (accepted)
+            state.conn_fds[state.num_conns++] = fd;
+        pthread_mutex_unlock(&state.conn_lock);
+        if (!accepted)
+        {
+            close(fd);
+            continue;
+        }
+
+        conn_arg *arg = (conn_arg *)malloc(sizeof(conn_arg));
+        arg->state = &state;
+        arg->fd = fd;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, connection_thread, arg) == 0)
+        {
+            pthread_detach(thread);
+        }
+        else
+        {
+            free(arg);
+            pthread_mutex_lock(&state.conn_lock);
+            for (int c = 0; c < state.num_conns; c++)
+                if (state.conn_fds[c] == fd)
+                    state.conn_fds[c] = state.conn_fds[--state.num_conns];
+            close(fd);
+            pthread_mutex_unlock(&state.conn_lock);
+        }
+    }
+    const double elapsed_ms = now_ms() - begin;
+    close(listen_fd);
+    unlink(config->socket_path);
+
+    // Drain: unblock the connections' reads (their in-flight requests are still served), then stop the workers
+    pthread_mutex_lock(&state.conn_lock);
+    for (int c = 0; c < state.num_conns; c++)
+        shutdown(state.conn_fds[c], SHUT_RDWR);
+    while (state.num_conns > 0)
+        pthread_cond_wait(&state.conn_cond, &state.conn_lock);
+    pthread_mutex_unlock(&state.conn_lock);
+
+    pthread_mutex_lock(&state.queue_lock);
+    state.stopping = 1;
+    pthread_cond_broadcast(&state.queue_cond);
+    pthread_mutex_unlock(&state.queue_lock);
+    for (int w = 0; w < config->num_workers; w++)
+        pthread_join(workers[w], NULL);
+
+    printf("\n========== INFERENCE SERVER ==========\n");
+    printf("Requests: %ld in %.2f s (%.0f images/s)\n", state.requests, elapsed_ms / 1000.0,
+           elapsed_ms > 0.0 ? state.requests / (elapsed_ms / 1000.0) : 0.0);
+    printf("Batches: %ld, mean size %.2f, largest %d (max %d)\n", state.batches,
+           state.batches ? (double)state.requests / state.batches : 0.0, state.max_batch_seen, config->max_batch);
+    printf("Mean queueing: %.4f ms per request, mean forward pass: %.4f ms per batch\n",
+           state.requests ? state.queue_ms / state.requests : 0.0,
+           state.batches ? state.compute_ms / state.batches : 0.0);
+    printf("======================================\n");
+
+    free(workers);
+    free(worker_args);
+    for (int w = 0; w < config->num_workers; w++)
+        inference_free(&state.engines[w]);
+    free(state.engines);
+    pthread_mutex_destroy(&state.queue_lock);
+    pthread_cond_destroy(&state.queue_cond);
+    pthread_mutex_destroy(&state.conn_lock);
+    pthread_cond_destroy(&state.conn_cond);
+    return 0;
+}
+
+static void handle_stop(int sig)
+{
+    (void)sig;
+    g_stop = 1;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * Read or write exactly bytes (retrying short transfers and interrupts)
+ * Returns 0 on success, 1 on error or end of stream
+ */
+static int read_full(int fd, void *buf, size_t bytes)
+{
+    char *p = (char *)buf;
+    while (bytes > 0)
+    {
+        ssize_t got = read(fd, p, bytes);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 1;
+        p += got;
+        bytes -= got;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t bytes)
+{
+    const char *p = (const char *)buf;
+    while (bytes > 0)
+    {
+        ssize_t sent = write(fd, p, bytes);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return 1;
+        p += sent;
+        bytes -= sent;
+    }
+    return 0;
+}
+
+/**
+ * Take dynamic batches off the queue and serve them with this worker's engine
+ */
+static void *worker_thread(void *arg)
+{
+    serve_state *state = ((worker_arg *)arg)->state;
+    inference_engine *engine = &state->engines[((worker_arg *)arg)->worker];
+    const int max_batch = state->config->max_batch;
+    const int num_inputs = state->num_inputs;
+    const int num_classes = state->num_classes;
+
+    uint8_t *images = (uint8_t *)malloc((size_t)max_batch * num_inputs);
+    double *probs = (double *)malloc(sizeof(double) * max_batch * num_classes);
+    serve_request **batch = (serve_request **)malloc(sizeof(serve_request *) * max_batch);
+
+    pthread_mutex_lock(&state->queue_lock);
+    for (;;)
+    {
+        while (!state->head && !state->stopping)
+            pthread_cond_wait(&state->queue_cond, &state->queue_lock);
+        if (!state->head)
+            break;
+
+        // Let the batch fill until the oldest request has waited max_wait_us (no use waiting once
+        // every connected client has a request queued)
+        const double deadline_ms = state->head->arrival_ms + state->config->max_wait_us / 1000.0;
+        struct timespec deadline;
+        deadline.tv_sec = (time_t)(deadline_ms / 1000.0);
+        deadline.tv_nsec = (long)((deadline_ms - deadline.tv_sec * 1000.0) * 1e6);
+        while (state->head && state->queued < max_batch && state->queued < state->clients &&
+               !state->stopping && now_ms() < deadline_ms)
+            if (pthread_cond_timedwait(&state->queue_cond, &state->queue_lock, &deadline) == ETIMEDOUT)
+                break;
+        if (!state->head) // Another worker took them
+            continue;
+
+        int n = 0;
+        while (state->head && n < max_batch)
+        {
+            batch[n++] = state->head;
+            state->head = state->head->next;
+        }
+        if (!state->head)
+            state->tail = NULL;
+        state->queued -= n;
+        pthread_mutex_unlock(&state->queue_lock);
+
+        TRACE_BEGIN(trace_begin_us);
+        const double start_ms = now_ms();
+        double queue_ms = 0.0;
+        for (int j = 0; j < n; j++)
+        {
+            memcpy(images + (size_t)j * num_inputs, batch[j]->image, num_inputs);
+            queue_ms += start_ms - batch[j]->arrival_ms;
+        }
+        inference_run(engine, images, num_inputs, n, NULL, probs);
+        const double forward_ms = now_ms() - start_ms;
+
+        for (int j = 0; j < n; j++)
+        {
+            serve_request *request = batch[j];
+            for (int i = 0; i < num_classes; i++)
+                request->probs[i] = (float)probs[(size_t)j * num_classes + i];
+            pthread_mutex_lock(&request->lock);
+            request->done = 1;
+            pthread_cond_signal(&request->cond);
+            pthread_mutex_unlock(&request->lock);
+        }
+        TRACE_END(trace_begin_us, "serve_batch", "inference");
+
+        pthread_mutex_lock(&state->queue_lock);
+        state->requests += n;
+        state->batches++;
+        if (n > state->max_batch_seen)
+            state->max_batch_seen = n;
+        state->queue_ms += queue_ms;
+        state->compute_ms += forward_ms;
+    }
+    pthread_mutex_unlock(&state->queue_lock);
+
+    free(images);
+    free(probs);
+    free(batch);
+    return NULL;
+}
+
+/**
+ * Serve one client: read an image, queue it, wait for its batch and send back the probabilities
+ */
+static void *connection_thread(void *arg)
+{
+    serve_state *state = ((conn_arg *)arg)->state;
+    const int fd = ((conn_arg *)arg)->fd;
+    free(arg);
+
+    uint8_t *image = (uint8_t *)malloc(state->num_inputs);
+    float *probs = (float *)malloc(sizeof(float) * state->num_classes);
+    serve_request request;
+    memset(&request, 0, sizeof(request));
+    request.image = image;
+    request.probs = probs;
+    pthread_mutex_init(&request.lock, NULL);
+    pthread_cond_init(&request.cond, NULL);
+
+    pthread_mutex_lock(&state->queue_lock);
+    state->clients++;
+    pthread_mutex_unlock(&state->queue_lock);
+
+    uint32_t hello[SERVE_HELLO_WORDS] = {(uint32_t)state->num_inputs, (uint32_t)state->num_classes};
+    int failed = write_full(fd, hello, sizeof(hello));
+    while (!failed && read_full(fd, image, state->num_inputs) == 0)
+    {
+        request.done = 0;
+        request.next = NULL;
+        request.arrival_ms = now_ms();
+
+        pthread_mutex_lock(&state->queue_lock);
+        if (state->tail)
+            state->tail->next = &request;
+        else
+            state->head = &request;
+        state->tail = &request;
+        state->queued++;
+        pthread_cond_broadcast(&state->queue_cond);
+        pthread_mutex_unlock(&state->queue_lock);
+
+        pthread_mutex_lock(&request.lock);
+        while (!request.done)
+            pthread_cond_wait(&request.cond, &request.lock);
+        pthread_mutex_unlock(&request.lock);
+
+        failed = write_full(fd, probs, sizeof(float) * state->num_classes);
+    }
+
+    pthread_mutex_lock(&state->queue_lock);
+    state->clients--;
+    pthread_mutex_unlock(&state->queue_lock);
+
+    pthread_mutex_destroy(&request.lock);
+    pthread_cond_destroy(&request.cond);
+    free(image);
+    free(probs);
+
+    // Leave the open set (the fd is closed under the lock so the number can't be reused before removal)
+    pthread_mutex_lock(&state->conn_lock);
+    for (int c = 0; c < state->num_conns; c++)
+    {
+        if (state->conn_fds[c] == fd)
+        {
+            state->conn_fds[c] = state->conn_fds[--state->num_conns];
+            break;
+        }
+    }
+    close(fd);
+    pthread_cond_signal(&state->conn_cond);
+    pthread_mutex_unlock(&state->conn_lock);
+    return NULL;
+}
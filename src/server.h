@@ -0,0 +1,34 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Local inference server on a Unix domain stream socket
+// On connect the server sends two uint32 values: the input size (bytes per image) and the number
+// of classes. The client then sends raw uint8 images, each answered, in order, by its class
+// probabilities as float32 values (host byte order). Every connection has one request in flight;
+// concurrent connections are coalesced into dynamic batches: a worker takes up to max_batch queued
+// requests as soon as that many are waiting or the oldest has waited max_wait_us, and runs them
+// through its own inference engine (throughput tuning, threads_per_worker threads).
+
+#define SERVE_HELLO_WORDS 2
+
+typedef struct
+{
+    const char *socket_path;
+    const char *model_path; // Checkpoint written by main.exe --checkpoint
+    int max_batch;
+    int max_wait_us;
+    int num_workers;
+    int threads_per_worker;
+    const uint8_t *calib_images; // Serve the int8 model calibrated on these images (NULL = double)
+    size_t calib_stride;
+    int calib_count;
+} serve_config;
+
+// Serve until SIGINT or SIGTERM, then drain the open connections and print the batching
+// statistics. Returns 0 on a clean shutdown, 1 on error
+int serve_run(const serve_config *config);
+
+#endif // SERVER_H
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <omp.h>
+
+#include "synthetic.h"
+#include "config.h"
+
+// Weight of the class prototype vs per-sample noise in each feature
+#define SYNTHETIC_CLASS_WEIGHT 0.5
+
+// Helper functions
+static double hash_uniform(uint64_t a, uint64_t b);
+static void generate_split(matrix *X, matrix *Y, int global_offset, int num_features);
+
+/**
+ * Counter-based uniform random number in [0, 1) from two integers (splitmix64 finalizer)
+ */
+static double hash_uniform(uint64_t a, uint64_t b)
+{
+    uint64_t z = (uint64_t)RANDOM_SEED + a * 0x9e3779b97f4a7c15ULL + b * 0xd1b54a32d192ed03ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (z >> 11) * 0x1.0p-53;
+}
+
+/**
+ * Fill X (features x samples) and Y (one-hot) for global sample indices starting at global_offset
+ */
+static void generate_split(matrix *X, matrix *Y, int global_offset, int num_features)
+{
+    const int m = X->cols;
+
+    // Rows are independent, so each thread generates (and first-touches) whole feature rows
+#pragma omp parallel for schedule(static)
+    for (int k = 0; k < num_features; k++)
+    {
+        for (int j = 0; j < m; j++)
+        {
+            uint64_t index = (uint64_t)global_offset + j;
+            int label = (int)(index % NUM_CLASSES);
+
+            // Prototype keyed by (class, feature), noise keyed by (sample, feature)
+            double prototype = hash_uniform(label, (uint64_t)k);
+            double noise = hash_uniform(index + NUM_CLASSES, (uint64_t)k + ((uint64_t)1 << 32));
+            X->val[(size_t)k * m + j] = SYNTHETIC_CLASS_WEIGHT * prototype + (1.0 - SYNTHETIC_CLASS_WEIGHT) * noise;
+        }
+    }
+
+    for (int j = 0; j < m; j++)
+        mgetp(Y, (int)(((uint64_t)global_offset + j) % NUM_CLASSES) + 1, j + 1) = 1.0;
+}
+
+int prepare_synthetic_data(int num_train_samples, int num_test_samples, int num_features, int rank, int num_processes)
+{
+    // Contiguous shares of the global index space (remainder to the first ranks)
+    int local_train_size = num_train_samples / num_processes + (rank < num_train_samples % num_processes ? 1 : 0);
+    int local_test_size = num_test_samples / num_processes + (rank < num_test_samples % num_processes ? 1 : 0);
+    int train_offset = rank * (num_train_samples / num_processes) + (rank < num_train_samples % num_processes ? rank : num_train_samples % num_processes);
+    int test_offset = rank * (num_test_samples / num_processes) + (rank < num_test_samples % num_processes ? rank : num_test_samples % num_processes);
+
+    // Allocate memory for transformed data structure
+    data = (CIFAR10Data *)malloc(sizeof(CIFAR10Data));
+    if (!data)
+    {
+        fprintf(stderr, "Error: Memory allocation failed for synthetic data on rank %d\n", rank);
+        return 1;
+    }
+
+    data->train_size = local_train_size;
+    data->test_size = local_test_size;
+    data->X_train = new_matrix_first_touch(num_features, local_train_size);
+    data->Y_train = new_matrix_first_touch(NUM_CLASSES, local_train_size);
+    data->X_test = new_matrix_first_touch(num_features, local_test_size);
+    data->Y_test = new_matrix_first_touch(NUM_CLASSES, local_test_size);
+
+    // Test samples live after all training samples in the global index space
+    generate_split(&data->X_train, &data->Y_train, train_offset, num_features);
+    generate_split(&data->X_test, &data->Y_test, num_train_samples + test_offset, num_features);
+
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include "transform.h"
+
+/**
+ * Generate a deterministic, class-structured synthetic dataset directly into the global data
+ * Every sample is a function of its global index only (label = index % NUM_CLASSES, features =
+ * class prototype + per-sample noise in [0, 1]), so the global dataset is identical for any
+ * number of processes. Rank r generates only its contiguous share of the train and test sets,
+ * in parallel over features.
+ * Returns 0 on success, 1 on error
+ */
+int prepare_synthetic_data(int num_train_samples, int num_test_samples, int num_features, int rank, int num_processes);
+
+#endif // SYNTHETIC_H
@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <mpi.h>
+
+#include "tensor_parallel.h"
+#include "trace.h"
+
+// Helper functions
+static void split_rows(tp_group *tp);
+
+tp_group tp_group_create(int size, int rows, MPI_Comm comm)
+{
+    int rank, num_processes;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &num_processes);
+    assert(size > 0 && num_processes % size == 0 && rows >= size);
+
+    tp_group tp;
+    tp.size = size;
+    tp.rank = rank % size;
+    tp.dp_size = num_processes / size;
+    tp.dp_rank = rank / size;
+    tp.rows = rows;
+
+    MPI_Comm_split(comm, tp.dp_rank, tp.rank, &tp.comm);
+    MPI_Comm_split(comm, tp.rank, tp.dp_rank, &tp.dp_comm);
+    split_rows(&tp);
+    return tp;
+}
+
+tp_group tp_group_dup(const tp_group *tp)
+{
+    tp_group dup = *tp;
+    MPI_Comm_dup(tp->comm, &dup.comm);
+    dup.dp_comm = MPI_COMM_NULL;
+    split_rows(&dup);
+    return dup;
+}
+
+void tp_group_free(tp_group *tp)
+{
+    if (tp->comm != MPI_COMM_NULL)
+        MPI_Comm_free(&tp->comm);
+    if (tp->dp_comm != MPI_COMM_NULL)
+        MPI_Comm_free(&tp->dp_comm);
+    free(tp->counts);
+    free(tp->offsets);
+    tp->counts = tp->offsets = NULL;
+}
+
+void tp_allgather_rows(const tp_group *tp, const matrix *slice, matrix *full)
+{
+    TRACE_BEGIN(trace_begin_us);
+    const int n = slice->cols;
+    assert(slice->rows == tp->row_count && full->rows == tp->rows && full->cols == n);
+
+    // Row blocks of a row-major matrix are contiguous, so the slices land in rank order
+    int *counts = (int *)malloc(sizeof(int) * tp->size);
+    int *displs = (int *)malloc(sizeof(int) * tp->size);
+    for (int r = 0; r < tp->size; r++)
+    {
+        counts[r] = tp->counts[r] * n;
+        displs[r] = tp->offsets[r] * n;
+    }
+    MPI_Allgatherv(slice->val, tp->row_count * n, MPI_DOUBLE, full->val, counts, displs, MPI_DOUBLE, tp->comm);
+
+    free(counts);
+    free(displs);
+    TRACE_END(trace_begin_us, "tp_allgather_rows", "mpi");
+}
+
+/**
+ * Contiguous row ranges of W[0], the first rows % size ranks taking one extra row
+ */
+static void split_rows(tp_group *tp)
+{
+    tp->counts = (int *)malloc(sizeof(int) * tp->size);
+    tp->offsets = (int *)malloc(sizeof(int) * tp->size);
+    int offset = 0;
+    for (int r = 0; r < tp->size; r++)
+    {
+        tp->counts[r] = tp->rows / tp->size + (r < tp->rows % tp->size ? 1 : 0);
+        tp->offsets[r] = offset;
+        offset += tp->counts[r];
+    }
+    tp->row_offset = tp->offsets[tp->rank];
+    tp->row_count = tp->counts[tp->rank];
+}
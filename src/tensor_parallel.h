@@ -0,0 +1,39 @@
+#ifndef TENSOR_PARALLEL_H
+#define TENSOR_PARALLEL_H
+
+#include <mpi.h>
+#include "matrix.h"
+
+// Tensor parallelism for the first (widest) layer
+// Ranks form groups of consecutive ranks. The ranks of a group hold the same data and split W[0]
+// and b[0] by output rows: each computes its slice of Z[0] and the slices are allgathered into the
+// full activations, while the smaller layers are replicated within the group. Ranks at the same
+// position of every group form a data-parallel communicator over which gradients are averaged, so
+// layer 0's gradient traffic and weight memory per rank drop by the group size.
+
+typedef struct
+{
+    int size;         // Ranks per group (1 = no tensor parallelism)
+    int rank;         // Position in the group
+    MPI_Comm comm;    // The group
+    int dp_size;      // Number of groups (data-parallel replicas)
+    int dp_rank;      // Group index
+    MPI_Comm dp_comm; // Ranks at the same position of every group
+    int rows;         // Full output width of layer 0
+    int row_offset;   // First row of W[0] held by this rank
+    int row_count;    // Rows of W[0] held by this rank
+    int *counts;      // Rows held by every rank of the group
+    int *offsets;     // First row of every rank of the group
+} tp_group;
+
+// Split comm into groups of size ranks (collective; the size must divide the communicator size)
+tp_group tp_group_create(int size, int rows, MPI_Comm comm);
+
+// Same group on a duplicate communicator (for a helper thread; no data-parallel communicator)
+tp_group tp_group_dup(const tp_group *tp);
+void tp_group_free(tp_group *tp);
+
+// Gather every rank's row slice (row_count x n) into the full (rows x n) matrix (collective over the group)
+void tp_allgather_rows(const tp_group *tp, const matrix *slice, matrix *full);
+
+#endif // TENSOR_PARALLEL_H
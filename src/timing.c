@@ -1,5 +1,8 @@
 #include <time.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <mpi.h>
 
 #include "timing.h"
 
@@ -8,8 +11,29 @@ timer_accum_t g_backward_time;
 timer_accum_t g_update_time;
 timer_accum_t g_cost_time;
 timer_accum_t g_accuracy_time;
+timer_accum_t g_comm_gradients_time;
+timer_accum_t g_comm_cost_time;
+timer_accum_t g_comm_accuracy_time;
+timer_accum_t g_comm_pipeline_time;
 timer_t_custom g_total_program_time;
 
+// All accumulators, with the column prefixes used in the CSV
+#define NUM_ACCUMS 9
+static timer_accum_t *const all_accums[NUM_ACCUMS] = {
+    &g_forward_time, &g_backward_time, &g_update_time, &g_cost_time, &g_accuracy_time,
+    &g_comm_gradients_time, &g_comm_cost_time, &g_comm_accuracy_time, &g_comm_pipeline_time};
+static const char *const accum_keys[NUM_ACCUMS] = {
+    "forward", "backward", "update", "cost", "accuracy",
+    "comm_gradients", "comm_cost", "comm_accuracy", "comm_pipeline"};
+
+// Fallback files tried when the results file was written with different columns
+#define CSV_MAX_FALLBACKS 16
+
+// Helper functions
+static double accum_imbalance(const timer_accum_t *accum);
+static void format_csv_header(char *header, size_t size);
+static FILE *open_results_file(const char *filename, const char *header, char *path, size_t path_size);
+
 // Initialize all global accumulators
 void init_timing_accumulators(void)
 {
@@ -18,6 +42,38 @@ void init_timing_accumulators(void)
     ACCUM_INIT(g_update_time, "Parameter Update");
     ACCUM_INIT(g_cost_time, "Cost Computation");
     ACCUM_INIT(g_accuracy_time, "Accuracy Computation");
+    ACCUM_INIT(g_comm_gradients_time, "Gradient Allreduce");
+    ACCUM_INIT(g_comm_cost_time, "Cost Reduction");
+    ACCUM_INIT(g_comm_accuracy_time, "Accuracy Reduction");
+    ACCUM_INIT(g_comm_pipeline_time, "Pipeline Transfers");
+}
+
+// Reduce every accumulator's total to min/max/mean across ranks (must be called by all ranks)
+void reduce_timing_accumulators(MPI_Comm comm)
+{
+    int num_processes;
+    MPI_Comm_size(comm, &num_processes);
+
+    double local[NUM_ACCUMS], min[NUM_ACCUMS], max[NUM_ACCUMS], sum[NUM_ACCUMS];
+    for (int a = 0; a < NUM_ACCUMS; a++)
+        local[a] = all_accums[a]->total_ms;
+
+    MPI_Allreduce(local, min, NUM_ACCUMS, MPI_DOUBLE, MPI_MIN, comm);
+    MPI_Allreduce(local, max, NUM_ACCUMS, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(local, sum, NUM_ACCUMS, MPI_DOUBLE, MPI_SUM, comm);
+
+    for (int a = 0; a < NUM_ACCUMS; a++)
+    {
+        all_accums[a]->min_ms = min[a];
+        all_accums[a]->max_ms = max[a];
+        all_accums[a]->mean_ms = sum[a] / num_processes;
+    }
+}
+
+// Imbalance ratio: slowest rank relative to the mean (1.0 is perfectly balanced)
+static double accum_imbalance(const timer_accum_t *accum)
+{
+    return accum->mean_ms > 0.0 ? accum->max_ms / accum->mean_ms : 1.0;
 }
 
 // Print all timing summaries
@@ -29,11 +85,24 @@ void print_timing_summary(void)
     ACCUM_PRINT(g_update_time);
     ACCUM_PRINT(g_cost_time);
     ACCUM_PRINT(g_accuracy_time);
+    ACCUM_PRINT(g_comm_gradients_time);
+    ACCUM_PRINT(g_comm_cost_time);
+    ACCUM_PRINT(g_comm_accuracy_time);
+    ACCUM_PRINT(g_comm_pipeline_time);
 
-    double total = g_forward_time.total_ms + g_backward_time.total_ms +
-                   g_update_time.total_ms + g_cost_time.total_ms;
+    double compute = g_forward_time.total_ms + g_backward_time.total_ms +
+                     g_update_time.total_ms + g_cost_time.total_ms;
+    double comm = g_comm_gradients_time.total_ms + g_comm_cost_time.total_ms + g_comm_pipeline_time.total_ms;
+    double total = compute + comm;
     printf("------------------------------------\n");
     printf("[TOTAL] %-30s: %10.3f ms\n", "Training Loop", total);
+    printf("[SPLIT] %-30s: %10.3f ms (%.1f%%)\n", "Compute", compute, total > 0.0 ? compute / total * 100.0 : 0.0);
+    printf("[SPLIT] %-30s: %10.3f ms (%.1f%%)\n", "Communication", comm, total > 0.0 ? comm / total * 100.0 : 0.0);
+
+    printf("------- ACROSS RANKS (total ms) -------\n");
+    printf("[RANKS] %-30s: %10s %10s %10s %8s\n", "", "min", "mean", "max", "max/mean");
+    for (int a = 0; a < NUM_ACCUMS; a++)
+        ACCUM_PRINT_RANKS(*all_accums[a]);
     printf("========================================\n\n");
 }
 
@@ -46,31 +115,19 @@ void log_results_to_csv(const char *filename,
                         double final_test_acc,
                         double training_time_sec,
                         int num_threads,
-                        int num_processes)
+                        int num_processes,
+                        const char *config)
 {
-    FILE *file = fopen(filename, "r");
-    int file_exists = (file != NULL);
-    if (file)
-        fclose(file);
+    char header[2048];
+    format_csv_header(header, sizeof(header));
 
-    file = fopen(filename, "a");
+    char path[512];
+    FILE *file = open_results_file(filename, header, path, sizeof(path));
     if (!file)
-    {
-        fprintf(stderr, "Warning: Could not open %s for writing\n", filename);
         return;
-    }
-
-    // Write header if file is new
-    if (!file_exists)
-    {
-        fprintf(file, "num_samples,num_iterations,learning_rate,train_accuracy,test_accuracy,"
-                      "training_time_sec,num_threads,num_processes,forward_time_ms,backward_time_ms,update_time_ms,"
-                      "cost_time_ms,accuracy_time_ms,avg_forward_ms,avg_backward_ms,"
-                      "avg_update_ms\n");
-    }
 
     // Write data row
-    fprintf(file, "%d,%d,%.6f,%.2f,%.2f,%.3f,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f\n",
+    fprintf(file, "%d,%d,%.6f,%.2f,%.2f,%.3f,%d,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f",
             num_samples,
             num_iterations,
             learning_rate,
@@ -86,8 +143,87 @@ void log_results_to_csv(const char *filename,
             g_accuracy_time.total_ms,
             g_forward_time.count > 0 ? g_forward_time.total_ms / g_forward_time.count : 0.0,
             g_backward_time.count > 0 ? g_backward_time.total_ms / g_backward_time.count : 0.0,
-            g_update_time.count > 0 ? g_update_time.total_ms / g_update_time.count : 0.0);
+            g_update_time.count > 0 ? g_update_time.total_ms / g_update_time.count : 0.0,
+            g_comm_gradients_time.total_ms,
+            g_comm_cost_time.total_ms,
+            g_comm_accuracy_time.total_ms);
+    for (int a = 0; a < NUM_ACCUMS; a++)
+        fprintf(file, ",%.3f,%.3f,%.3f,%.3f",
+                all_accums[a]->min_ms, all_accums[a]->mean_ms, all_accums[a]->max_ms,
+                accum_imbalance(all_accums[a]));
+    fprintf(file, ",%s\n", config);
 
+    fflush(file);
+    flock(fileno(file), LOCK_UN);
     fclose(file);
-    printf("Results logged to %s\n", filename);
+    printf("Results logged to %s\n", path);
+}
+
+/**
+ * Column names of the results file, ending in a newline
+ */
+static void format_csv_header(char *header, size_t size)
+{
+    size_t length = (size_t)snprintf(header, size,
+                                      "num_samples,num_iterations,learning_rate,train_accuracy,test_accuracy,"
+                                      "training_time_sec,num_threads,num_processes,forward_time_ms,backward_time_ms,update_time_ms,"
+                                      "cost_time_ms,accuracy_time_ms,avg_forward_ms,avg_backward_ms,"
+                                      "avg_update_ms,comm_gradients_time_ms,comm_cost_time_ms,comm_accuracy_time_ms");
+    for (int a = 0; a < NUM_ACCUMS && length < size; a++)
+        length += (size_t)snprintf(header + length, size - length, ",%s_min_ms,%s_mean_ms,%s_max_ms,%s_imbalance",
+                                   accum_keys[a], accum_keys[a], accum_keys[a], accum_keys[a]);
+    if (length < size)
+        snprintf(header + length, size - length, ",config\n");
+}
+
+/**
+ * Open the results file locked for appending, writing the header if it is new. A file whose first line
+ * is a different header (written by an older build) is left alone and rows go to <name>.<n>.csv instead.
+ */
+static FILE *open_results_file(const char *filename, const char *header, char *path, size_t path_size)
+{
+    const char *extension = strrchr(filename, '.');
+    const int stem = extension ? (int)(extension - filename) : (int)strlen(filename);
+
+    for (int n = 0; n <= CSV_MAX_FALLBACKS; n++)
+    {
+        if (n == 0)
+            snprintf(path, path_size, "%s", filename);
+        else
+            snprintf(path, path_size, "%.*s.%d%s", stem, filename, n, extension ? extension : "");
+
+        FILE *file = fopen(path, "a+");
+        if (!file)
+        {
+            fprintf(stderr, "Warning: Could not open %s for writing\n", path);
+            return NULL;
+        }
+
+        // Concurrent jobs (e.g. the groups of a sweep) append whole rows one at a time
+        flock(fileno(file), LOCK_EX);
+        fseek(file, 0, SEEK_END);
+
+        // Write header if file is new
+        if (ftell(file) == 0)
+        {
+            fputs(header, file);
+            return file;
+        }
+
+        char line[2048];
+        rewind(file);
+        if (fgets(line, sizeof(line), file) && strcmp(line, header) == 0)
+        {
+            fseek(file, 0, SEEK_END);
+            return file;
+        }
+
+        flock(fileno(file), LOCK_UN);
+        fclose(file);
+        if (n == 0)
+            fprintf(stderr, "Warning: %s has different columns, appending to a numbered file instead\n", filename);
+    }
+
+    fprintf(stderr, "Warning: No results file with matching columns (%s and %d alternatives)\n", filename, CSV_MAX_FALLBACKS);
+    return NULL;
 }
@@ -3,6 +3,7 @@
 
 #include <time.h>
 #include <stdio.h>
+#include <mpi.h>
 
 // Timer using clock_gettime
 typedef struct
@@ -28,6 +29,10 @@ typedef struct
     double total_ms;
     int count;
     const char *label;
+    // Statistics of total_ms across ranks (filled by reduce_timing_accumulators)
+    double min_ms;
+    double max_ms;
+    double mean_ms;
 } timer_accum_t;
 
 // Macros to facilitate accumulator usage
@@ -37,6 +42,9 @@ typedef struct
         (accum).total_ms = 0.0; \
         (accum).count = 0;      \
         (accum).label = name;   \
+        (accum).min_ms = 0.0;   \
+        (accum).max_ms = 0.0;   \
+        (accum).mean_ms = 0.0;  \
     } while (0)
 #define ACCUM_ADD(accum, timer)                 \
     do                                          \
@@ -49,18 +57,29 @@ typedef struct
            (accum).label, (accum).total_ms,                            \
            (accum).count > 0 ? (accum).total_ms / (accum).count : 0.0, \
            (accum).count)
+#define ACCUM_PRINT_RANKS(accum)                                           \
+    printf("[RANKS] %-30s: %10.3f %10.3f %10.3f %8.3f\n",                  \
+           (accum).label, (accum).min_ms, (accum).mean_ms, (accum).max_ms, \
+           (accum).mean_ms > 0.0 ? (accum).max_ms / (accum).mean_ms : 1.0)
 
-// Global timing accumulators
+// Global timing accumulators (compute)
 extern timer_accum_t g_forward_time;
 extern timer_accum_t g_backward_time;
 extern timer_accum_t g_update_time;
 extern timer_accum_t g_cost_time;
 extern timer_accum_t g_accuracy_time;
+
+// Global timing accumulators (communication)
+extern timer_accum_t g_comm_gradients_time;
+extern timer_accum_t g_comm_cost_time;
+extern timer_accum_t g_comm_accuracy_time;
+extern timer_accum_t g_comm_pipeline_time; // Waits on the stage-to-stage activations and gradients
 extern timer_t_custom g_total_program_time;
 
 // Function declarations
 void init_timing_accumulators(void);
+void reduce_timing_accumulators(MPI_Comm comm); // Collective: min/max/mean of every accumulator across comm
 void print_timing_summary(void);
-void log_results_to_csv(const char *filename, int num_samples, int num_iterations, double learning_rate, double final_train_acc, double final_test_acc, double training_time_sec, int num_threads, int num_processes);
+void log_results_to_csv(const char *filename, int num_samples, int num_iterations, double learning_rate, double final_train_acc, double final_test_acc, double training_time_sec, int num_threads, int num_processes, const char *config); // config tags the row (e.g. a sweep's hyperparameters)
 
 #endif // TIMING_H
\ No newline at end of file
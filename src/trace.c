@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <mpi.h>
+
+#include "trace.h"
+
+#define TRACE_CHUNK_EVENTS 4096
+#define TRACE_MAX_THREADS 256
+
+typedef struct
+{
+    const char *name;
+    const char *category;
+    double begin_us;
+    double duration_us;
+    int step;
+    int layer;
+} trace_event;
+
+// Events are appended to fixed-size chunks, so recording never moves existing events
+typedef struct trace_chunk
+{
+    trace_event events[TRACE_CHUNK_EVENTS];
+    int count;
+    struct trace_chunk *next;
+} trace_chunk;
+
+typedef struct trace_buffer
+{
+    trace_chunk *head;
+    trace_chunk *tail;
+    int tid;
+    struct trace_buffer *next_free; // In the free list once its thread has exited
+} trace_buffer;
+
+// Growable string used to serialize events
+typedef struct
+{
+    char *text;
+    size_t length;
+    size_t capacity;
+} trace_string;
+
+// Global variables
+int g_trace_enabled = 0;
+static const char *trace_filename = NULL;
+static struct timespec trace_origin;
+static atomic_int trace_step = -1;
+static atomic_int num_buffers = 0;
+static atomic_int dropped_events = 0;
+static atomic_int limit_warned = 0;
+static trace_buffer *buffers[TRACE_MAX_THREADS];
+static _Thread_local trace_buffer *thread_buffer = NULL;
+static _Thread_local int thread_layer = -1;
+
+// Buffers of exited threads (helper threads come and go: one per evaluation or checkpoint write),
+// handed to the next new thread so that slots are only used by threads alive at the same time
+static pthread_mutex_t free_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_buffer *free_buffers = NULL;
+static int buffers_released = 0; // Set by trace_finalize: exiting threads no longer return buffers
+static pthread_key_t exit_key;
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+// Helper functions
+static trace_buffer *get_thread_buffer(void);
+static void create_exit_key(void);
+static void release_thread_buffer(void *arg);
+static void append(trace_string *str, const char *format, ...);
+
+void trace_init(const char *filename)
+{
+    trace_filename = filename;
+
+    // Align the time origin across ranks
+    MPI_Barrier(MPI_COMM_WORLD);
+    clock_gettime(CLOCK_MONOTONIC, &trace_origin);
+    g_trace_enabled = 1;
+}
+
+void trace_set_step(int step)
+{
+    atomic_store_explicit(&trace_step, step, memory_order_relaxed);
+}
+
+int trace_set_layer(int layer)
+{
+    const int previous = thread_layer;
+    thread_layer = layer;
+    return previous;
+}
+
+double trace_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - trace_origin.tv_sec) * 1e6 + (now.tv_nsec - trace_origin.tv_nsec) / 1e3;
+}
+
+static void create_exit_key(void)
+{
+    pthread_key_create(&exit_key, release_thread_buffer);
+}
+
+/**
+ * Thread exit: put the thread's buffer (with its events) on the free list for the next new thread
+ */
+static void release_thread_buffer(void *arg)
+{
+    trace_buffer *buffer = (trace_buffer *)arg;
+    pthread_mutex_lock(&free_lock);
+    if (!buffers_released)
+    {
+        buffer->next_free = free_buffers;
+        free_buffers = buffer;
+    }
+    pthread_mutex_unlock(&free_lock);
+}
+
+/**
+ * Lazily register a buffer for the calling thread: one left by an exited thread (its events
+ * continue on that thread's track), else a new slot
+ */
+static trace_buffer *get_thread_buffer(void)
+{
+    if (thread_buffer)
+        return thread_buffer;
+
+    pthread_once(&exit_key_once, create_exit_key);
+    pthread_mutex_lock(&free_lock);
+    trace_buffer *buffer = free_buffers;
+    if (buffer)
+        free_buffers = buffer->next_free;
+    pthread_mutex_unlock(&free_lock);
+
+    if (!buffer)
+    {
+        int slot = atomic_fetch_add(&num_buffers, 1);
+        if (slot >= TRACE_MAX_THREADS)
+        {
+            if (!atomic_exchange(&limit_warned, 1))
+                fprintf(stderr, "Warning: More than %d threads traced at once, events of the others are dropped\n",
+                        TRACE_MAX_THREADS);
+            return NULL;
+        }
+
+        buffer = (trace_buffer *)malloc(sizeof(trace_buffer));
+        buffer->head = buffer->tail = (trace_chunk *)calloc(1, sizeof(trace_chunk));
+        buffer->tid = slot;
+        buffer->next_free = NULL;
+        buffers[slot] = buffer;
+    }
+    pthread_setspecific(exit_key, buffer);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+void trace_record(const char *name, const char *category, double begin_us)
+{
+    double end_us = trace_now_us();
+    trace_buffer *buffer = get_thread_buffer();
+    if (!buffer)
+    {
+        atomic_fetch_add(&dropped_events, 1);
+        return;
+    }
+
+    // Start a new chunk when the current one is full
+    if (buffer->tail->count == TRACE_CHUNK_EVENTS)
+    {
+        trace_chunk *chunk = (trace_chunk *)calloc(1, sizeof(trace_chunk));
+        buffer->tail->next = chunk;
+        buffer->tail = chunk;
+    }
+
+    trace_event *event = &buffer->tail->events[buffer->tail->count++];
+    event->name = name;
+    event->category = category;
+    event->begin_us = begin_us;
+    event->duration_us = end_us - begin_us;
+    event->step = atomic_load_explicit(&trace_step, memory_order_relaxed);
+    event->layer = thread_layer;
+}
+
+static void append(trace_string *str, const char *format, ...)
+{
+    va_list args;
+    for (;;)
+    {
+        va_start(args, format);
+        int needed = vsnprintf(str->text + str->length, str->capacity - str->length, format, args);
+        va_end(args);
+
+        if (str->length + needed < str->capacity)
+        {
+            str->length += needed;
+            return;
+        }
+
+        str->capacity = 2 * (str->capacity + needed);
+        str->text = (char *)realloc(str->text, str->capacity);
+    }
+}
+
+void trace_finalize(void)
+{
+    if (!g_trace_enabled)
+        return;
+    g_trace_enabled = 0;
+
+    int rank, num_processes;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &num_processes);
+
+    // Serialize this rank's events (each entry prefixed with ",\n" so fragments concatenate)
+    trace_string local = {(char *)malloc(1 << 16), 0, 1 << 16};
+    local.text[0] = '\0';
+    append(&local, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Rank %d\"}}", rank, rank);
+
+    int thread_count = atomic_load(&num_buffers);
+    if (thread_count > TRACE_MAX_THREADS)
+        thread_count = TRACE_MAX_THREADS;
+    for (int t = 0; t < thread_count; t++)
+    {
+        trace_buffer *buffer = buffers[t];
+        append(&local, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}",
+               rank, buffer->tid, buffer->tid);
+
+        for (trace_chunk *chunk = buffer->head; chunk; chunk = chunk->next)
+            for (int e = 0; e < chunk->count; e++)
+            {
+                const trace_event *event = &chunk->events[e];
+                append(&local, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                               "\"pid\":%d,\"tid\":%d,\"args\":{\"step\":%d,\"layer\":%d}}",
+                       event->name, event->category, event->begin_us, event->duration_us,
+                       rank, buffer->tid, event->step, event->layer);
+            }
+    }
+
+    // Gather all fragments on rank 0
+    int local_length = (int)local.length;
+    int *lengths = NULL;
+    int *offsets = NULL;
+    char *merged = NULL;
+    int total_length = 0;
+    if (rank == 0)
+    {
+        lengths = (int *)malloc(sizeof(int) * num_processes);
+        offsets = (int *)malloc(sizeof(int) * num_processes);
+    }
+    MPI_Gather(&local_length, 1, MPI_INT, lengths, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0)
+    {
+        for (int r = 0; r < num_processes; r++)
+        {
+            offsets[r] = total_length;
+            total_length += lengths[r];
+        }
+        merged = (char *)malloc(total_length + 1);
+    }
+    MPI_Gatherv(local.text, local_length, MPI_CHAR, merged, lengths, offsets, MPI_CHAR, 0, MPI_COMM_WORLD);
+
+    int total_dropped = 0;
+    int local_dropped = atomic_load(&dropped_events);
+    MPI_Reduce(&local_dropped, &total_dropped, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        FILE *file = fopen(trace_filename, "w");
+        if (!file)
+        {
+            fprintf(stderr, "Warning: Could not open %s for writing\n", trace_filename);
+        }
+        else
+        {
+            // Skip the leading ",\n" of the first fragment
+            fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+            fwrite(merged + 2, 1, total_length - 2, file);
+            fprintf(file, "\n]}\n");
+            fclose(file);
+            printf("Trace written to %s", trace_filename);
+            if (total_dropped > 0)
+                printf(" (%d events dropped: more than %d threads at once)", total_dropped, TRACE_MAX_THREADS);
+            printf("\n");
+        }
+        free(lengths);
+        free(offsets);
+        free(merged);
+    }
+
+    // Release all buffers (threads still running keep theirs to themselves from now on)
+    pthread_mutex_lock(&free_lock);
+    buffers_released = 1;
+    free_buffers = NULL;
+    pthread_mutex_unlock(&free_lock);
+    free(local.text);
+    for (int t = 0; t < thread_count; t++)
+    {
+        trace_chunk *chunk = buffers[t]->head;
+        while (chunk)
+        {
+            trace_chunk *next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        free(buffers[t]);
+        buffers[t] = NULL;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Optional event tracing, exported as a Chrome trace-event JSON file (loadable in Perfetto)
+// Each thread records complete (begin + duration) events into its own buffer without locking;
+// buffers from all ranks are merged into one file by trace_finalize. A thread that exits leaves its
+// buffer to the next thread that starts, so short-lived helper threads don't use up the slots.
+
+// Non-zero once trace_init has been called (checked before every record)
+extern int g_trace_enabled;
+
+// Enable tracing (collective: ranks agree on a common time origin)
+void trace_init(const char *filename);
+
+// Context attached to subsequent events: step is global, layer is per thread (-1 = none)
+// trace_set_layer returns the previous layer, for tasks that restore it when they finish
+void trace_set_step(int step);
+int trace_set_layer(int layer);
+
+double trace_now_us(void);
+void trace_record(const char *name, const char *category, double begin_us);
+
+// Merge all ranks' events and write the trace file on rank 0 (collective, call after worker threads exit)
+void trace_finalize(void);
+
+// Macros to instrument a scope (no work beyond one branch when tracing is disabled)
+#define TRACE_BEGIN(var) double var = g_trace_enabled ? trace_now_us() : 0.0
+#define TRACE_END(var, name, category)                \
+    do                                                \
+    {                                                 \
+        if (g_trace_enabled)                          \
+            trace_record((name), (category), (var)); \
+    } while (0)
+
+#endif // TRACE_H
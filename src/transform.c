@@ -7,22 +7,71 @@
 // Global variables
 CIFAR10Data *data = NULL;
 
-int prepare_cifar10_data(int num_samples, int rank, int num_processes)
+// Helper functions
+static void split_class_counts(int total, int *class_counts);
+static void split_across_ranks(const int *class_counts, int rank, int num_processes, int *class_start, int *class_share);
+
+/**
+ * Split a global sample count over the classes (first total % NUM_CLASSES classes take one extra)
+ */
+static void split_class_counts(int total, int *class_counts)
 {
-    int samples_per_process = num_samples / num_processes;
+    for (int c = 0; c < NUM_CLASSES; c++)
+        class_counts[c] = total / NUM_CLASSES + (c < total % NUM_CLASSES ? 1 : 0);
+}
 
-    // Calculate train/test split for this process (90% train, 10% test)
-    int local_train_size = (samples_per_process * 9) / 10;
-    int local_test_size = samples_per_process - local_train_size;
+/**
+ * Split each class's samples across ranks. The remainder of every class is handed out
+ * round-robin, continuing where the previous class stopped, so local totals differ by at most 1.
+ * Outputs this rank's starting position within each class and its share of that class.
+ */
+static void split_across_ranks(const int *class_counts, int rank, int num_processes, int *class_start, int *class_share)
+{
+    int remainder_offset = 0;
 
-    // Calculate samples per class for this process
-    int samples_per_class_total = num_samples / NUM_CLASSES;
-    int samples_per_class_per_process = samples_per_class_total / num_processes;
-    int train_per_class = (local_train_size) / NUM_CLASSES;
-    int test_per_class = (local_test_size) / NUM_CLASSES;
+    for (int c = 0; c < NUM_CLASSES; c++)
+    {
+        int base = class_counts[c] / num_processes;
+        int remainder = class_counts[c] % num_processes;
 
-    // Calculate the starting offset for this rank within each class
-    int class_offset = rank * samples_per_class_per_process;
+        // Accumulate the shares of all lower ranks to find this rank's start
+        class_start[c] = 0;
+        for (int r = 0; r <= rank; r++)
+        {
+            int extra = ((r - remainder_offset + num_processes) % num_processes) < remainder ? 1 : 0;
+            if (r < rank)
+                class_start[c] += base + extra;
+            else
+                class_share[c] = base + extra;
+        }
+
+        remainder_offset = (remainder_offset + remainder) % num_processes;
+    }
+}
+
+int prepare_cifar10_data(int num_train_samples, int num_test_samples, int rank, int num_processes)
+{
+    // Global per-class counts (balanced classes, train images first within each class)
+    int train_per_class[NUM_CLASSES];
+    int test_per_class[NUM_CLASSES];
+    split_class_counts(num_train_samples, train_per_class);
+    split_class_counts(num_test_samples, test_per_class);
+
+    // This rank's portion of each class
+    int train_start[NUM_CLASSES], train_share[NUM_CLASSES];
+    int test_start[NUM_CLASSES], test_share[NUM_CLASSES];
+    split_across_ranks(train_per_class, rank, num_processes, train_start, train_share);
+    split_across_ranks(test_per_class, rank, num_processes, test_start, test_share);
+
+    int local_train_size = 0;
+    int local_test_size = 0;
+    for (int c = 0; c < NUM_CLASSES; c++)
+    {
+        // Test images of a class follow all of its training images
+        test_start[c] += train_per_class[c];
+        local_train_size += train_share[c];
+        local_test_size += test_share[c];
+    }
 
     // Allocate memory for transformed data structure
     data = (CIFAR10Data *)malloc(sizeof(CIFAR10Data));
@@ -36,34 +85,25 @@ int prepare_cifar10_data(int num_samples, int rank, int num_processes)
     data->test_size = local_test_size;
 
     // Create matrices for this process's local data
-    data->X_train = new_matrix(PIXELS_PER_IMAGE, local_train_size);
-    data->Y_train = new_matrix(NUM_CLASSES, local_train_size);
-    data->X_test = new_matrix(PIXELS_PER_IMAGE, local_test_size);
-    data->Y_test = new_matrix(NUM_CLASSES, local_test_size);
-
-    // Track how many samples collected per class for this process
-    int class_train_count[NUM_CLASSES] = {0};
-    int class_test_count[NUM_CLASSES] = {0};
+    data->X_train = new_matrix_first_touch(PIXELS_PER_IMAGE, local_train_size);
+    data->Y_train = new_matrix_first_touch(NUM_CLASSES, local_train_size);
+    data->X_test = new_matrix_first_touch(PIXELS_PER_IMAGE, local_test_size);
+    data->Y_test = new_matrix_first_touch(NUM_CLASSES, local_test_size);
+
+    // Track how many samples of each class have been seen so far
     int class_seen_count[NUM_CLASSES] = {0};
     int train_idx = 0;
     int test_idx = 0;
 
-    // Process all images and distribute to train/test based on class and rank offset
+    // Process all images and distribute to train/test based on class position and rank range
     for (int i = 0; i < TOTAL_IMAGES && (train_idx < local_train_size || test_idx < local_test_size); i++)
     {
         uint8_t label = cifar10_images[i].label;
         int seen_in_class = class_seen_count[label];
         class_seen_count[label]++;
 
-        // Check if this sample belongs to this rank's portion
-        // Each rank gets samples [class_offset, class_offset + samples_per_class_per_process - 1] for each class
-        if (seen_in_class < class_offset || seen_in_class >= class_offset + samples_per_class_per_process)
-        {
-            continue; // This sample belongs to another rank
-        }
-
-        // Add to training set if this class needs more training samples
-        if (class_train_count[label] < train_per_class && train_idx < local_train_size)
+        // Add to training set if this position is in this rank's training range
+        if (seen_in_class >= train_start[label] && seen_in_class < train_start[label] + train_share[label])
         {
             // Set one-hot encoding for label (matrices are 1-indexed via mget)
             mget(data->Y_train, label + 1, train_idx + 1) = 1.0;
@@ -74,11 +114,10 @@ int prepare_cifar10_data(int num_samples, int rank, int num_processes)
                 mget(data->X_train, pixel + 1, train_idx + 1) = cifar10_images[i].data[pixel] / 255.0;
             }
 
-            class_train_count[label]++;
             train_idx++;
         }
-        // Add to test set if this class needs more test samples
-        else if (class_test_count[label] < test_per_class && test_idx < local_test_size)
+        // Add to test set if this position is in this rank's test range
+        else if (seen_in_class >= test_start[label] && seen_in_class < test_start[label] + test_share[label])
         {
             // Set one-hot encoding for label
             mget(data->Y_test, label + 1, test_idx + 1) = 1.0;
@@ -89,7 +128,6 @@ int prepare_cifar10_data(int num_samples, int rank, int num_processes)
                 mget(data->X_test, pixel + 1, test_idx + 1) = cifar10_images[i].data[pixel] / 255.0;
             }
 
-            class_test_count[label]++;
             test_idx++;
         }
     }
@@ -116,4 +154,4 @@ void cleanup_transformed_data(void)
     delete_matrix(&data->Y_test);
     free(data);
     data = NULL;
-}
\ No newline at end of file
+}
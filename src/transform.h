@@ -20,11 +20,12 @@ extern CIFAR10Data *data;
 
 /**
  * Prepare CIFAR-10 data for a specific MPI rank
- * Given num_processes P, rank r (0 to P-1), and total num_samples n,
- * each rank gets a disjoint subset: rank r gets samples [r*n/P, (r+1)*n/P-1] from each class
+ * Given num_processes P and rank r (0 to P-1), the global train and test counts are split
+ * evenly over the 10 classes, and each class is split into disjoint contiguous ranges across
+ * ranks. Remainders are spread round-robin so local sizes differ by at most one sample.
  * Returns 0 on success, 1 on error
  */
-int prepare_cifar10_data(int num_samples, int rank, int num_processes);
+int prepare_cifar10_data(int num_train_samples, int num_test_samples, int rank, int num_processes);
 
 // Clean up transformed data
 void cleanup_transformed_data(void);
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <omp.h>
+
+#include "load.h"
+#include "matrix.h"
+#include "nn.h"
+#include "nn_params.h"
+#include "config.h"
+#include "autotune.h"
+
+// Kernel microbenchmarks over the network's real layer shapes
+// Sweeps every kernel x layer x batch size x thread count and reports the median time,
+// achieved GFLOP/s and GB/s (analytic FLOP and byte counts), optionally as JSON.
+
+#define MAX_SWEEP 32
+
+typedef enum
+{
+    KERNEL_MULT_ADD_COL, // Z = W * A + b (forward, the variant training binds for the shape)
+    KERNEL_RELU,         // A = relu(Z) (hidden layers)
+    KERNEL_SOFTMAX,      // A = softmax(Z) (output layer)
+    KERNEL_WEIGHT_GRAD,  // dW += dZ * A^T / m
+    KERNEL_BIAS_GRAD,    // db += sum(dZ, axis=1) / m
+    KERNEL_INPUT_GRAD,   // dZ_prev = (W^T * dZ) masked by the ReLU of the layer below
+    KERNEL_PREDICT,      // Inference-only forward over the whole network
+    KERNEL_COUNT
+} kernel_id;
+
+static const char *kernel_names[KERNEL_COUNT] = {
+    "matrix_mult_add_col", "relu", "softmax", "backward_weight_grad", "backward_bias_grad",
+    "backward_input_grad", "L_model_predict"};
+
+// Inputs and preallocated outputs for one layer at one batch size (the kernels write into buffers,
+// as they do in a plan's slab)
+typedef struct
+{
+    matrix W;       // out x in
+    matrix b;       // out x 1
+    matrix A;       // in x batch (also the ReLU mask of the layer below)
+    matrix Z;       // out x batch
+    matrix dZ;      // out x batch
+    matrix out;     // out x batch
+    matrix scratch; // batch x in (transposed input of the forward GEMM)
+    matrix dW;      // out x in
+    matrix db;      // out x 1
+    matrix dA;      // in x batch
+    gemm_variant variant;
+} layer_inputs;
+
+typedef struct
+{
+    int warmup;
+    int reps;
+    int batches[MAX_SWEEP];
+    int num_batches;
+    int threads[MAX_SWEEP];
+    int num_threads;
+    const char *kernel_filter; // Substring match on kernel name (NULL = all)
+    const char *json_file;
+    int autotune;             // Tune the GEMM kernels instead of benchmarking
+    const char *tuning_file;  // Output of --autotune (NULL = tuning_<hostname>.txt)
+} bench_options;
+
+// Helper functions
+static int parse_list(const char *text, int *values);
+static void fill_random(matrix *A, unsigned int *seed);
+static double run_once(kernel_id kernel, layer_inputs *in, const nn_params *params, predict_workspace *ws);
+static void kernel_cost(kernel_id kernel, const layer_inputs *in, const nn_params *params, double *flops, double *bytes);
+static int compare_doubles(const void *a, const void *b);
+
+static void print_usage(const char *prog_name)
+{
+    printf("Usage: %s [OPTIONS]\n", prog_name);
+    printf("Options:\n");
+    printf("  -w, --warmup <num>        Untimed warmup runs per point (default 3)\n");
+    printf("  -r, --reps <num>          Timed repetitions per point (default 15)\n");
+    printf("  -b, --batches <list>      Comma-separated batch sizes (default 1,8,32,64,128,256,512)\n");
+    printf("  -t, --threads <list>      Comma-separated thread counts (default 1,2,4,... up to max)\n");
+    printf("  -k, --kernel <name>       Only run kernels whose name contains <name>\n");
+    printf("  -j, --json <file>         Write machine-readable results to <file>\n");
+    printf("  --autotune                Offline autotuning: tile sizes / schedules per GEMM shape at every\n");
+    printf("                            batch size and thread count, plus a ranks x threads recommendation\n");
+    printf("  --tuning-file <file>      Tuning file written by --autotune (default tuning_<hostname>.txt)\n");
+    printf("  -h, --help                Show this help message\n");
+}
+
+static int parse_list(const char *text, int *values)
+{
+    int count = 0;
+    char *copy = strdup(text);
+    for (char *token = strtok(copy, ","); token && count < MAX_SWEEP; token = strtok(NULL, ","))
+    {
+        int value = atoi(token);
+        if (value > 0)
+            values[count++] = value;
+    }
+    free(copy);
+    return count;
+}
+
+static void fill_random(matrix *A, unsigned int *seed)
+{
+    for (size_t i = 0; i < (size_t)A->rows * A->cols; i++)
+        A->val[i] = (double)rand_r(seed) / RAND_MAX - 0.5;
+}
+
+/**
+ * Run one kernel and return its wall time in ms (the backward kernels run as tasks of a parallel
+ * region, as in the backward task graph)
+ */
+static double run_once(kernel_id kernel, layer_inputs *in, const nn_params *params, predict_workspace *ws)
+{
+    struct timespec start, end;
+    const double inv_m = 1.0 / in->A.cols;
+    int *predictions = NULL;
+
+    if (kernel == KERNEL_PREDICT)
+        predictions = (int *)malloc(sizeof(int) * in->A.cols);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    switch (kernel)
+    {
+    case KERNEL_MULT_ADD_COL:
+        matrix_mult_add_col_variant(in->variant, &in->W, &in->A, &in->b, &in->out, &in->scratch);
+        break;
+    case KERNEL_RELU:
+        relu_into(&in->Z, &in->out);
+        break;
+    case KERNEL_SOFTMAX:
+        softmax_into(&in->Z, &in->out);
+        break;
+    case KERNEL_WEIGHT_GRAD:
+#pragma omp parallel
+#pragma omp master
+        backward_weight_grad(&in->dZ, &in->A, inv_m, 1.0, 1, 0, &in->dW);
+        break;
+    case KERNEL_BIAS_GRAD:
+#pragma omp parallel
+#pragma omp master
+        backward_bias_grad(&in->dZ, inv_m, 1.0, 1, &in->db);
+        break;
+    case KERNEL_INPUT_GRAD:
+#pragma omp parallel
+#pragma omp master
+        backward_input_grad(&in->W, &in->dZ, &in->A, 0, 0, &in->dA);
+        break;
+    case KERNEL_PREDICT:
+        L_model_predict(&in->A, params, ws, predictions);
+        break;
+    default:
+        break;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    free(predictions);
+    return (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+/**
+ * Analytic FLOPs and compulsory bytes moved (doubles read + written once)
+ */
+static void kernel_cost(kernel_id kernel, const layer_inputs *in, const nn_params *params, double *flops, double *bytes)
+{
+    const double out = in->W.rows;
+    const double inp = in->W.cols;
+    const double m = in->A.cols;
+    const double d = sizeof(double);
+
+    switch (kernel)
+    {
+    case KERNEL_MULT_ADD_COL:
+        *flops = 2.0 * out * inp * m + out * m;
+        *bytes = (out * inp + inp * m + out * m + out) * d;
+        break;
+    case KERNEL_RELU:
+        *flops = out * m;
+        *bytes = 2.0 * out * m * d;
+        break;
+    case KERNEL_SOFTMAX:
+        *flops = 4.0 * out * m;
+        *bytes = 2.0 * out * m * d;
+        break;
+    case KERNEL_WEIGHT_GRAD:
+        *flops = 2.0 * out * inp * m;
+        *bytes = (out * m + inp * m + 2.0 * out * inp) * d;
+        break;
+    case KERNEL_BIAS_GRAD:
+        *flops = out * m;
+        *bytes = (out * m + 2.0 * out) * d;
+        break;
+    case KERNEL_INPUT_GRAD:
+        *flops = 2.0 * out * inp * m;
+        *bytes = (out * inp + out * m + 2.0 * inp * m) * d;
+        break;
+    case KERNEL_PREDICT:
+        *flops = 0.0;
+        *bytes = in->A.rows * m * d;
+        for (int l = 0; l < params->L; l++)
+        {
+            *flops += 2.0 * params->W[l].rows * params->W[l].cols * m;
+            *bytes += (double)params->W[l].rows * params->W[l].cols * d;
+        }
+        break;
+    default:
+        *flops = *bytes = 0.0;
+        break;
+    }
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_options opts;
+    opts.warmup = 3;
+    opts.reps = 15;
+    opts.num_batches = parse_list("1,8,32,64,128,256,512", opts.batches);
+    opts.num_threads = 0;
+    for (int t = 1; t <= omp_get_max_threads() && opts.num_threads < MAX_SWEEP; t *= 2)
+        opts.threads[opts.num_threads++] = t;
+    opts.kernel_filter = NULL;
+    opts.json_file = NULL;
+    opts.autotune = 0;
+    opts.tuning_file = NULL;
+
+    // Parse command-line arguments
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else if ((strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--warmup") == 0) && i + 1 < argc)
+            opts.warmup = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--reps") == 0) && i + 1 < argc)
+            opts.reps = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batches") == 0) && i + 1 < argc)
+            opts.num_batches = parse_list(argv[++i], opts.batches);
+        else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc)
+            opts.num_threads = parse_list(argv[++i], opts.threads);
+        else if ((strcmp(argv[i], "-k") == 0 || strcmp(argv[i], "--kernel") == 0) && i + 1 < argc)
+            opts.kernel_filter = argv[++i];
+        else if ((strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--json") == 0) && i + 1 < argc)
+            opts.json_file = argv[++i];
+        else if (strcmp(argv[i], "--autotune") == 0)
+            opts.autotune = 1;
+        else if (strcmp(argv[i], "--tuning-file") == 0 && i + 1 < argc)
+            opts.tuning_file = argv[++i];
+        else
+        {
+            fprintf(stderr, "Error: Unknown argument '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (opts.reps <= 0 || opts.warmup < 0 || opts.num_batches == 0 || opts.num_threads == 0)
+    {
+        fprintf(stderr, "Error: Need positive repetitions, batch sizes and thread counts\n");
+        return 1;
+    }
+
+    // Same architecture as training
+    int layer_dims[] = {PIXELS_PER_IMAGE, 128, 64, NUM_CLASSES};
+    int L = 3;
+    nn_params params = initialize_parameters_he(layer_dims, L, 0);
+
+    // Offline autotuning: write the per-host tuning file that training runs load
+    if (opts.autotune)
+    {
+        char path[300];
+        if (opts.tuning_file)
+            snprintf(path, sizeof(path), "%s", opts.tuning_file);
+        else
+            autotune_default_path(path, sizeof(path));
+
+        for (int ti = 0; ti < opts.num_threads; ti++)
+        {
+            omp_set_num_threads(opts.threads[ti]);
+            autotune_kernels(layer_dims, L, layer_dims[1], opts.batches, opts.num_batches, opts.reps, 1);
+        }
+        tune_layout layout = autotune_layout(layer_dims, L, DEFAULT_BATCH_SIZE, autotune_node_cores(MPI_COMM_NULL), opts.reps, 1);
+
+        if (autotune_save(path, &layout) != 0)
+        {
+            fprintf(stderr, "Error: Cannot write tuning file %s\n", path);
+            return 1;
+        }
+        printf("Wrote %d tuned kernel shapes to %s\n", g_tune_count, path);
+        delete_nn_params(&params);
+        return 0;
+    }
+
+    FILE *json = NULL;
+    if (opts.json_file)
+    {
+        json = fopen(opts.json_file, "w");
+        if (!json)
+        {
+            fprintf(stderr, "Error: Cannot open %s for writing\n", opts.json_file);
+            return 1;
+        }
+        char host[256] = "unknown";
+        gethostname(host, sizeof(host));
+        fprintf(json, "{\n  \"version\": 1,\n  \"host\": \"%s\",\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"results\": [",
+                host, opts.warmup, opts.reps);
+    }
+
+    printf("%-26s %-10s %6s %7s %11s %11s %9s %9s\n",
+           "Kernel", "Shape", "Batch", "Threads", "Median(ms)", "Min(ms)", "GFLOP/s", "GB/s");
+
+    double *times = (double *)malloc(sizeof(double) * opts.reps);
+    unsigned int seed = RANDOM_SEED;
+    int first_result = 1;
+
+    for (int bi = 0; bi < opts.num_batches; bi++)
+    {
+        int batch = opts.batches[bi];
+
+        for (int l = 0; l < L; l++)
+        {
+            // Inputs for this layer and batch size
+            layer_inputs in;
+            in.W = params.W[l];
+            in.b = params.b[l];
+            in.A = new_matrix(layer_dims[l], batch);
+            in.Z = new_matrix(layer_dims[l + 1], batch);
+            in.dZ = new_matrix(layer_dims[l + 1], batch);
+            in.out = new_matrix(layer_dims[l + 1], batch);
+            in.scratch = new_matrix(batch, layer_dims[l]);
+            in.dW = new_matrix(layer_dims[l + 1], layer_dims[l]);
+            in.db = new_matrix(layer_dims[l + 1], 1);
+            in.dA = new_matrix(layer_dims[l], batch);
+            in.variant = gemm_select_variant(layer_dims[l + 1], layer_dims[l], batch);
+            fill_random(&in.A, &seed);
+            fill_random(&in.Z, &seed);
+            fill_random(&in.dZ, &seed);
+
+            for (int k = 0; k < KERNEL_COUNT; k++)
+            {
+                // Activation kernels depend on the layer (training never needs the input's gradient);
+                // the whole-network pass runs once per batch
+                if (k == KERNEL_RELU && l == L - 1)
+                    continue;
+                if (k == KERNEL_INPUT_GRAD && l == 0)
+                    continue;
+                if (k == KERNEL_SOFTMAX && l != L - 1)
+                    continue;
+                if (k == KERNEL_PREDICT && l != 0)
+                    continue;
+                if (opts.kernel_filter && !strstr(kernel_names[k], opts.kernel_filter))
+                    continue;
+
+                char shape[32];
+                if (k == KERNEL_PREDICT)
+                    snprintf(shape, sizeof(shape), "network");
+                else
+                    snprintf(shape, sizeof(shape), "%dx%d", layer_dims[l + 1], layer_dims[l]);
+
+                double flops, bytes;
+                kernel_cost((kernel_id)k, &in, &params, &flops, &bytes);
+
+                for (int ti = 0; ti < opts.num_threads; ti++)
+                {
+                    omp_set_num_threads(opts.threads[ti]);
+
+                    // The inference plan and its slabs are built once per team size, as in evaluation
+                    predict_workspace ws;
+                    if (k == KERNEL_PREDICT)
+                        predict_workspace_init(&ws, &params, INFERENCE_CHUNK_SIZE, opts.threads[ti]);
+
+                    for (int r = 0; r < opts.warmup; r++)
+                        run_once((kernel_id)k, &in, &params, &ws);
+                    for (int r = 0; r < opts.reps; r++)
+                        times[r] = run_once((kernel_id)k, &in, &params, &ws);
+                    if (k == KERNEL_PREDICT)
+                        predict_workspace_free(&ws);
+
+                    qsort(times, opts.reps, sizeof(double), compare_doubles);
+                    double median = opts.reps % 2 ? times[opts.reps / 2]
+                                                  : 0.5 * (times[opts.reps / 2 - 1] + times[opts.reps / 2]);
+                    double gflops = median > 0.0 ? flops / (median / 1000.0) / 1e9 : 0.0;
+                    double gbps = median > 0.0 ? bytes / (median / 1000.0) / 1e9 : 0.0;
+
+                    printf("%-26s %-10s %6d %7d %11.4f %11.4f %9.3f %9.3f\n",
+                           kernel_names[k], shape, batch, opts.threads[ti], median, times[0], gflops, gbps);
+
+                    if (json)
+                    {
+                        fprintf(json, "%s\n    {\"kernel\": \"%s\", \"shape\": \"%s\", \"batch\": %d, \"threads\": %d, "
+                                      "\"median_ms\": %.6f, \"min_ms\": %.6f, \"max_ms\": %.6f, "
+                                      "\"flops\": %.0f, \"bytes\": %.0f, \"gflops\": %.4f, \"gbps\": %.4f}",
+                                first_result ? "" : ",", kernel_names[k], shape, batch, opts.threads[ti],
+                                median, times[0], times[opts.reps - 1], flops, bytes, gflops, gbps);
+                        first_result = 0;
+                    }
+                }
+            }
+
+            delete_matrix(&in.A);
+            delete_matrix(&in.Z);
+            delete_matrix(&in.dZ);
+            delete_matrix(&in.out);
+            delete_matrix(&in.scratch);
+            delete_matrix(&in.dW);
+            delete_matrix(&in.db);
+            delete_matrix(&in.dA);
+        }
+    }
+
+    if (json)
+    {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+        printf("Results written to %s\n", opts.json_file);
+    }
+
+    free(times);
+    delete_nn_params(&params);
+    return 0;
+}
@@ -0,0 +1,297 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "load.h"
+#include "config.h"
+#include "inference.h"
+#include "server.h"
+
+// Load generator for the inference server (predict.exe --serve)
+// Opens one connection per simulated client, each sending images back to back (closed loop: the
+// next request goes out when the previous answer is back), and reports the served throughput and
+// the latency distribution. Images come from a CIFAR-10 binary file (accuracy reported from its
+// labels) or are random.
+
+#define DEFAULT_CONNECTIONS 8
+#define DEFAULT_REQUESTS 1000
+#define DEFAULT_WARMUP 10
+#define RANDOM_IMAGES 256
+
+typedef struct
+{
+    const char *socket_path;
+    const uint8_t *images; // Image i at images + i * stride
+    const uint8_t *labels; // NULL for random images
+    size_t stride;
+    int num_images;
+    int client;
+    int requests;
+    int warmup;
+
+    // Results
+    double *latency; // ms per timed request
+    int completed;
+    int correct;
+    int failed;
+} client_arg;
+
+// Helper functions
+static double now_ms(void);
+static int compare_doubles(const void *a, const void *b);
+static int read_full(int fd, void *buf, size_t bytes);
+static int write_full(int fd, const void *buf, size_t bytes);
+static void *client_thread(void *arg);
+
+static void print_usage(const char *prog_name)
+{
+    printf("Usage: %s -s <socket> [OPTIONS]\n", prog_name);
+    printf("Options:\n");
+    printf("  -s, --socket <path>       Server socket (predict.exe --serve <path>)\n");
+    printf("  -c, --connections <num>   Concurrent clients (default %d)\n", DEFAULT_CONNECTIONS);
+    printf("  -n, --requests <num>      Timed requests per client (default %d)\n", DEFAULT_REQUESTS);
+    printf("  -w, --warmup <num>        Untimed requests per client first (default %d)\n", DEFAULT_WARMUP);
+    printf("  -d, --data <file>         Send the images of a CIFAR-10 binary file (default: random images)\n");
+    printf("  -h, --help                Show this help message\n");
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int read_full(int fd, void *buf, size_t bytes)
+{
+    char *p = (char *)buf;
+    while (bytes > 0)
+    {
+        ssize_t got = read(fd, p, bytes);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 1;
+        p += got;
+        bytes -= got;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t bytes)
+{
+    const char *p = (const char *)buf;
+    while (bytes > 0)
+    {
+        ssize_t sent = write(fd, p, bytes);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return 1;
+        p += sent;
+        bytes -= sent;
+    }
+    return 0;
+}
+
+/**
+ * One client: connect, check the model's shape and send warmup + timed requests back to back
+ */
+static void *client_thread(void *arg)
+{
+    client_arg *c = (client_arg *)arg;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, c->socket_path, sizeof(addr.sun_path) - 1);
+
+    uint32_t hello[SERVE_HELLO_WORDS];
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || read_full(fd, hello, sizeof(hello)) != 0)
+    {
+        fprintf(stderr, "Error: Client %d cannot connect to %s (%s)\n", c->client, c->socket_path, strerror(errno));
+        c->failed = 1;
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    if (hello[0] != PIXELS_PER_IMAGE)
+    {
+        fprintf(stderr, "Error: Server takes %u-byte inputs, images have %d\n", hello[0], PIXELS_PER_IMAGE);
+        c->failed = 1;
+        close(fd);
+        return NULL;
+    }
+
+    const int num_classes = hello[1];
+    float *probs = (float *)malloc(sizeof(float) * num_classes);
+    for (int r = 0; r < c->warmup + c->requests; r++)
+    {
+        // Clients start at different images
+        const int i = (c->client * 7919 + r) % c->num_images;
+        const double begin = now_ms();
+        if (write_full(fd, c->images + (size_t)i * c->stride, PIXELS_PER_IMAGE) != 0 ||
+            read_full(fd, probs, sizeof(float) * num_classes) != 0)
+        {
+            fprintf(stderr, "Error: Client %d lost the connection\n", c->client);
+            c->failed = 1;
+            break;
+        }
+        if (r < c->warmup)
+            continue;
+
+        c->latency[c->completed++] = now_ms() - begin;
+        if (c->labels)
+        {
+            int pred_class = 0;
+            for (int k = 1; k < num_classes; k++)
+                if (probs[k] > probs[pred_class])
+                    pred_class = k;
+            c->correct += pred_class == c->labels[(size_t)i * c->stride];
+        }
+    }
+
+    free(probs);
+    close(fd);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket_path = NULL;
+    const char *data_file = NULL;
+    int connections = DEFAULT_CONNECTIONS;
+    int requests = DEFAULT_REQUESTS;
+    int warmup = DEFAULT_WARMUP;
+
+    // Parse command-line arguments
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else if ((strcmp(argv[i], "-s") == 0 || strcmp(argv[i], "--socket") == 0) && i + 1 < argc)
+            socket_path = argv[++i];
+        else if ((strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--connections") == 0) && i + 1 < argc)
+            connections = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--requests") == 0) && i + 1 < argc)
+            requests = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "--warmup") == 0) && i + 1 < argc)
+            warmup = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--data") == 0) && i + 1 < argc)
+            data_file = argv[++i];
+        else
+        {
+            fprintf(stderr, "Error: Unknown argument '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!socket_path)
+    {
+        fprintf(stderr, "Error: No server socket given (-s <path>)\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (connections <= 0 || requests <= 0 || warmup < 0)
+    {
+        fprintf(stderr, "Error: Need positive connection and request counts\n");
+        return 1;
+    }
+
+    // Images to send: CIFAR-10 records in place past their label byte, or random pixels
+    uint8_t *records;
+    int num_images;
+    client_arg proto;
+    memset(&proto, 0, sizeof(proto));
+    if (data_file)
+    {
+        records = inference_read_records(data_file, RECORD_SIZE, &num_images);
+        if (!records)
+            return 1;
+        proto.images = records + 1;
+        proto.labels = records;
+        proto.stride = RECORD_SIZE;
+    }
+    else
+    {
+        num_images = RANDOM_IMAGES;
+        records = (uint8_t *)malloc((size_t)num_images * PIXELS_PER_IMAGE);
+        unsigned int seed = RANDOM_SEED;
+        for (size_t k = 0; k < (size_t)num_images * PIXELS_PER_IMAGE; k++)
+            records[k] = (uint8_t)rand_r(&seed);
+        proto.images = records;
+        proto.stride = PIXELS_PER_IMAGE;
+    }
+    proto.socket_path = socket_path;
+    proto.num_images = num_images;
+    proto.requests = requests;
+    proto.warmup = warmup;
+
+    client_arg *clients = (client_arg *)malloc(sizeof(client_arg) * connections);
+    pthread_t *threads = (pthread_t *)malloc(sizeof(pthread_t) * connections);
+    const double begin = now_ms();
+    for (int c = 0; c < connections; c++)
+    {
+        clients[c] = proto;
+        clients[c].client = c;
+        clients[c].latency = (double *)malloc(sizeof(double) * requests);
+        pthread_create(&threads[c], NULL, client_thread, &clients[c]);
+    }
+    for (int c = 0; c < connections; c++)
+        pthread_join(threads[c], NULL);
+    const double elapsed_ms = now_ms() - begin;
+
+    // Latencies of every client together
+    double *all = (double *)malloc(sizeof(double) * connections * requests);
+    int total = 0, correct = 0, failed = 0;
+    for (int c = 0; c < connections; c++)
+    {
+        memcpy(all + total, clients[c].latency, sizeof(double) * clients[c].completed);
+        total += clients[c].completed;
+        correct += clients[c].correct;
+        failed += clients[c].failed;
+        free(clients[c].latency);
+    }
+
+    if (total > 0)
+    {
+        qsort(all, total, sizeof(double), compare_doubles);
+        double sum = 0.0;
+        for (int r = 0; r < total; r++)
+            sum += all[r];
+
+        printf("Clients: %d x %d requests (%d warmup each)%s\n", connections, requests, warmup,
+               failed ? ", some FAILED" : "");
+        printf("Throughput: %.0f images/s (%d timed requests, %.2f s in total)\n",
+               (double)(total + connections * warmup) / (elapsed_ms / 1000.0), total, elapsed_ms / 1000.0);
+        printf("Latency (ms): mean %.4f  p50 %.4f  p90 %.4f  p99 %.4f  p99.9 %.4f  max %.4f\n", sum / total,
+               all[(int)(0.50 * (total - 1))], all[(int)(0.90 * (total - 1))], all[(int)(0.99 * (total - 1))],
+               all[(int)(0.999 * (total - 1))], all[total - 1]);
+        if (proto.labels)
+            printf("Accuracy: %.2f%%\n", 100.0 * correct / total);
+    }
+
+    free(all);
+    free(clients);
+    free(threads);
+    free(records);
+    return failed == connections ? 1 : 0;
+}
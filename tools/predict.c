@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <omp.h>
+
+#include "load.h"
+#include "config.h"
+#include "inference.h"
+#include "server.h"
+
+// Batched inference with a trained model (a checkpoint written by main.exe --checkpoint)
+// Classifies a CIFAR-10 binary file (accuracy reported from its labels) or a file of raw uint8
+// images, sending them to the engine as requests of a fixed size, and reports images/s and the
+// p50/p99 request latency in throughput mode (large requests, all threads) and latency mode
+// (one image per request, one thread). With --int8, the int8 model (calibrated on training
+// images) runs too and its accuracy is compared with the double model's. With --serve, serves the
+// model on a Unix socket instead (see server.h; tools/loadgen.c drives it).
+
+#define DEFAULT_PREDICT_DATA "cifar-10-batches-bin/test_batch.bin"
+#define DEFAULT_CALIB_DATA "cifar-10-batches-bin/data_batch_1.bin"
+#define DEFAULT_REQUEST_SIZE 256
+#define WARMUP_REQUESTS 8
+
+typedef struct
+{
+    const char *model_file;
+    const char *data_file; // CIFAR-10 binary (labelled)
+    const char *raw_file;  // Raw images (NULL = use data_file)
+    const char *output_file;
+    int run_throughput;
+    int run_latency;
+    int request_size; // Images per request in throughput mode
+    int chunk_size;
+    int num_threads;
+    int reps;
+    int limit; // Images used (0 = all)
+    const char *socket_path; // Serve instead of classifying a file
+    int max_batch;
+    int max_wait_us;
+    int num_workers;
+    int threads_set; // -t given (servers default to one thread per worker)
+    int int8;
+    const char *calib_file; // Calibration images for --int8 (NULL = default)
+} predict_options;
+
+// Images of a calibration sample (image j at images + j * stride)
+typedef struct
+{
+    const uint8_t *images;
+    size_t stride;
+    int count;
+} image_set;
+
+// Helper functions
+static double now_ms(void);
+static int compare_doubles(const void *a, const void *b);
+static double run_mode(const predict_options *opts, inference_mode mode, const image_set *calib,
+                       const uint8_t *images, size_t stride, const uint8_t *labels, int count);
+
+static void print_usage(const char *prog_name)
+{
+    printf("Usage: %s -m <checkpoint> [OPTIONS]\n", prog_name);
+    printf("Options:\n");
+    printf("  -m, --model <file>        Trained model (written by main.exe --checkpoint)\n");
+    printf("  -d, --data <file>         CIFAR-10 binary file to classify (default %s)\n", DEFAULT_PREDICT_DATA);
+    printf("  --raw <file>              Classify raw uint8 images instead (input-size bytes each, no labels)\n");
+    printf("  --mode <mode>             throughput, latency or both (default both)\n");
+    printf("  -b, --batch <num>         Images per request in throughput mode (default %d)\n", DEFAULT_REQUEST_SIZE);
+    printf("  -c, --chunk <num>         Samples per forward pass of one thread (default %d)\n", INFERENCE_CHUNK_SIZE);
+    printf("  -t, --threads <num>       Threads in throughput mode (default: all)\n");
+    printf("  -r, --reps <num>          Passes over the images (default 1)\n");
+    printf("  -n, --num <num>           Only use the first <num> images\n");
+    printf("  -o, --output <file>       Write the class and probabilities of every image as CSV\n");
+    printf("  --int8                    Also run the int8 model and report its accuracy delta\n");
+    printf("  --calib <file>            Calibration images for --int8, in the input's format (default: first\n");
+    printf("                            %d images of %s, or of the --raw file)\n", QUANT_CALIBRATION_SAMPLES, DEFAULT_CALIB_DATA);
+    printf("  --serve <socket>          Serve the model on a Unix domain socket until interrupted\n");
+    printf("  --max-batch <num>         Largest dynamic batch when serving (default %d)\n", SERVE_MAX_BATCH);
+    printf("  --max-wait-us <num>       Longest wait for a batch to fill when serving (default %d)\n", SERVE_MAX_WAIT_US);
+    printf("  --workers <num>           Batch workers when serving, -t threads each (default %d x 1)\n", SERVE_WORKERS);
+    printf("  -h, --help                Show this help message\n");
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Time every request of reps passes over the images with one engine tuning (int8 if calib is not
+ * NULL) and print its row. Returns the accuracy in percent (-1 without labels)
+ */
+static double run_mode(const predict_options *opts, inference_mode mode, const image_set *calib,
+                       const uint8_t *images, size_t stride, const uint8_t *labels, int count)
+{
+    inference_engine engine;
+    if (inference_init(&engine, opts->model_file, mode, opts->chunk_size, opts->num_threads) != 0)
+        return -1.0;
+    if (calib)
+        inference_quantize(&engine, calib->images, calib->stride, calib->count);
+
+    const int request_size = mode == INFERENCE_LATENCY ? 1 : opts->request_size;
+    const int requests_per_pass = (count + request_size - 1) / request_size;
+    const int num_requests = requests_per_pass * opts->reps;
+    int *classes = (int *)malloc(sizeof(int) * count);
+    double *latency = (double *)malloc(sizeof(double) * num_requests);
+
+    for (int r = 0; r < WARMUP_REQUESTS && r < requests_per_pass; r++)
+    {
+        const int start = r * request_size;
+        const int n = start + request_size <= count ? request_size : count - start;
+        inference_run(&engine, images + (size_t)start * stride, stride, n, classes + start, NULL);
+    }
+
+    double begin = now_ms();
+    for (int q = 0; q < num_requests; q++)
+    {
+        const int start = (q % requests_per_pass) * request_size;
+        const int n = start + request_size <= count ? request_size : count - start;
+        double request_begin = now_ms();
+        inference_run(&engine, images + (size_t)start * stride, stride, n, classes + start, NULL);
+        latency[q] = now_ms() - request_begin;
+    }
+    double elapsed_ms = now_ms() - begin;
+
+    qsort(latency, num_requests, sizeof(double), compare_doubles);
+    const double p50 = latency[(int)(0.50 * (num_requests - 1))];
+    const double p99 = latency[(int)(0.99 * (num_requests - 1))];
+
+    char accuracy[16] = "-";
+    double accuracy_pct = -1.0;
+    if (labels)
+    {
+        int correct = 0;
+        for (int j = 0; j < count; j++)
+            correct += classes[j] == labels[(size_t)j * stride];
+        accuracy_pct = 100.0 * correct / count;
+        snprintf(accuracy, sizeof(accuracy), "%.2f%%", accuracy_pct);
+    }
+    printf("%-11s %-7s %7d %7d %7d %12.0f %10.4f %10.4f %9s\n", mode == INFERENCE_LATENCY ? "latency" : "throughput",
+           calib ? "int8" : "double", request_size, engine.chunk_size, engine.num_threads,
+           (double)count * opts->reps / (elapsed_ms / 1000.0), p50, p99, accuracy);
+
+    free(latency);
+    free(classes);
+    inference_free(&engine);
+    return accuracy_pct;
+}
+
+int main(int argc, char *argv[])
+{
+    predict_options opts;
+    opts.model_file = NULL;
+    opts.data_file = DEFAULT_PREDICT_DATA;
+    opts.raw_file = NULL;
+    opts.output_file = NULL;
+    opts.run_throughput = 1;
+    opts.run_latency = 1;
+    opts.request_size = DEFAULT_REQUEST_SIZE;
+    opts.chunk_size = INFERENCE_CHUNK_SIZE;
+    opts.num_threads = omp_get_max_threads();
+    opts.reps = 1;
+    opts.limit = 0;
+    opts.socket_path = NULL;
+    opts.max_batch = SERVE_MAX_BATCH;
+    opts.max_wait_us = SERVE_MAX_WAIT_US;
+    opts.num_workers = SERVE_WORKERS;
+    opts.threads_set = 0;
+    opts.int8 = 0;
+    opts.calib_file = NULL;
+
+    // Parse command-line arguments
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+        {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else if ((strcmp(argv[i], "-m") == 0 || strcmp(argv[i], "--model") == 0) && i + 1 < argc)
+            opts.model_file = argv[++i];
+        else if ((strcmp(argv[i], "-d") == 0 || strcmp(argv[i], "--data") == 0) && i + 1 < argc)
+            opts.data_file = argv[++i];
+        else if (strcmp(argv[i], "--raw") == 0 && i + 1 < argc)
+            opts.raw_file = argv[++i];
+        else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc)
+        {
+            const char *mode = argv[++i];
+            opts.run_throughput = strcmp(mode, "throughput") == 0 || strcmp(mode, "both") == 0;
+            opts.run_latency = strcmp(mode, "latency") == 0 || strcmp(mode, "both") == 0;
+            if (!opts.run_throughput && !opts.run_latency)
+            {
+                fprintf(stderr, "Error: Unknown mode '%s' (use throughput, latency or both)\n", mode);
+                return 1;
+            }
+        }
+        else if ((strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "--batch") == 0) && i + 1 < argc)
+            opts.request_size = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-c") == 0 || strcmp(argv[i], "--chunk") == 0) && i + 1 < argc)
+            opts.chunk_size = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--threads") == 0) && i + 1 < argc)
+        {
+            opts.num_threads = atoi(argv[++i]);
+            opts.threads_set = 1;
+        }
+        else if ((strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--reps") == 0) && i + 1 < argc)
+            opts.reps = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "--num") == 0) && i + 1 < argc)
+            opts.limit = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-o") == 0 || strcmp(argv[i], "--output") == 0) && i + 1 < argc)
+            opts.output_file = argv[++i];
+        else if (strcmp(argv[i], "--int8") == 0)
+            opts.int8 = 1;
+        else if (strcmp(argv[i], "--calib") == 0 && i + 1 < argc)
+            opts.calib_file = argv[++i];
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            opts.socket_path = argv[++i];
+        else if (strcmp(argv[i], "--max-batch") == 0 && i + 1 < argc)
+            opts.max_batch = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-wait-us") == 0 && i + 1 < argc)
+            opts.max_wait_us = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc)
+            opts.num_workers = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "Error: Unknown argument '%s'\n", argv[i]);
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!opts.model_file)
+    {
+        fprintf(stderr, "Error: No model given (-m <checkpoint>)\n");
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (opts.request_size <= 0 || opts.chunk_size <= 0 || opts.num_threads <= 0 || opts.reps <= 0 || opts.limit < 0)
+    {
+        fprintf(stderr, "Error: Need positive request sizes, chunk sizes, thread counts and repetitions\n");
+        return 1;
+    }
+
+    if (opts.socket_path && (opts.max_batch <= 0 || opts.max_wait_us < 0 || opts.num_workers <= 0))
+    {
+        fprintf(stderr, "Error: Need a positive max batch and worker count and a non-negative max wait\n");
+        return 1;
+    }
+
+    // The engine used for the CSV output also tells the input size of the model
+    inference_engine engine;
+    if (inference_init(&engine, opts.model_file, INFERENCE_THROUGHPUT, opts.chunk_size, opts.num_threads) != 0)
+        return 1;
+
+    // Calibration sample for the int8 model: training images, in the same format as the input
+    image_set calib = {NULL, 0, 0};
+    uint8_t *calib_records = NULL;
+    if (opts.int8)
+    {
+        const char *calib_file = opts.calib_file ? opts.calib_file : opts.raw_file ? opts.raw_file : DEFAULT_CALIB_DATA;
+        calib.stride = opts.raw_file ? (size_t)engine.num_inputs : RECORD_SIZE;
+        calib_records = inference_read_records(calib_file, calib.stride, &calib.count);
+        if (!calib_records)
+        {
+            inference_free(&engine);
+            return 1;
+        }
+        calib.images = opts.raw_file ? calib_records : calib_records + 1;
+        if (calib.count > QUANT_CALIBRATION_SAMPLES)
+            calib.count = QUANT_CALIBRATION_SAMPLES;
+        inference_quantize(&engine, calib.images, calib.stride, calib.count);
+    }
+
+    if (opts.socket_path)
+    {
+        serve_config config;
+        config.socket_path = opts.socket_path;
+        config.model_path = opts.model_file;
+        config.max_batch = opts.max_batch;
+        config.max_wait_us = opts.max_wait_us;
+        config.num_workers = opts.num_workers;
+        config.threads_per_worker = opts.threads_set ? opts.num_threads : 1;
+        config.calib_images = calib.images;
+        config.calib_stride = calib.stride;
+        config.calib_count = calib.count;
+        inference_free(&engine);
+        const int status = serve_run(&config);
+        free(calib_records);
+        return status;
+    }
+
+    // Images stay in the file's layout: CIFAR-10 records are read in place past their label byte
+    int count = 0;
+    size_t stride;
+    const uint8_t *images, *labels;
+    uint8_t *records;
+    if (opts.raw_file)
+    {
+        stride = engine.num_inputs;
+        records = inference_read_records(opts.raw_file, stride, &count);
+        images = records;
+        labels = NULL;
+    }
+    else
+    {
+        if (engine.num_inputs != PIXELS_PER_IMAGE)
+        {
+            fprintf(stderr, "Error: Model takes %d inputs, CIFAR-10 images have %d (use --raw)\n", engine.num_inputs,
+                    PIXELS_PER_IMAGE);
+            inference_free(&engine);
+            free(calib_records);
+            return 1;
+        }
+        stride = RECORD_SIZE;
+        records = inference_read_records(opts.data_file, stride, &count);
+        images = records + 1;
+        labels = records;
+    }
+    if (!records)
+    {
+        inference_free(&engine);
+        free(calib_records);
+        return 1;
+    }
+    if (opts.limit > 0 && opts.limit < count)
+        count = opts.limit;
+
+    printf("Model: %s (", opts.model_file);
+    for (int l = 0; l <= engine.L; l++)
+        printf("%d%s", engine.layer_dims[l], l < engine.L ? "-" : "");
+    printf("), %d images from %s\n\n", count, opts.raw_file ? opts.raw_file : opts.data_file);
+
+    printf("%-11s %-7s %7s %7s %7s %12s %10s %10s %9s\n", "Mode", "Model", "Request", "Chunk", "Threads", "Images/s",
+           "p50(ms)", "p99(ms)", "Accuracy");
+    double accuracy_double = -1.0, accuracy_int8 = -1.0;
+    for (int m = 0; m < 2; m++)
+    {
+        const inference_mode mode = m == 0 ? INFERENCE_THROUGHPUT : INFERENCE_LATENCY;
+        if (!(m == 0 ? opts.run_throughput : opts.run_latency))
+            continue;
+        accuracy_double = run_mode(&opts, mode, NULL, images, stride, labels, count);
+        if (opts.int8)
+            accuracy_int8 = run_mode(&opts, mode, &calib, images, stride, labels, count);
+    }
+    if (opts.int8)
+    {
+        printf("\nInt8 model: %s kernel, calibrated on %d images", quant_kernel_name(), calib.count);
+        if (labels)
+            printf("; accuracy delta %+.2f pp (%.2f%% -> %.2f%%)", accuracy_int8 - accuracy_double, accuracy_double,
+                   accuracy_int8);
+        printf("\n");
+    }
+
+    if (opts.output_file)
+    {
+        FILE *out = fopen(opts.output_file, "w");
+        if (!out)
+        {
+            fprintf(stderr, "Error: Cannot open %s for writing\n", opts.output_file);
+        }
+        else
+        {
+            int *classes = (int *)malloc(sizeof(int) * count);
+            double *probs = (double *)malloc(sizeof(double) * count * engine.num_classes);
+            inference_run(&engine, images, stride, count, classes, probs);
+
+            fprintf(out, "image,class");
+            for (int i = 0; i < engine.num_classes; i++)
+                fprintf(out, ",p%d", i);
+            fprintf(out, "\n");
+            for (int j = 0; j < count; j++)
+            {
+                fprintf(out, "%d,%d", j, classes[j]);
+                for (int i = 0; i < engine.num_classes; i++)
+                    fprintf(out, ",%.6f", probs[(size_t)j * engine.num_classes + i]);
+                fprintf(out, "\n");
+            }
+            fclose(out);
+            printf("\nPredictions written to %s\n", opts.output_file);
+            free(classes);
+            free(probs);
+        }
+    }
+
+    free(records);
+    free(calib_records);
+    inference_free(&engine);
+    return 0;
+}